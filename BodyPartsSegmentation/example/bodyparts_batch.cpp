@@ -0,0 +1,149 @@
+/*
+ * Offline body parts segmentation of depth image sequences.
+ *
+ * Segments the depth images listed in a file and writes one label
+ * image per depth image. Reading, human extraction, classification
+ * and writing run in parallel threads.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <locale.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../src/BodyPartBatch.h"
+
+using namespace std;
+
+typedef struct params
+{
+	string legend_file;
+	bool millimeters;
+	BodyPartBatch::Parameters batch;
+} params;
+
+
+void set_default_params(params* p)
+{
+	p->legend_file = "";
+	p->millimeters = false;
+	BodyPartBatch::defaultParameters(p->batch);
+}
+
+
+void print_usage(params* p)
+{
+	cout << "Usage: bodyparts_batch <options> <forest_file> <depth_list> <output_dir>" << endl;
+	cout << "  <depth_list> contains one 16 bits depth image file per line." << endl;
+	cout << "  the label image of <name>.<ext> is written to <output_dir>/<name>_labels.png," << endl;
+	cout << "  it contains the body part indices (255 for background)." << endl;
+	cout << "  options:" << endl;
+	cout << "    -j (--jobs) N           number of classification threads (default: " << p->batch.classifyThreads << ")" << endl;
+	cout << "    -q (--queue) N          frames waiting between two stages (default: " << p->batch.queueSize << ")" << endl;
+	cout << "    -H (--half)             segment at half resolution (default: " << p->batch.halfResolution << ")" << endl;
+	cout << "    -c (--color)            write colour images instead of indices (default: " << p->batch.colorOutput << ")" << endl;
+	cout << "    -g (--legend) FILE      legend image, displayed on colour images" << endl;
+	cout << "    -m (--millimeters)      depth is in millimeters (default: " << p->millimeters << ")" << endl;
+}
+
+
+// output file name of a depth file
+string label_file_name(const string& depth_file, const string& output_dir)
+{
+	size_t slash = depth_file.find_last_of("/\\");
+	string name = (slash == string::npos) ? depth_file : depth_file.substr(slash+1);
+	size_t dot = name.find_last_of('.');
+	if (dot != string::npos)
+		name = name.substr(0, dot);
+	return output_dir + "/" + name + "_labels.png";
+}
+
+
+int main(int argc, char** argv)
+{
+	setlocale(LC_ALL, "C");
+	params par;
+	set_default_params(&par);
+
+	int option_index=0;
+	int opt;
+	opterr=0;
+	static struct option long_options[] =
+	{
+		{"color",         no_argument,       0, 'c'},
+		{"legend",        required_argument, 0, 'g'},
+		{"half",          no_argument,       0, 'H'},
+		{"jobs",          required_argument, 0, 'j'},
+		{"millimeters",   no_argument,       0, 'm'},
+		{"queue",         required_argument, 0, 'q'},
+		{0, 0, 0, 0}
+	};
+	do
+	{
+		opt = getopt_long(argc, argv, "cg:Hj:mq:", long_options, &option_index);
+		if (opt==-1)
+			break;
+
+		switch (opt)
+		{
+			case 'c':
+				par.batch.colorOutput = true;
+				break;
+			case 'g':
+				par.legend_file = optarg;
+				par.batch.legend = true;
+				break;
+			case 'H':
+				par.batch.halfResolution = true;
+				break;
+			case 'j':
+				par.batch.classifyThreads = atoi(optarg);
+				break;
+			case 'm':
+				par.millimeters = true;
+				break;
+			case 'q':
+				par.batch.queueSize = atoi(optarg);
+				break;
+			default:
+				print_usage(&par);
+				return -1;
+		}
+	} while (opt!=-1);
+
+	if (argc!=optind+3 || par.batch.classifyThreads<1 || par.batch.queueSize<1)
+	{
+		print_usage(&par);
+		return -1;
+	}
+	string forest_file = argv[optind];
+	string list_file = argv[optind+1];
+	string output_dir = argv[optind+2];
+
+	ifstream list(list_file.c_str());
+	if (!list.is_open())
+	{
+		cerr << "Failed to open depth list " << list_file << "." << endl;
+		return EXIT_FAILURE;
+	}
+	vector<string> depth_files, label_files;
+	string line;
+	while (getline(list, line))
+	{
+		if (line.empty())
+			continue;
+		depth_files.push_back(line);
+		label_files.push_back(label_file_name(line, output_dir));
+	}
+
+	BodyPartBatch batch(forest_file.c_str(), par.legend_file.c_str(), par.batch, par.millimeters);
+	int written = batch.process(depth_files, label_files);
+
+	double fps = batch.elapsedSeconds > 0 ? written / batch.elapsedSeconds : 0;
+	cout << written << " frames written, " << batch.failedFrames << " failed, in " << batch.elapsedSeconds << " s (" << fps << " frames/s)." << endl;
+
+	return batch.failedFrames == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,352 @@
+/*
+ * Body parts segmentation benchmark.
+ *
+ * Runs BodyPartSegmentation::run() on synthetic depth frames, or on
+ * depth images listed in a file, and reports as JSON the time spent
+ * in each processing stage, the forest nodes visited per pixel, the
+ * operator new calls per frame and the frame rate, for one or both
+ * forest inference implementations.
+ * The image buffers OpenCV allocates with cv::fastMalloc() don't go
+ * through operator new and are not counted.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <locale.h>
+#include <math.h>
+#include <atomic>
+#include <new>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <highgui.h>
+#include "../src/bodypartsegmentation.h"
+
+using namespace std;
+
+// count the operator new calls of the whole program, OpenCV image 
+// buffers excepted
+static atomic<long long> allocation_count(0);
+
+void* operator new(size_t size)
+{
+	allocation_count++;
+	void* p = malloc(size ? size : 1);
+	if (p == NULL)
+		throw bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+typedef struct params
+{
+	int frames;
+	int warmup;
+	int width;
+	int height;
+	string backend;
+	bool half;
+	bool temporal;
+	bool millimeters;
+	string output_file;
+} params;
+
+
+void set_default_params(params* p)
+{
+	p->frames = 50;
+	p->warmup = 2;
+	p->width = 640;
+	p->height = 480;
+	p->backend = "both";
+	p->half = false;
+	p->temporal = false;
+	p->millimeters = false;
+	p->output_file = "";
+}
+
+
+void print_usage(params* p)
+{
+	cout << "Usage: bodyparts_bench <options> <forest_file> [<depth_list>]" << endl;
+	cout << "  <depth_list> contains one 16 bits depth image file per line, synthetic" << endl;
+	cout << "  frames of a moving person are used if no list is given." << endl;
+	cout << "  options:" << endl;
+	cout << "    -n (--frames) N         measured frames (default: " << p->frames << ")" << endl;
+	cout << "    -w (--warmup) N         frames processed before measuring (default: " << p->warmup << ")" << endl;
+	cout << "    -W (--width) N          synthetic frames width (default: " << p->width << ")" << endl;
+	cout << "    -H (--height) N         synthetic frames height (default: " << p->height << ")" << endl;
+	cout << "    -b (--backend) NAME     legacy, compiled or both (default: " << p->backend << ")" << endl;
+	cout << "    -h (--half)             half resolution mode (default: " << p->half << ")" << endl;
+	cout << "    -t (--temporal)         temporal coherence mode (default: " << p->temporal << ")" << endl;
+	cout << "    -m (--millimeters)      depth is in millimeters (default: " << p->millimeters << ")" << endl;
+	cout << "    -o (--output) FILE      JSON output file (default: standard output)" << endl;
+}
+
+
+// synthetic frame: a person (head, torso, arms, legs) walking in front of a wall
+void make_frame(int index, int width, int height, bool millimeters, cv::Mat& depth)
+{
+	depth.create(height, width, CV_16UC1);
+	float sx = width / 640.f;
+	float sy = height / 480.f;
+	float cx = 320 + 100 * sin(index * 0.05);
+	float arm = 60 * sin(index * 0.2);
+	unsigned short wall = millimeters ? 3500 : BodyPartSegmentation::meters_to_raw_depth(3.5);
+	for (int m=0; m<height; m++)
+	{
+		unsigned short* row = depth.ptr<unsigned short>(m);
+		float y = m / sy;
+		for (int n=0; n<width; n++)
+		{
+			float x = n / sx - cx;
+			bool head = x*x + (y-90)*(y-90) < 35*35;
+			bool torso = fabs(x) < 55 && y > 125 && y < 290;
+			bool arms = fabs(x) < 130 && fabs(y - 150 - arm * fabs(x) / 130) < 15;
+			bool legs = fabs(fabs(x) - 28) < 22 && y >= 290 && y < 460;
+			if (head || torso || arms || legs)
+			{
+				float meters = 2.0 + 0.0005 * (x*x / 50 + fabs(y - 250));
+				row[n] = millimeters ? (unsigned short) (meters * 1000) : BodyPartSegmentation::meters_to_raw_depth(meters);
+			}
+			else
+				row[n] = wall;
+		}
+	}
+}
+
+
+struct result
+{
+	string backend;
+	int frames;
+	double seconds;
+	double allocations;
+	BodyPartSegmentation::Statistics total;
+};
+
+
+bool run_backend(const string& forest_file, int backend, const vector<cv::Mat>& frames, const params& par, result& res)
+{
+	BodyPartSegmentation seg(forest_file.c_str(), "", par.millimeters);
+	seg.setForestBackend(backend);
+	seg.setHalfResolution(par.half);
+	seg.setTemporalCoherence(par.temporal);
+
+	cv::Mat labels;
+	for (int i=0; i<par.warmup; i++)
+		if (!seg.run(frames[i % frames.size()], labels))
+			return false;
+
+	res.backend = (backend == BodyPartSegmentation::LEGACY_FOREST) ? "legacy" : "compiled";
+	res.frames = par.frames;
+	res.total = BodyPartSegmentation::Statistics();
+	long long allocations = allocation_count;
+	int64 start = cv::getTickCount();
+	for (int i=0; i<par.frames; i++)
+	{
+		if (!seg.run(frames[(par.warmup + i) % frames.size()], labels))
+			return false;
+		const BodyPartSegmentation::Statistics& s = seg.getStatistics();
+		res.total.smoothTime += s.smoothTime;
+		res.total.thresholdTime += s.thresholdTime;
+		res.total.extractTime += s.extractTime;
+		res.total.classifyTime += s.classifyTime;
+		res.total.resizeTime += s.resizeTime;
+		res.total.totalTime += s.totalTime;
+		res.total.classifiedPixels += s.classifiedPixels;
+		res.total.reusedPixels += s.reusedPixels;
+		res.total.visitedNodes += s.visitedNodes;
+	}
+	res.seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+	res.allocations = (allocation_count - allocations) / (double) par.frames;
+	return true;
+}
+
+
+void write_json(ostream& out, const params& par, const vector<cv::Mat>& frames, const vector<result>& results)
+{
+	out << "{" << endl;
+	out << "  \"width\": " << frames[0].cols << "," << endl;
+	out << "  \"height\": " << frames[0].rows << "," << endl;
+	out << "  \"frames\": " << par.frames << "," << endl;
+	out << "  \"half_resolution\": " << (par.half ? "true" : "false") << "," << endl;
+	out << "  \"temporal_coherence\": " << (par.temporal ? "true" : "false") << "," << endl;
+	out << "  \"backends\": [" << endl;
+	for (size_t i=0; i<results.size(); i++)
+	{
+		const result& r = results[i];
+		double n = r.frames;
+		out << "    {" << endl;
+		out << "      \"backend\": \"" << r.backend << "\"," << endl;
+		out << "      \"frames_per_second\": " << (r.seconds > 0 ? r.frames / r.seconds : 0) << "," << endl;
+		out << "      \"stage_ms\": {" << endl;
+		out << "        \"smooth\": " << r.total.smoothTime / n << "," << endl;
+		out << "        \"threshold\": " << r.total.thresholdTime / n << "," << endl;
+		out << "        \"extract\": " << r.total.extractTime / n << "," << endl;
+		out << "        \"classify\": " << r.total.classifyTime / n << "," << endl;
+		out << "        \"resize\": " << r.total.resizeTime / n << "," << endl;
+		out << "        \"total\": " << r.total.totalTime / n << endl;
+		out << "      }," << endl;
+		out << "      \"classified_pixels_per_frame\": " << r.total.classifiedPixels / n << "," << endl;
+		out << "      \"reused_pixels_per_frame\": " << r.total.reusedPixels / n << "," << endl;
+		out << "      \"nodes_per_pixel\": " << (r.total.classifiedPixels > 0 ? r.total.visitedNodes / (double) r.total.classifiedPixels : 0) << "," << endl;
+		out << "      \"operator_new_per_frame\": " << r.allocations << endl;
+		out << "    }" << (i+1 < results.size() ? "," : "") << endl;
+	}
+	out << "  ]" << endl;
+	out << "}" << endl;
+}
+
+
+int main(int argc, char** argv)
+{
+	setlocale(LC_ALL, "C");
+	params par;
+	set_default_params(&par);
+
+	int option_index=0;
+	int opt;
+	opterr=0;
+	static struct option long_options[] =
+	{
+		{"backend",       required_argument, 0, 'b'},
+		{"half",          no_argument,       0, 'h'},
+		{"height",        required_argument, 0, 'H'},
+		{"millimeters",   no_argument,       0, 'm'},
+		{"frames",        required_argument, 0, 'n'},
+		{"output",        required_argument, 0, 'o'},
+		{"temporal",      no_argument,       0, 't'},
+		{"warmup",        required_argument, 0, 'w'},
+		{"width",         required_argument, 0, 'W'},
+		{0, 0, 0, 0}
+	};
+	do
+	{
+		opt = getopt_long(argc, argv, "b:hH:mn:o:tw:W:", long_options, &option_index);
+		if (opt==-1)
+			break;
+
+		switch (opt)
+		{
+			case 'b':
+				par.backend = optarg;
+				break;
+			case 'h':
+				par.half = true;
+				break;
+			case 'H':
+				par.height = atoi(optarg);
+				break;
+			case 'm':
+				par.millimeters = true;
+				break;
+			case 'n':
+				par.frames = atoi(optarg);
+				break;
+			case 'o':
+				par.output_file = optarg;
+				break;
+			case 't':
+				par.temporal = true;
+				break;
+			case 'w':
+				par.warmup = atoi(optarg);
+				break;
+			case 'W':
+				par.width = atoi(optarg);
+				break;
+			default:
+				print_usage(&par);
+				return -1;
+		}
+	} while (opt!=-1);
+
+	bool backend_ok = par.backend == "legacy" || par.backend == "compiled" || par.backend == "both";
+	if ((argc!=optind+1 && argc!=optind+2) || !backend_ok || par.frames<1 || par.warmup<0 || par.width<2 || par.height<2)
+	{
+		print_usage(&par);
+		return -1;
+	}
+	string forest_file = argv[optind];
+
+	// input frames
+	vector<cv::Mat> frames;
+	if (argc==optind+2)
+	{
+		ifstream list(argv[optind+1]);
+		if (!list.is_open())
+		{
+			cerr << "Failed to open depth list " << argv[optind+1] << "." << endl;
+			return EXIT_FAILURE;
+		}
+		string line;
+		while (getline(list, line))
+		{
+			if (line.empty())
+				continue;
+			frames.push_back(cv::imread(line, CV_LOAD_IMAGE_ANYDEPTH));
+			if (frames.back().empty())
+			{
+				cerr << "Failed to load " << line << "." << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		if (frames.empty())
+		{
+			cerr << "No depth image in " << argv[optind+1] << "." << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		frames.resize(par.warmup + par.frames);
+		for (size_t i=0; i<frames.size(); i++)
+			make_frame((int) i, par.width, par.height, par.millimeters, frames[i]);
+	}
+
+	vector<result> results;
+	if (par.backend != "compiled")
+	{
+		results.push_back(result());
+		if (!run_backend(forest_file, BodyPartSegmentation::LEGACY_FOREST, frames, par, results.back()))
+			return EXIT_FAILURE;
+	}
+	if (par.backend != "legacy")
+	{
+		results.push_back(result());
+		if (!run_backend(forest_file, BodyPartSegmentation::COMPILED_FOREST, frames, par, results.back()))
+			return EXIT_FAILURE;
+	}
+
+	if (par.output_file.empty())
+		write_json(cout, par, frames, results);
+	else
+	{
+		ofstream out(par.output_file.c_str());
+		if (!out.is_open())
+		{
+			cerr << "Failed to open output file " << par.output_file << "." << endl;
+			return EXIT_FAILURE;
+		}
+		write_json(out, par, frames, results);
+	}
+
+	return EXIT_SUCCESS;
+}
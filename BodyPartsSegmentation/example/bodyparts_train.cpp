@@ -0,0 +1,320 @@
+/*
+ * Random forest trainer for body parts segmentation.
+ *
+ * Trains a forest on labelled depth images and writes it in the
+ * forest_param.txt format read by BodyPartSegmentation.
+ * Trees are grown in parallel processes, the candidate splits of
+ * each node are evaluated in parallel threads.
+ */
+
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <locale.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <highgui.h>
+#include "../src/ForestTrainer.h"
+
+using namespace std;
+
+typedef struct params
+{
+	int trees;
+	int first_tree;
+	int jobs;
+	unsigned int seed;
+	bool merge;
+	ForestTrainer::Parameters training;
+} params;
+
+
+void set_default_params(params* p)
+{
+	p->trees = 4;
+	p->first_tree = 0;
+	p->jobs = 1;
+	p->seed = 1;
+	p->merge = false;
+	ForestTrainer::defaultParameters(p->training);
+}
+
+
+void print_usage(params* p)
+{
+	cout << "Usage: bodyparts_train <options> <image_list> <forest_file>" << endl;
+	cout << "       bodyparts_train -M <forest_file> <input_forest_file> ..." << endl;
+	cout << "  <image_list> contains one training frame per line: <depth_png> <label_png>" << endl;
+	cout << "  label images are either 1 channel body part indices (255 for background)," << endl;
+	cout << "  or colour images using the colours of the segmentation output." << endl;
+	cout << "  options:" << endl;
+	cout << "    -t (--trees) N          number of trees (default: " << p->trees << ")" << endl;
+	cout << "    -F (--first_tree) N     index of the first tree, to train a forest in several runs (default: " << p->first_tree << ")" << endl;
+	cout << "    -j (--jobs) N           number of training processes (default: " << p->jobs << ")" << endl;
+	cout << "    -s (--seed) N           random seed, tree i uses seed+i (default: " << p->seed << ")" << endl;
+	cout << "    -d (--depth) N          level of the terminal nodes (default: " << p->training.maxDepth << ")" << endl;
+	cout << "    -n (--min_samples) N    minimum number of samples to split a node (default: " << p->training.minSamples << ")" << endl;
+	cout << "    -p (--pixels) N         pixels sampled per image and per tree (default: " << p->training.pixelsPerImage << ")" << endl;
+	cout << "    -f (--features) N       features tested per node (default: " << p->training.featuresPerNode << ")" << endl;
+	cout << "    -o (--max_offset) N     maximum probe offset, in 640x480 geometry (default: " << p->training.maxOffset << ")" << endl;
+	cout << "    -b (--bins) N           split search histogram bins (default: " << p->training.thresholdBins << ")" << endl;
+	cout << "    -S (--sum)              also use SUM features (default: " << p->training.sumFeatures << ")" << endl;
+	cout << "    -m (--millimeters)      depth is in millimeters (default: " << p->training.depthIsInMillimeters << ")" << endl;
+	cout << "    -M (--merge)            merge forest files, trees are sorted by index" << endl;
+}
+
+
+static bool treeLess(TreeNode* a, TreeNode* b)
+{
+	return a->tree < b->tree;
+}
+
+
+// merge forest files into one forest, sorted by tree index
+bool merge_forests(const vector<string>& inputs, const string& output)
+{
+	RandomForest forest;
+	for (size_t i=0; i<inputs.size(); i++)
+	{
+		ifstream in(inputs[i].c_str());
+		if (!in.is_open())
+		{
+			cerr << "Failed to open forest file " << inputs[i] << "." << endl;
+			return false;
+		}
+		forest.readForeset(in);
+	}
+	forest.rootNodeList.sort(treeLess);
+
+	ofstream out(output.c_str());
+	if (!out.is_open())
+	{
+		cerr << "Failed to open output file " << output << "." << endl;
+		return false;
+	}
+	forest.writeForest(out);
+	cout << forest.rootNodeList.size() << " trees written to " << output << "." << endl;
+	return true;
+}
+
+
+// load the training frames listed in a file
+bool load_images(const string& list_file, ForestTrainer& trainer)
+{
+	ifstream list(list_file.c_str());
+	if (!list.is_open())
+	{
+		cerr << "Failed to open image list " << list_file << "." << endl;
+		return false;
+	}
+
+	string line;
+	while (getline(list, line))
+	{
+		istringstream fields(line);
+		string depth_file, label_file;
+		if (!(fields >> depth_file >> label_file))
+			continue;
+
+		cv::Mat depth = cv::imread(depth_file, CV_LOAD_IMAGE_ANYDEPTH);
+		cv::Mat labels = cv::imread(label_file, CV_LOAD_IMAGE_UNCHANGED);
+		if (depth.empty() || labels.empty())
+		{
+			cerr << "Failed to load " << depth_file << " or " << label_file << "." << endl;
+			return false;
+		}
+		if (labels.channels() == 3)
+		{
+			cv::Mat colors = labels;
+			BodyPartSegmentation::labelsFromColors(colors, labels);
+		}
+		if (!trainer.addImage(depth, labels))
+		{
+			cerr << "Invalid training frame " << depth_file << " " << label_file << "." << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// train trees first, first+step, ... < last and write them
+bool train_trees(ForestTrainer& trainer, int first, int last, int step, unsigned int seed, const string& output)
+{
+	RandomForest forest;
+	for (int t=first; t<last; t+=step)
+	{
+		TreeNode* root = trainer.trainTree(t, seed+t);
+		if (root == NULL)
+		{
+			cerr << "Failed to grow tree " << t << "." << endl;
+			return false;
+		}
+		forest.rootNodeList.push_back(root);
+		cout << "tree " << t << ": " << trainer.decisionNodeCount << " decision nodes, " << trainer.terminalNodeCount << " terminal nodes" << endl;
+	}
+
+	ofstream out(output.c_str());
+	if (!out.is_open())
+	{
+		cerr << "Failed to open output file " << output << "." << endl;
+		return false;
+	}
+	forest.writeForest(out);
+	return true;
+}
+
+
+int main(int argc, char** argv)
+{
+	setlocale(LC_ALL, "C");
+	params par;
+	set_default_params(&par);
+
+	int option_index=0;
+	int opt;
+	opterr=0;
+	static struct option long_options[] =
+	{
+		{"bins",          required_argument, 0, 'b'},
+		{"depth",         required_argument, 0, 'd'},
+		{"first_tree",    required_argument, 0, 'F'},
+		{"features",      required_argument, 0, 'f'},
+		{"jobs",          required_argument, 0, 'j'},
+		{"merge",         no_argument,       0, 'M'},
+		{"millimeters",   no_argument,       0, 'm'},
+		{"min_samples",   required_argument, 0, 'n'},
+		{"max_offset",    required_argument, 0, 'o'},
+		{"pixels",        required_argument, 0, 'p'},
+		{"sum",           no_argument,       0, 'S'},
+		{"seed",          required_argument, 0, 's'},
+		{"trees",         required_argument, 0, 't'},
+		{0, 0, 0, 0}
+	};
+	do
+	{
+		opt = getopt_long(argc, argv, "b:d:F:f:j:Mmn:o:p:Ss:t:", long_options, &option_index);
+		if (opt==-1)
+			break;
+
+		switch (opt)
+		{
+			case 'b':
+				par.training.thresholdBins = atoi(optarg);
+				break;
+			case 'd':
+				par.training.maxDepth = atoi(optarg);
+				break;
+			case 'F':
+				par.first_tree = atoi(optarg);
+				break;
+			case 'f':
+				par.training.featuresPerNode = atoi(optarg);
+				break;
+			case 'j':
+				par.jobs = atoi(optarg);
+				break;
+			case 'M':
+				par.merge = true;
+				break;
+			case 'm':
+				par.training.depthIsInMillimeters = true;
+				break;
+			case 'n':
+				par.training.minSamples = atoi(optarg);
+				break;
+			case 'o':
+				par.training.maxOffset = atoi(optarg);
+				break;
+			case 'p':
+				par.training.pixelsPerImage = atoi(optarg);
+				break;
+			case 'S':
+				par.training.sumFeatures = true;
+				break;
+			case 's':
+				par.seed = atoi(optarg);
+				break;
+			case 't':
+				par.trees = atoi(optarg);
+				break;
+			default:
+				print_usage(&par);
+				return -1;
+		}
+	} while (opt!=-1);
+
+	if (par.merge)
+	{
+		if (argc<optind+2)
+		{
+			print_usage(&par);
+			return -1;
+		}
+		vector<string> inputs(argv+optind+1, argv+argc);
+		return merge_forests(inputs, argv[optind]) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (argc!=optind+2 || par.trees<1 || par.jobs<1 || par.training.thresholdBins<2)
+	{
+		print_usage(&par);
+		return -1;
+	}
+	string list_file = argv[optind];
+	string forest_file = argv[optind+1];
+
+	ForestTrainer trainer(par.training);
+	if (!load_images(list_file, trainer))
+		return EXIT_FAILURE;
+	cout << trainer.imageCount() << " training frames." << endl;
+
+	int first = par.first_tree;
+	int last = par.first_tree + par.trees;
+	if (par.jobs == 1)
+		return train_trees(trainer, first, last, 1, par.seed, forest_file) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	// one process per group of trees, sharing the training frames,
+	// the cores being shared between the processes
+	int jobs = min(par.jobs, par.trees);
+	cv::setNumThreads(max(1, cv::getNumberOfCPUs() / jobs));
+	vector<string> parts;
+	vector<pid_t> pids;
+	for (int j=0; j<jobs; j++)
+	{
+		ostringstream part;
+		part << forest_file << ".part" << j;
+		parts.push_back(part.str());
+
+		pid_t pid = fork();
+		if (pid < 0)
+		{
+			perror("fork");
+			return EXIT_FAILURE;
+		}
+		if (pid == 0)
+		{
+			bool ok = train_trees(trainer, first+j, last, jobs, par.seed, parts.back());
+			_exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		pids.push_back(pid);
+	}
+
+	bool ok = true;
+	for (size_t j=0; j<pids.size(); j++)
+	{
+		int status;
+		if (waitpid(pids[j], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+			ok = false;
+	}
+	if (ok)
+		ok = merge_forests(parts, forest_file);
+	for (size_t j=0; j<parts.size(); j++)
+		remove(parts[j].c_str());
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,265 @@
+#include <iostream>
+#include <fstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <highgui.h>
+#include "BodyPartBatch.h"
+
+//---------------------------------------------------------
+
+/**
+ * Buffers of a frame, reused from one frame to the next.
+ */
+struct BodyPartBatch::Frame
+{
+	int index;	// frame index in the sequence
+	bool valid;	// false if a stage failed
+	std::vector<uchar> file;	// encoded depth image
+	cv::Mat raw;	// decoded depth image
+	cv::Mat depth;	// depth image to segment
+	cv::Mat human;	// human depth data
+	cv::Mat labels;	// body part labels
+	cv::Mat fullLabels;	// labels at the input resolution
+	cv::Mat colors;	// colour output
+};
+
+/**
+ * Blocking queue of frames, with a maximum size.
+ * A NULL frame marks the end of the sequence.
+ */
+class BodyPartBatch::FrameQueue
+{
+public:
+	FrameQueue( size_t _capacity ) : capacity(_capacity) {}
+
+	void push( Frame* frame )
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		while ( queue.size()>=capacity )
+			notFull.wait( lock );
+		queue.push_back( frame );
+		notEmpty.notify_one();
+	}
+
+	Frame* pop(void)
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		while ( queue.empty() )
+			notEmpty.wait( lock );
+		Frame* frame = queue.front();
+		queue.pop_front();
+		notFull.notify_one();
+		return frame;
+	}
+
+protected:
+	size_t capacity;
+	std::deque<Frame*> queue;
+	std::mutex mutex;
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+};
+
+//---------------------------------------------------------
+
+BodyPartBatch::BodyPartBatch( const char* forestParamFileName, const char* groundImgFileName, const Parameters& _params, bool depthIsInMillimeters )
+{
+	params = _params;
+	if ( params.classifyThreads<1 )
+		params.classifyThreads = 1;
+	if ( params.queueSize<1 )
+		params.queueSize = 1;
+	failedFrames = 0;
+	elapsedSeconds = 0;
+
+	// the instances share the forest (see ForestCache)
+	masker = new BodyPartSegmentation( forestParamFileName, groundImgFileName, depthIsInMillimeters );
+	for ( int i=0; i<params.classifyThreads; i++ )
+		classifiers.push_back( new BodyPartSegmentation( forestParamFileName, groundImgFileName, depthIsInMillimeters ) );
+
+	// enough frames to fill all the queues, plus the frame of each stage thread
+	int frameCount = 3*params.queueSize + params.classifyThreads + 2;
+	for ( int i=0; i<frameCount; i++ )
+		frames.push_back( new Frame );
+}
+
+//---------------------------------------------------------
+
+BodyPartBatch::~BodyPartBatch()
+{
+	for ( size_t i=0; i<frames.size(); i++ )
+		delete frames[i];
+	for ( size_t i=0; i<classifiers.size(); i++ )
+		delete classifiers[i];
+	delete masker;
+}
+
+//---------------------------------------------------------
+
+void BodyPartBatch::defaultParameters( Parameters& params )
+{
+	params.classifyThreads = 1;
+	params.queueSize = 4;
+	params.halfResolution = false;
+	params.colorOutput = false;
+	params.legend = false;
+}
+
+//---------------------------------------------------------
+
+int BodyPartBatch::process( const std::vector<std::string>& depthFiles, const std::vector<std::string>& labelFiles )
+{
+	failedFrames = 0;
+	elapsedSeconds = 0;
+	if ( depthFiles.size()!=labelFiles.size() )
+	{
+		std::cout << "BodyPartBatch::process ERROR: " << depthFiles.size() << " depth files for " << labelFiles.size() << " label files." << std::endl;
+		return 0;
+	}
+
+	int64 start = cv::getTickCount();
+
+	// the free frames queue can hold all the frames, so that the
+	// encode stage never waits
+	FrameQueue freeFrames( frames.size() );
+	FrameQueue decoded( params.queueSize );
+	FrameQueue masked( params.queueSize );
+	FrameQueue classified( params.queueSize );
+	for ( size_t i=0; i<frames.size(); i++ )
+		freeFrames.push( frames[i] );
+
+	int written = 0;
+	std::vector<std::thread> threads;
+	threads.push_back( std::thread( &BodyPartBatch::decodeStage, this, std::cref(depthFiles), std::ref(freeFrames), std::ref(decoded) ) );
+	threads.push_back( std::thread( &BodyPartBatch::maskStage, this, std::ref(decoded), std::ref(masked) ) );
+	for ( size_t i=0; i<classifiers.size(); i++ )
+		threads.push_back( std::thread( &BodyPartBatch::classifyStage, this, classifiers[i], std::ref(masked), std::ref(classified) ) );
+	threads.push_back( std::thread( &BodyPartBatch::encodeStage, this, std::cref(labelFiles), std::ref(classified), std::ref(freeFrames), std::ref(written) ) );
+	for ( size_t i=0; i<threads.size(); i++ )
+		threads[i].join();
+
+	elapsedSeconds = ( cv::getTickCount() - start ) / cv::getTickFrequency();
+	return written;
+}
+
+//---------------------------------------------------------
+
+/**
+ * Read a whole file into buf, keeping its capacity.
+ */
+static bool readFile( const std::string& fileName, std::vector<uchar>& buf )
+{
+	std::ifstream input( fileName.c_str(), std::ios::in | std::ios::binary );
+	if( ! input.is_open() )
+		return false;
+	input.seekg( 0, std::ios::end );
+	std::streamoff size = input.tellg();
+	input.seekg( 0, std::ios::beg );
+	if( size<=0 )
+		return false;
+	buf.resize( (size_t) size );
+	input.read( (char*) &buf[0], size );
+	return input.gcount()==size;
+}
+
+//---------------------------------------------------------
+
+void BodyPartBatch::decodeStage( const std::vector<std::string>& depthFiles, FrameQueue& input, FrameQueue& output )
+{
+	for ( size_t i=0; i<depthFiles.size(); i++ )
+	{
+		Frame* frame = input.pop();
+		frame->index = (int) i;
+		// decode into the buffers of the frame, cv::imread() would allocate new ones
+		frame->valid = readFile( depthFiles[i], frame->file );
+		if ( frame->valid )
+		{	cv::imdecode( frame->file, CV_LOAD_IMAGE_ANYDEPTH, &frame->raw );
+			frame->valid = ! frame->raw.empty();
+		}
+		if ( ! frame->valid )
+			std::cout << "BodyPartBatch::process ERROR: failed to read " << depthFiles[i] << "." << std::endl;
+		else if ( params.halfResolution && frame->raw.rows>=2 && frame->raw.cols>=2 && frame->raw.depth()==CV_16U )
+		{	// decimate by 2, as BodyPartSegmentation::run() does
+			frame->depth.create( frame->raw.rows/2, frame->raw.cols/2, CV_16UC1 );
+			for ( int m=0; m<frame->depth.rows; m++ )
+			{	const unsigned short* src = frame->raw.ptr<unsigned short>(2*m);
+				unsigned short* half = frame->depth.ptr<unsigned short>(m);
+				for ( int n=0; n<frame->depth.cols; n++ )
+					half[n] = src[2*n];
+			}
+		} else
+			frame->depth = frame->raw;
+		output.push( frame );
+	}
+	output.push( NULL );
+}
+
+//---------------------------------------------------------
+
+void BodyPartBatch::maskStage( FrameQueue& input, FrameQueue& output )
+{
+	while ( Frame* frame = input.pop() )
+	{
+		if ( frame->valid )
+			frame->valid = masker->extractHumanDepth( frame->depth, frame->human );
+		output.push( frame );
+	}
+
+	// one end mark for each classification thread
+	for ( size_t i=0; i<classifiers.size(); i++ )
+		output.push( NULL );
+}
+
+//---------------------------------------------------------
+
+void BodyPartBatch::classifyStage( BodyPartSegmentation* segmentation, FrameQueue& input, FrameQueue& output )
+{
+	while ( Frame* frame = input.pop() )
+	{
+		if ( frame->valid )
+			segmentation->classifyHumanDepth( frame->human, frame->labels );
+		output.push( frame );
+	}
+	output.push( NULL );
+}
+
+//---------------------------------------------------------
+
+void BodyPartBatch::encodeStage( const std::vector<std::string>& labelFiles, FrameQueue& input, FrameQueue& output, int& written )
+{
+	// frames may come in any order when there are several classification threads
+	int running = (int) classifiers.size();
+	while ( running>0 )
+	{
+		Frame* frame = input.pop();
+		if ( frame==NULL )
+		{	running--;
+			continue;
+		}
+
+		if ( frame->valid )
+		{
+			cv::Mat labels = frame->labels;
+			if ( frame->labels.size()!=frame->raw.size() )
+			{	cv::resize( frame->labels, frame->fullLabels, frame->raw.size(), 0, 0, cv::INTER_NEAREST );
+				labels = frame->fullLabels;
+			}
+			if ( params.colorOutput )
+			{	// colorizeLabels() only reads the shared legend
+				masker->colorizeLabels( labels, params.legend, frame->colors );
+				labels = frame->colors;
+			}
+			frame->valid = cv::imwrite( labelFiles[frame->index], labels );
+			if ( ! frame->valid )
+				std::cout << "BodyPartBatch::process ERROR: failed to write " << labelFiles[frame->index] << "." << std::endl;
+		}
+
+		if ( frame->valid )
+			written++;
+		else
+			failedFrames++;
+		output.push( frame );
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef BODYPARTBATCH_H
+#define BODYPARTBATCH_H
+
+#include <string>
+#include <vector>
+#include "bodypartsegmentation.h"
+
+/**
+ * Offline body part segmentation of depth image sequences.
+ * Frames go through a pipeline of stages running in separate threads:
+ * decode (depth image reading), mask (human depth extraction),
+ * classify (forest inference, in one or more threads) and encode
+ * (label image writing). Stages exchange frames through bounded
+ * queues, and the frame buffers are recycled, so the memory used
+ * does not depend on the sequence length.
+ */
+class DLL_EXPORT BodyPartBatch
+{
+public:
+	struct Parameters
+	{
+		int classifyThreads;	// number of classification threads
+		int queueSize;		// maximum number of frames waiting between two stages
+		bool halfResolution;	// segment decimated images (see BodyPartSegmentation)
+		bool colorOutput;	// write colour images instead of label indices
+		bool legend;		// display the legend on colour images
+	};
+
+	/*
+	 * Constructor.
+	 * @param  forestParamFileName  Forest configuration file name.
+	 * @param  groundImgFileName  Ground truth (legend) file name.
+	 * @param  params  batch parameters.
+	 * @param  depthIsInMillimeters  depth unit, see BodyPartSegmentation.
+	 */
+	BodyPartBatch( const char* forestParamFileName, const char* groundImgFileName, const Parameters& params, bool depthIsInMillimeters = false );
+	virtual ~BodyPartBatch();
+
+	/**
+	 * Fill batch parameters with default values.
+	 */
+	static void defaultParameters( Parameters& params );
+
+	/**
+	 * Segment a sequence of depth images.
+	 * @param  depthFiles  16 bits depth image files.
+	 * @param  labelFiles  output image files, one per depth file. Label
+	 *         images are CV_8UC1 (BodyPartSegmentation::run() labels).
+	 * @return  the number of frames written.
+	 */
+	int process( const std::vector<std::string>& depthFiles, const std::vector<std::string>& labelFiles );
+
+	// statistics of the last process() call
+	int failedFrames;	// frames that could not be read or written
+	double elapsedSeconds;	// wall time
+
+protected:
+	struct Frame;
+	class FrameQueue;
+
+	void decodeStage( const std::vector<std::string>& depthFiles, FrameQueue& input, FrameQueue& output );
+	void maskStage( FrameQueue& input, FrameQueue& output );
+	void classifyStage( BodyPartSegmentation* segmentation, FrameQueue& input, FrameQueue& output );
+	void encodeStage( const std::vector<std::string>& labelFiles, FrameQueue& input, FrameQueue& output, int& written );
+
+	Parameters params;
+	BodyPartSegmentation* masker;	// mask stage instance
+	std::vector<BodyPartSegmentation*> classifiers;	// one instance per classification thread
+	std::vector<Frame*> frames;	// frame buffers, recycled
+};
+
+#endif // BODYPARTBATCH_H
@@ -0,0 +1,121 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <highgui.h>
+#include "ForestCache.h"
+
+// registry state
+static std::mutex cacheMutex;
+static std::condition_variable cacheLoaded;
+static std::list<SharedForest*> cacheModels;
+
+//---------------------------------------------------------
+
+// 64 bits FNV-1a hash
+static unsigned long long fnv1a( const std::string& data )
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for ( size_t i=0; i<data.size(); i++ )
+	{	hash ^= (unsigned char) data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+//---------------------------------------------------------
+
+SharedForest* ForestCache::acquire( const char* forestParamFileName, const char* groundImgFileName )
+{
+	// read the forest file, its content identifies the model
+	std::string params_file(forestParamFileName);
+	std::ifstream input( params_file.c_str(), std::ios::in | std::ios::binary );
+	if( ! input.is_open() )
+		std::cout << "BodyPartSegmentation::BodyPartSegmentation ERROR: failed to open forest parameters file " << params_file << "." << std::endl;
+	std::ostringstream content;
+	content << input.rdbuf();
+	input.close();
+	std::string data = content.str();
+	unsigned long long hash = fnv1a( data );
+
+	SharedForest* model = NULL;
+	{
+		std::unique_lock<std::mutex> lock( cacheMutex );
+		for ( std::list<SharedForest*>::iterator it=cacheModels.begin(); it!=cacheModels.end(); it++ )
+		{	if ( (*it)->hash==hash && (*it)->forestFileName==forestParamFileName && (*it)->groundFileName==groundImgFileName )
+			{	model = *it;
+				break;
+			}
+		}
+
+		if ( model )
+		{	// already loaded, or being loaded by another thread
+			model->refCount++;
+			while ( model->loading )
+				cacheLoaded.wait( lock );
+			return model;
+		}
+
+		model = new SharedForest;
+		model->forestFileName = forestParamFileName;
+		model->groundFileName = groundImgFileName;
+		model->hash = hash;
+		model->forest = NULL;
+		model->ground = NULL;
+		model->refCount = 1;
+		model->loading = true;
+		cacheModels.push_back( model );
+	}
+
+	// parse the model, out of the lock
+	RandomForest* forest = new RandomForest();
+	std::istringstream forestData( data );
+	forest->readForeset( forestData );
+	model->forest = forest;
+	model->compiled.compile( forest );
+	// no legend image if the file name is empty
+	if( groundImgFileName[0] != '\0' )
+	{
+		model->ground = cvLoadImage( groundImgFileName );
+		if( model->ground == NULL )
+			std::cout << "BodyPartSegmentation::BodyPartSegmentation warning: failed to load " << groundImgFileName << "." << std::endl;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( cacheMutex );
+		model->loading = false;
+	}
+	cacheLoaded.notify_all();
+
+	return model;
+}
+
+//---------------------------------------------------------
+
+void ForestCache::release( SharedForest* model )
+{
+	if ( model==NULL )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock( cacheMutex );
+		if ( --model->refCount>0 )
+			return;
+		cacheModels.remove( model );
+	}
+
+	delete model->forest;
+	if ( model->ground != NULL )
+		cvReleaseImage( &model->ground );
+	delete model;
+}
+
+//---------------------------------------------------------
+
+int ForestCache::size()
+{
+	std::lock_guard<std::mutex> lock( cacheMutex );
+	return (int) cacheModels.size();
+}
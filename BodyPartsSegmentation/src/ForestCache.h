@@ -0,0 +1,53 @@
+#ifndef FORESTCACHE_H
+#define FORESTCACHE_H
+
+#include <string>
+#include "RandomForest.h"
+
+/**
+ * Model shared by the BodyPartSegmentation instances that use the
+ * same forest file and legend image. Read-only once loaded.
+ */
+struct SharedForest
+{
+	std::string forestFileName;
+	std::string groundFileName;
+	unsigned long long hash;	// forest file content hash
+	RandomForest* forest;
+	CompiledForest compiled;	// flat copy of forest, if its features are supported
+	IplImage* ground;	// body parts legend
+	int refCount;
+	bool loading;	// true while the model is being parsed
+};
+
+/**
+ * Process-wide registry of the loaded forests.
+ * Models are keyed by forest file name, forest file content hash
+ * and legend file name, and are released when their last user
+ * releases them. Thread-safe: when several threads acquire the same
+ * model at once, the forest is parsed only once and the other
+ * threads wait for it.
+ */
+class ForestCache
+{
+public:
+	/**
+	 * Get a model, loading it if it is not already loaded.
+	 * @param  forestParamFileName  Forest configuration file name.
+	 * @param  groundImgFileName  Ground truth (legend) file name.
+	 * @return  the model, to be given back with release().
+	 */
+	static SharedForest* acquire( const char* forestParamFileName, const char* groundImgFileName );
+
+	/**
+	 * Give back a model, it is deleted when it has no user left.
+	 */
+	static void release( SharedForest* model );
+
+	/**
+	 * Number of loaded models.
+	 */
+	static int size(void);
+};
+
+#endif // FORESTCACHE_H
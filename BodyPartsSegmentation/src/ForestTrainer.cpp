@@ -0,0 +1,356 @@
+#include <iostream>
+#include <algorithm>
+#include <math.h>
+#include "support_class.h"
+#include "RandomForest.h"
+#include "ForestTrainer.h"
+
+extern int PART_SIZE;
+extern int FIXED_INF;
+
+//------------- define the feature type and id -------------
+enum { DEPT, EDGE_MAG, EDGE_ORI };	/* feature_id */
+enum { DIFF, SUM, BOTH };               /* feature_type */
+
+// range of the split thresholds, for each feature type
+static const float DIFF_THRESHOLD_MIN = -1.6;
+static const float DIFF_THRESHOLD_MAX = 1.6;
+static const float SUM_THRESHOLD_MIN = 0;
+static const float SUM_THRESHOLD_MAX = 8;
+
+//---------------------------------------------------------
+
+// xorshift random generator, the same sequence on every platform
+static unsigned int nextRandom( unsigned int& state )
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+// random integer in [min,max]
+static int randomInt( unsigned int& state, int min, int max )
+{
+	return min + (int) ( nextRandom(state) % (unsigned int) (max - min + 1) );
+}
+
+// entropy of a class histogram
+static double entropy( const int* counts, int total )
+{
+	if ( total==0 )
+		return 0;
+	double e = 0;
+	for ( int w=0; w<PART_SIZE; w++ )
+	{	if ( counts[w]>0 )
+		{	double p = counts[w] / (double) total;
+			e -= p * log(p);
+		}
+	}
+	return e;
+}
+
+//---------------------------------------------------------
+
+/**
+ * Evaluate candidate splits of a node in parallel.
+ */
+class SplitEvaluator : public cv::ParallelLoopBody
+{
+public:
+	SplitEvaluator( ForestTrainer* _trainer, const std::vector<ForestTrainer::Sample>& _samples, int _begin, int _end, std::vector<ForestTrainer::Split>& _splits )
+		: trainer(_trainer), samples(_samples), begin(_begin), end(_end), splits(_splits) {}
+
+	virtual void operator()( const cv::Range& range ) const
+	{
+		for ( int i=range.start; i<range.end; i++ )
+			trainer->evaluateSplit( samples, begin, end, splits[i] );
+	}
+
+private:
+	ForestTrainer* trainer;
+	const std::vector<ForestTrainer::Sample>& samples;
+	int begin;
+	int end;
+	std::vector<ForestTrainer::Split>& splits;
+};
+
+//---------------------------------------------------------
+
+ForestTrainer::ForestTrainer( const Parameters& _params )
+{
+	params = _params;
+	decisionNodeCount = 0;
+	terminalNodeCount = 0;
+}
+
+//---------------------------------------------------------
+
+ForestTrainer::~ForestTrainer()
+{
+}
+
+//---------------------------------------------------------
+
+void ForestTrainer::defaultParameters( Parameters& params )
+{
+	params.maxDepth = 10;
+	params.minSamples = 20;
+	params.pixelsPerImage = 2000;
+	params.featuresPerNode = 200;
+	params.maxOffset = 120;
+	params.thresholdBins = 64;
+	params.sumFeatures = false;
+	params.depthIsInMillimeters = false;
+}
+
+//---------------------------------------------------------
+
+bool ForestTrainer::addImage( const cv::Mat& depthImg, const cv::Mat& labels )
+{
+	if( depthImg.empty() || depthImg.channels() != 1 || depthImg.depth() != CV_16U )
+	{
+		std::cout << "ForestTrainer::addImage ERROR: depth image must be a 1 channel, 16 bits image." << std::endl;
+		return false;
+	}
+	if( labels.rows != depthImg.rows || labels.cols != depthImg.cols || labels.type() != CV_8UC1 )
+	{
+		std::cout << "ForestTrainer::addImage ERROR: label image must be a 1 channel, 8 bits image of the depth image size." << std::endl;
+		return false;
+	}
+
+	int height = depthImg.rows;
+	int width = depthImg.cols;
+
+	// raw depth, smoothed as in BodyPartSegmentation
+	cv::Mat raw( height, width, CV_32FC1 );
+	for ( int m=0; m<height; m++ )
+	{	const unsigned short* data = depthImg.ptr<unsigned short>(m);
+		float* raw_row = raw.ptr<float>(m);
+		for ( int n=0; n<width; n++ )
+		{	if ( params.depthIsInMillimeters )
+			{	float depthInMeters = data[n] / 1000.0;
+				raw_row[n] = BodyPartSegmentation::meters_to_raw_depth( depthInMeters );
+			} else
+				raw_row[n] = data[n];
+		}
+	}
+	cv::Mat smooth;
+	cv::GaussianBlur( raw, smooth, cv::Size(3, 3), 0, 0, cv::BORDER_REPLICATE );
+
+	// human depth data in the labelled area, normalised into 4m
+	cv::Mat human( height, width, CV_32FC1 );
+	cv::Mat fgLabels( height, width, CV_8UC1 );
+	int fgCount = 0;
+	float max_value = 0;
+	for ( int m=0; m<height; m++ )
+	{	const float* smooth_row = smooth.ptr<float>(m);
+		const unsigned char* label = labels.ptr<unsigned char>(m);
+		float* human_row = human.ptr<float>(m);
+		unsigned char* fg_label = fgLabels.ptr<unsigned char>(m);
+		for ( int n=0; n<width; n++ )
+		{	int depth_value = (int) smooth_row[n];
+			if ( label[n]<PART_SIZE && depth_value>0 && depth_value<2047 )
+			{	human_row[n] = BodyPartSegmentation::raw_depth_to_meters( depth_value );
+				if ( human_row[n]>max_value )
+					max_value = human_row[n];
+				fg_label[n] = label[n];
+				fgCount++;
+			} else
+			{	human_row[n] = FIXED_INF;
+				fg_label[n] = BodyPartSegmentation::BACKGROUND_LABEL;
+			}
+		}
+	}
+	for ( int m=0; m<height; m++ )
+	{	float* human_row = human.ptr<float>(m);
+		for ( int n=0; n<width; n++ )
+		{	if ( human_row[n]!=FIXED_INF )
+				human_row[n] = 4 * (human_row[n] / max_value);
+		}
+	}
+
+	depths.push_back( human );
+	labelImgs.push_back( fgLabels );
+	foregroundCounts.push_back( fgCount );
+	rows.push_back( std::vector<float*>(height) );
+	for ( int m=0; m<height; m++ )
+		rows.back()[m] = depths.back().ptr<float>(m);
+
+	return true;
+}
+
+//---------------------------------------------------------
+
+TreeNode* ForestTrainer::trainTree( unsigned int treeId, unsigned int seed )
+{
+	unsigned int rng = seed * 2654435761u + 1;
+	if ( rng==0 )
+		rng = 1;
+
+	// sample labelled pixels in each image
+	std::vector<Sample> samples;
+	for ( int i=0; i<(int)depths.size(); i++ )
+	{	if ( foregroundCounts[i]==0 )
+			continue;
+		int height = labelImgs[i].rows;
+		int width = labelImgs[i].cols;
+		for ( int k=0; k<params.pixelsPerImage; k++ )
+		{	for ( int tries=0; tries<1000; tries++ )
+			{	Sample s;
+				s.image = i;
+				s.row = randomInt( rng, 0, height-1 );
+				s.col = randomInt( rng, 0, width-1 );
+				s.label = labelImgs[i].at<unsigned char>( s.row, s.col );
+				if ( s.label<PART_SIZE )
+				{	samples.push_back(s);
+					break;
+				}
+			}
+		}
+	}
+
+	decisionNodeCount = 0;
+	terminalNodeCount = 0;
+	if ( samples.empty() )
+		return NULL;
+
+	TreeNode* root = growNode( samples, 0, (int) samples.size(), treeId, 0, 0, rng );
+	if ( dynamic_cast<DecisionNode*>(root)==NULL )
+	{	// a forest can't store a tree without decision node
+		delete root;
+		return NULL;
+	}
+
+	return root;
+}
+
+//---------------------------------------------------------
+
+TreeNode* ForestTrainer::growNode( std::vector<Sample>& samples, int begin, int end, unsigned int treeId, unsigned int level, int child, unsigned int& rng )
+{
+	int total = end - begin;
+	std::vector<int> counts( PART_SIZE, 0 );
+	for ( int i=begin; i<end; i++ )
+		counts[samples[i].label]++;
+	int classCount = 0;
+	for ( int w=0; w<PART_SIZE; w++ )
+		if ( counts[w]>0 )
+			classCount++;
+
+	TreeNode* smaller = NULL;
+	TreeNode* greater = NULL;
+	Split best;
+	if ( (int)level<params.maxDepth && total>=params.minSamples && classCount>1 )
+	{
+		// random candidate features
+		std::vector<Split> splits( params.featuresPerNode );
+		for ( int i=0; i<(int)splits.size(); i++ )
+		{	splits[i].type = ( params.sumFeatures && nextRandom(rng) % 2 ) ? SUM : DIFF;
+			splits[i].offset_1 = cvPoint( randomInt( rng, -params.maxOffset, params.maxOffset ), randomInt( rng, -params.maxOffset, params.maxOffset ) );
+			splits[i].offset_2 = cvPoint( randomInt( rng, -params.maxOffset, params.maxOffset ), randomInt( rng, -params.maxOffset, params.maxOffset ) );
+			splits[i].threshold = 0;
+			splits[i].gain = 0;
+		}
+		cv::parallel_for_( cv::Range( 0, (int) splits.size() ), SplitEvaluator( this, samples, begin, end, splits ) );
+
+		best.gain = 0;
+		for ( int i=0; i<(int)splits.size(); i++ )
+			if ( splits[i].gain>best.gain )
+				best = splits[i];
+
+		if ( best.gain>0 )
+		{	// split the samples, keeping their order
+			std::vector<Sample> greaterSamples;
+			int middle = begin;
+			for ( int i=begin; i<end; i++ )
+			{	if ( featureValue( samples[i], best.type, best.offset_1, best.offset_2 )<best.threshold )
+					samples[middle++] = samples[i];
+				else
+					greaterSamples.push_back( samples[i] );
+			}
+			std::copy( greaterSamples.begin(), greaterSamples.end(), samples.begin() + middle );
+
+			if ( middle>begin && middle<end )
+			{	smaller = growNode( samples, begin, middle, treeId, level+1, 0, rng );
+				greater = growNode( samples, middle, end, treeId, level+1, 1, rng );
+			}
+		}
+	}
+
+	if ( smaller==NULL )
+	{	// terminal node with the class distribution of the samples
+		ClassLabelHistogram distribution( PART_SIZE );
+		for ( int w=0; w<PART_SIZE; w++ )
+			distribution.setScaleValue( w, counts[w] / (float) total );
+		terminalNodeCount++;
+		return new TerminalNode( &distribution, treeId, level, child );
+	}
+
+	DecisionNode* node = new DecisionNode( DEPT, best.type, best.offset_1, best.offset_2, best.threshold, smaller, greater, best.gain, treeId, level, child );
+	smaller->parent = node;
+	greater->parent = node;
+	decisionNodeCount++;
+	return node;
+}
+
+//---------------------------------------------------------
+
+void ForestTrainer::evaluateSplit( const std::vector<Sample>& samples, int begin, int end, Split& split )
+{
+	int nbins = params.thresholdBins;
+	float min = ( split.type==SUM ) ? SUM_THRESHOLD_MIN : DIFF_THRESHOLD_MIN;
+	float max = ( split.type==SUM ) ? SUM_THRESHOLD_MAX : DIFF_THRESHOLD_MAX;
+	float step = ( max - min ) / nbins;
+
+	// class histogram of each bin of feature values
+	std::vector<int> hist( nbins*PART_SIZE, 0 );
+	std::vector<int> counts( PART_SIZE, 0 );
+	for ( int i=begin; i<end; i++ )
+	{	float value = featureValue( samples[i], split.type, split.offset_1, split.offset_2 );
+		int bin = (int) floor( ( value - min ) / step );
+		if ( bin<0 )
+			bin = 0;
+		if ( bin>nbins-1 )
+			bin = nbins - 1;
+		hist[bin*PART_SIZE+samples[i].label]++;
+		counts[samples[i].label]++;
+	}
+
+	// best threshold among the bin borders
+	int total = end - begin;
+	double parentEntropy = entropy( &counts[0], total );
+	std::vector<int> left( PART_SIZE, 0 );
+	std::vector<int> right( counts );
+	int leftTotal = 0;
+	split.gain = 0;
+	for ( int k=1; k<nbins; k++ )
+	{	for ( int w=0; w<PART_SIZE; w++ )
+		{	int c = hist[(k-1)*PART_SIZE+w];
+			left[w] += c;
+			right[w] -= c;
+			leftTotal += c;
+		}
+		if ( leftTotal==0 || leftTotal==total )
+			continue;
+		double gain = parentEntropy
+			- ( leftTotal * entropy( &left[0], leftTotal ) + (total - leftTotal) * entropy( &right[0], total - leftTotal ) ) / total;
+		if ( gain>split.gain )
+		{	split.gain = gain;
+			split.threshold = min + k*step;
+		}
+	}
+}
+
+//---------------------------------------------------------
+
+float ForestTrainer::featureValue( const Sample& sample, int type, CvPoint u, CvPoint v )
+{
+	const cv::Mat& depth = depths[sample.image];
+	Feature feat( DEPT, cvPoint( sample.row, sample.col ), &rows[sample.image][0], depth.rows, depth.cols, FIXED_INF );
+	feat.set_scale( depth.rows / (float) BodyPartSegmentation::TRAIN_HEIGHT, depth.cols / (float) BodyPartSegmentation::TRAIN_WIDTH );
+	feat.set_type( type );
+	feat.set_offset( u, v );
+	feat.computeFeature();
+	return feat.value;
+}
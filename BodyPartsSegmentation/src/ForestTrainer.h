@@ -0,0 +1,114 @@
+#ifndef FORESTTRAINER_H
+#define FORESTTRAINER_H
+
+#include <vector>
+#include "RandomForest.h"
+#include "bodypartsegmentation.h"
+
+/**
+ * Random forest trainer.
+ * Grows trees on labelled depth images, with the depth features
+ * (DIFF and SUM of two depth probes) used by BodyPartSegmentation.
+ * Split thresholds are searched with per feature histograms of the
+ * feature values, the candidate features of a node being evaluated
+ * in parallel.
+ */
+class DLL_EXPORT ForestTrainer
+{
+public:
+	struct Parameters
+	{
+		int maxDepth;		// level of the terminal nodes
+		int minSamples;		// minimum number of samples to split a node
+		int pixelsPerImage;	// number of pixels sampled in each image, for each tree
+		int featuresPerNode;	// number of random features tested at each node
+		int maxOffset;		// maximum probe offset, in 640x480 geometry
+		int thresholdBins;	// number of bins of the split search histograms
+		bool sumFeatures;	// also test SUM features (DIFF only otherwise)
+		bool depthIsInMillimeters;	// input depth images in millimeters
+	};
+
+	/*
+	 * Constructor.
+	 * @param  params  training parameters.
+	 */
+	ForestTrainer( const Parameters& params );
+	virtual ~ForestTrainer();
+
+	/**
+	 * Fill training parameters with default values.
+	 */
+	static void defaultParameters( Parameters& params );
+
+	/**
+	 * Add a training image.
+	 * @param  depthImg  1 channel, 16 bits depth image.
+	 * @param  labels  CV_8UC1 label image, body part index of each pixel,
+	 *         BodyPartSegmentation::BACKGROUND_LABEL (or any value greater
+	 *         than the number of parts) outside of the person.
+	 * @return  false if the images are not valid.
+	 */
+	bool addImage( const cv::Mat& depthImg, const cv::Mat& labels );
+
+	int imageCount(void) { return (int) depths.size(); }
+
+	/**
+	 * Grow one tree.
+	 * @param  treeId  index of the tree in the forest.
+	 * @param  seed  random seed, pixels and features sampling depend on it only.
+	 * @return  the root of the tree (to be added to a RandomForest
+	 *          rootNodeList), NULL if no tree could be grown.
+	 */
+	TreeNode* trainTree( unsigned int treeId, unsigned int seed );
+
+	// number of nodes of the last grown tree
+	int decisionNodeCount;
+	int terminalNodeCount;
+
+protected:
+	struct Sample
+	{
+		int image;
+		int row;
+		int col;
+		int label;
+	};
+
+	struct Split
+	{
+		int type;
+		CvPoint offset_1;
+		CvPoint offset_2;
+		float threshold;
+		double gain;
+	};
+
+	friend class SplitEvaluator;
+
+	/**
+	 * Grow the subtree of a set of samples.
+	 * @param  samples  the samples of the node, reordered.
+	 * @param  begin, end  range of the node samples.
+	 * return the node
+	 */
+	TreeNode* growNode( std::vector<Sample>& samples, int begin, int end, unsigned int treeId, unsigned int level, int child, unsigned int& rng );
+
+	/**
+	 * Find the best threshold of a feature with the histogram of its values.
+	 * @param  split  the feature, receives the threshold and its gain.
+	 */
+	void evaluateSplit( const std::vector<Sample>& samples, int begin, int end, Split& split );
+
+	/**
+	 * Compute the feature of a sample, the same way as at inference.
+	 */
+	float featureValue( const Sample& sample, int type, CvPoint u, CvPoint v );
+
+	Parameters params;
+	std::vector<cv::Mat> depths;	// human depth data (CV_32FC1)
+	std::vector<cv::Mat> labelImgs;	// labels (CV_8UC1)
+	std::vector<int> foregroundCounts;	// number of labelled pixels
+	std::vector< std::vector<float*> > rows;	// rows of the human depth data
+};
+
+#endif // FORESTTRAINER_H
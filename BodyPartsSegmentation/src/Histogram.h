@@ -188,7 +188,7 @@ int Histogram<T>::getThresholdValueFisher (int kmin, int kmax,
 		
 	m0 = m0opt = kmin ;
 	for	(k = kmin+1	; k	<= kmax	; k++) {
-		m1 +=	k*H[k] ;
+		m1 +=	k*(float)H[k] ;
 	  	W	+= H[k]	;
 	}
 	
@@ -197,8 +197,8 @@ int Histogram<T>::getThresholdValueFisher (int kmin, int kmax,
 	Smax = (W/M)*(1.-W/M)*(m1 -	m0)*(m1	- m0) ;
 	
 	for	(k = kmin+1	; k	< kmax ; k++) {
-		m0 = m0*(M - W) +	k*H[k] ;
-	  	m1 = m1 *	W -	k*H[k] ;
+		m0 = m0*(M - W) +	k*(float)H[k] ;
+	  	m1 = m1 *	W -	k*(float)H[k] ;
 	  	W	-= H[k]	;
 	  	m1 /=	W ;
 	  	m0 /=	(M-W) ;
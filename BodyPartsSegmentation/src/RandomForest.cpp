@@ -302,3 +302,121 @@ void RandomForest::readForeset( std::istream &in )
 	}
 }
 
+
+//---------------------------------------------------------------
+/* functions of CompiledForest */
+
+enum { DEPT, EDGE_MAG, EDGE_ORI };	/* feature_id */
+enum { DIFF, SUM, BOTH };               /* feature_type */
+
+
+CompiledForest::CompiledForest()
+{
+	valid = false; 
+}
+
+
+bool CompiledForest::compile( RandomForest* forest )
+{
+	nodes.clear(); 
+	terminals.clear(); 
+	roots.clear(); 
+	valid = true; 
+	for ( list<TreeNode*>::iterator it=forest->rootNodeList.begin(); it!=forest->rootNodeList.end(); it++ )
+		roots.push_back( addNode( *it ) ); 
+	if ( ! valid )
+	{	nodes.clear(); 
+		terminals.clear(); 
+		roots.clear(); 
+	}
+	return valid; 
+}
+
+
+int CompiledForest::addNode( TreeNode* node )
+{
+	DecisionNode* dnode = dynamic_cast <DecisionNode *> (node); 
+	if ( dnode )
+	{	if ( dnode->feat_id!=DEPT || ( dnode->feat_type!=DIFF && dnode->feat_type!=SUM ) )
+			valid = false; 
+		int index = (int) nodes.size(); 
+		nodes.push_back( Node() ); 
+		Node n; 
+		n.feat_type = dnode->feat_type; 
+		n.offset1_x = dnode->offset_1.x; 
+		n.offset1_y = dnode->offset_1.y; 
+		n.offset2_x = dnode->offset_2.x; 
+		n.offset2_y = dnode->offset_2.y; 
+		n.threshold = dnode->threshold; 
+		n.smaller = addNode( dnode->nodeAttSmaller ); 
+		n.greater = addNode( dnode->nodeAttGE ); 
+		nodes[index] = n; 
+		return index; 
+	}
+
+	TerminalNode* tnode = dynamic_cast <TerminalNode *> (node); 
+	int index = (int) terminals.size() / PART_SIZE; 
+	terminals.resize( terminals.size() + PART_SIZE, 0 ); 
+	if ( tnode )
+	{	map<int, float> dis = tnode->getClassDistribution();
+		for ( map<int, float>::iterator p=dis.begin(); p!=dis.end(); p++ )
+			terminals[index*PART_SIZE + p->first] += p->second;
+	}
+	return -index - 1; 
+}
+
+
+// depth at a probe position, as computed by Feature::computeFeature
+static inline float probeDepth( float** data, int rows, int cols, int m, int n, float depth, int offset_x, int offset_y, float scale_x, float scale_y )
+{
+	int nora_x, nora_y; 
+	if ( depth !=0 )
+	{	nora_x = offset_x * scale_x / depth;
+		nora_y = offset_y * scale_y / depth;
+	} else {
+		nora_x = offset_x * scale_x;
+		nora_y = offset_y * scale_y;
+	}
+	int x = m + nora_x; 
+	int y = n + nora_y; 
+	if ( x<0 )
+		x = 0; 
+	if ( x>rows-1 )
+		x = rows - 1; 
+	if ( y<0 )
+		y = 0; 
+	if ( y>cols-1 )
+		y = cols - 1; 
+	return data[x][y]; 
+}
+
+
+int CompiledForest::classify( float** data, int rows, int cols, int m, int n, float scale_x, float scale_y, float* vote ) const
+{
+	for ( int i=0; i<PART_SIZE; i++ )
+		vote[i] = 0;
+
+	int visited = 0; 
+	float depth = data[m][n]; 
+	for ( size_t t=0; t<roots.size(); t++ )
+	{	int index = roots[t]; 
+		while ( index>=0 )
+		{	const Node& node = nodes[index]; 
+			float left_depth = probeDepth( data, rows, cols, m, n, depth, node.offset1_x, node.offset1_y, scale_x, scale_y ); 
+			float right_depth = probeDepth( data, rows, cols, m, n, depth, node.offset2_x, node.offset2_y, scale_x, scale_y ); 
+			float value = ( node.feat_type==DIFF ) ? left_depth - right_depth : left_depth + right_depth; 
+			index = ( value<node.threshold ) ? node.smaller : node.greater; 
+			visited++; 
+		}
+		const float* distribution = &terminals[(-index-1)*PART_SIZE]; 
+		for ( int i=0; i<PART_SIZE; i++ )
+			vote[i] += distribution[i];
+	}
+
+	if ( roots.size()>0 )
+	{	for ( int i=0; i<PART_SIZE; i++ )	
+			vote[i] /= (int)roots.size();
+	}
+
+	return visited; 
+}
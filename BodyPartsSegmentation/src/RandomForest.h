@@ -3,6 +3,7 @@
 
 #include "support_class.h"
 #include <ostream>
+#include <vector>
 
 class TerminalNode;
 
@@ -104,4 +105,54 @@ private:
 
 };
 
+
+//-------------------------------------------------------------------
+/* Read-only forest in flat arrays, for fast classification */
+
+class CompiledForest {
+
+public:
+	CompiledForest();
+
+	/**
+	 * Build the flat representation of a forest.
+	 * Only depth features of type DIFF or SUM are supported.
+	 * return false if the forest uses other features
+	 */
+	bool compile( RandomForest* forest );
+
+	bool isValid() const { return valid; }
+	int treeCount() const { return (int) roots.size(); }
+
+	/**
+	 * Classify one pixel of depth data, the same way as 
+	 * RandomForest::testFeatInForest with a depth feature.
+	 * @param data the depth data rows
+	 * @param rows, cols the data size
+	 * @param m, n the pixel row and column
+	 * @param scale_x, scale_y the offsets scale along rows and columns
+	 * @param vote the averaged class distributions (PART_SIZE values)
+	 * return the number of decision nodes visited, in all the trees
+	 */
+	int classify( float** data, int rows, int cols, int m, int n, float scale_x, float scale_y, float* vote ) const;
+
+	struct Node {
+		int feat_type;
+		int offset1_x, offset1_y;
+		int offset2_x, offset2_y;
+		float threshold;
+		int smaller;	// child index, or -(terminal index)-1
+		int greater;
+	};
+
+	std::vector<Node> nodes;	// decision nodes
+	std::vector<float> terminals;	// class distributions of the terminal nodes
+	std::vector<int> roots;		// root of each tree
+
+private:
+	int addNode( TreeNode* node );
+
+	bool valid;
+};
+
 #endif
@@ -1,11 +1,15 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <algorithm>
 #include <assert.h>
+#include <math.h>
+#include <string.h>
 #include <highgui.h>
 #include "support_class.h"
 #include "RandomForest.h"
 #include "Histogram.h"
+#include "ForestCache.h"
 #include "bodypartsegmentation.h"
 
 
@@ -16,6 +20,28 @@
 int PART_SIZE = 11; 
 int FIXED_INF = 100; 
 
+// colour of each body part (BGR), for visualization
+static const unsigned char PART_COLOURS[][3] = {
+	{ 0, 0, 255 },		// head
+	{ 0, 255, 0 },		// neck
+	{ 125, 50, 0 },		// left shoulder
+	{ 50, 0, 125 },		// right shoulder
+	{ 192, 182, 32 },	// left upper arm    (0, 125, 50)
+	{ 25, 100, 0 },		// left forearm
+	{ 9, 246, 253 },	// right upper arm    (0, 25, 100)
+	{ 8, 165, 255 },	// right forearm    (100, 0, 25)
+	{ 255, 0, 0 },		// left hip (wrist)
+	{ 26, 80, 255 },	// right hip   (100, 125, 125)
+	{ 255, 255, 255 }	// other parts  cvScalar (147, 94, 213)
+};
+static const int PART_COLOURS_COUNT = sizeof(PART_COLOURS) / sizeof(PART_COLOURS[0]);
+
+// milliseconds elapsed since a cv::getTickCount() value
+static double elapsedMs( int64 start )
+{
+	return ( cv::getTickCount() - start ) * 1000. / cv::getTickFrequency();
+}
+
 //------------- define the feature type and id -------------
 enum { DEPT, EDGE_MAG, EDGE_ORI };	/* feature_id */
 enum { DIFF, SUM, BOTH };               /* feature_type */
@@ -26,17 +52,48 @@ BodyPartSegmentation::BodyPartSegmentation( const char *forestParamFileName, con
 {
 	// basic initializations
 	depthIsInMillimeters = _depthIsInMillimeters;
-	forest = new RandomForest();
-	std::string params_file(forestParamFileName); 
-	std::ifstream input; 
-	input.open( params_file.c_str(), std::ios::in );
-	if( ! input.is_open() )
-		std::cout << "BodyPartSegmentation::BodyPartSegmentation ERROR: failed to open forest parameters file " << params_file << "." << std::endl;
-	forest->readForeset( input );
-	input.close();
-	ground = cvLoadImage(groundImgFileName);
-	if( ground == NULL )
-		std::cout << "BodyPartSegmentation::BodyPartSegmentation warning: failed to load " << groundImgFileName << "." << std::endl;
+	temporalCoherence = false;
+	temporalTolerance = 0.01;
+	hasPrevFrame = false;
+	prevSmoothDepth = NULL;
+	prevHumanDepth = NULL;
+	prevVotes = NULL;
+	changedIntegral = NULL;
+	halfResolution = false;
+	forestBackend = COMPILED_FOREST;
+	stats = Statistics();
+	offsetScaleRow = 1;
+	offsetScaleCol = 1;
+	smoothBuf = NULL;
+	humanBuf = NULL;
+	rowBuf = NULL;
+	depthHist = new Histogram<int> (1086, 0, 1085, true);
+
+	// depth conversion tables
+	rawToMeters = new float [2048];
+	for( int i = 0; i < 2048; i++ )
+		rawToMeters[i] = raw_depth_to_meters(i);
+	mmToRaw = new unsigned short [65536];
+	for( int i = 0; i < 65536; i++ )
+	{
+		float depthInMeters = i / 1000.0;
+		mmToRaw[i] = meters_to_raw_depth(depthInMeters);
+	}
+
+	// forest and legend are shared with the other instances
+	model = ForestCache::acquire( forestParamFileName, groundImgFileName );
+	forest = model->forest;
+	ground = model->ground;
+
+	// largest offset a pixel may be probed at, before depth normalisation
+	maxProbeOffset = 0;
+	for( std::list<DecisionNode*>::iterator it = forest->dnlist.begin(); it != forest->dnlist.end(); it++ )
+	{
+		int offsets[4] = { (*it)->offset_1.x, (*it)->offset_1.y, (*it)->offset_2.x, (*it)->offset_2.y };
+		for( int i = 0; i < 4; i++ )
+			if( abs(offsets[i]) > maxProbeOffset )
+				maxProbeOffset = abs(offsets[i]);
+	}
 
 #if DEBUG
 	if( depthIsInMillimeters )
@@ -51,8 +108,12 @@ BodyPartSegmentation::BodyPartSegmentation( const char *forestParamFileName, con
 BodyPartSegmentation::~BodyPartSegmentation()
 {
 	// cleaning
-	delete forest;
-	cvReleaseImage(&ground);
+	ForestCache::release( model );
+	releaseTemporalState();
+	releaseBuffers();
+	delete depthHist;
+	delete[] rawToMeters;
+	delete[] mmToRaw;
 }
 
 //---------------------------------------------------------
@@ -64,6 +125,87 @@ void BodyPartSegmentation::init()
 
 //---------------------------------------------------------
 
+void BodyPartSegmentation::setHalfResolution(bool enable)
+{
+	halfResolution = enable;
+}
+
+//---------------------------------------------------------
+
+void BodyPartSegmentation::setForestBackend(int backend)
+{
+	forestBackend = backend;
+}
+
+//---------------------------------------------------------
+
+void BodyPartSegmentation::allocateBuffers(int height, int width)
+{
+	releaseBuffers();
+	smoothBuf = cvCreateMat( height, width, CV_32SC1 ); 
+	humanBuf = cvCreateMat( height, width, CV_32FC1 ); 
+	rowBuf = new int [ 4*width ];
+}
+
+//---------------------------------------------------------
+
+void BodyPartSegmentation::releaseBuffers()
+{
+	if( smoothBuf != NULL )
+		cvReleaseMat( &smoothBuf );
+	if( humanBuf != NULL )
+		cvReleaseMat( &humanBuf );
+	delete[] rowBuf;
+	rowBuf = NULL;
+}
+
+//---------------------------------------------------------
+
+void BodyPartSegmentation::setTemporalCoherence(bool enable, float tolerance)
+{
+	temporalCoherence = enable;
+	temporalTolerance = tolerance;
+	if( ! enable )
+		releaseTemporalState();
+	hasPrevFrame = false;
+}
+
+//---------------------------------------------------------
+
+void BodyPartSegmentation::resetTemporalState()
+{
+	hasPrevFrame = false;
+}
+
+//---------------------------------------------------------
+
+void BodyPartSegmentation::allocateTemporalState(int height, int width)
+{
+	releaseTemporalState();
+	prevSmoothDepth = cvCreateMat( height, width, CV_32SC1 ); 
+	prevHumanDepth = cvCreateMat( height, width, CV_32FC1 ); 
+	prevVotes = new float [ height*width*PART_SIZE ];
+	changedIntegral = new int [ (height+1)*(width+1) ];
+	hasPrevFrame = false;
+}
+
+//---------------------------------------------------------
+
+void BodyPartSegmentation::releaseTemporalState()
+{
+	if( prevSmoothDepth != NULL )
+		cvReleaseMat( &prevSmoothDepth );
+	if( prevHumanDepth != NULL )
+		cvReleaseMat( &prevHumanDepth );
+	delete[] prevVotes;
+	prevVotes = NULL;
+	delete[] changedIntegral;
+	changedIntegral = NULL;
+	hasPrevFrame = false;
+}
+
+//---------------------------------------------------------
+
 float BodyPartSegmentation::raw_depth_to_meters(int raw_depth)
 {
 	// depth must be in [0,2047]
@@ -96,7 +238,10 @@ void BodyPartSegmentation::ExtractDepthHuman( CvMat* src, CvMat* mask, CvMat* ds
 		for( int n=0; n<width; n++ )
 		{	if( *(mask->data.ptr+m*width+n)==1 )
 			{	int depth_value = (int) *(src->data.fl+m*width+n); 
-				*(dst->data.fl+m*width+n) = raw_depth_to_meters( depth_value ); 
+				if ( depth_value>=0 && depth_value<2048 )
+					*(dst->data.fl+m*width+n) = rawToMeters[depth_value]; 
+				else
+					*(dst->data.fl+m*width+n) = raw_depth_to_meters( depth_value ); 
 				if ( *(dst->data.fl+m*width+n)>max_value )
 					max_value = *(dst->data.fl+m*width+n); 
 			} else
@@ -115,124 +260,348 @@ void BodyPartSegmentation::ExtractDepthHuman( CvMat* src, CvMat* mask, CvMat* ds
 
 //---------------------------------------------------------
 
+int BodyPartSegmentation::ClassifyPixel( float** filtered_depth, float** filtered_edge, int height, int width, int m, int n, float* vote )
+{
+	if ( forestBackend==COMPILED_FOREST && model->compiled.isValid() )
+	{	// flat forest, depth features only
+		stats.visitedNodes += model->compiled.classify( filtered_depth, height, width, m, n, offsetScaleRow, offsetScaleCol, vote ); 
+	} else 
+	{	Feature* feat_depth = new Feature( DEPT, cvPoint( m, n), filtered_depth, height, width, FIXED_INF );
+		feat_depth->set_scale( offsetScaleRow, offsetScaleCol ); 
+		Feature* feat_rgb = NULL;
+		if ( filtered_edge ) 
+		{	feat_rgb = new Feature( EDGE_MAG, cvPoint( m, n ), filtered_edge, height, width, FIXED_INF );
+			feat_rgb->set_scale( offsetScaleRow, offsetScaleCol ); 
+		}
+		Feature* feat_rgb_ori = NULL; 
+		FeatureVector* feat_vec = new FeatureVector( feat_depth, FIXED_INF ); 
+		feat_vec->add_feature( feat_rgb ); 
+		feat_vec->add_feature( feat_rgb_ori ); 
+
+		std::list<TerminalNode*> leaves = forest->testFeatInForest( feat_vec, vote, PART_SIZE ); 		
+		delete feat_vec; 
+
+		// decision nodes between the root and the leaf of each tree
+		std::list<TreeNode*>::const_iterator root = forest->rootNodeList.begin(); 
+		for ( std::list<TerminalNode*>::const_iterator leaf=leaves.begin(); leaf!=leaves.end(); leaf++, root++ )
+			stats.visitedNodes += (*leaf)->level - (*root)->level; 
+	}
+							
+	float max = 0; 
+	int classified = -1; 
+	for ( int w=0; w<PART_SIZE; w++ )
+	{	if ( vote[w]>max )
+		{	max = vote[w];  classified = w;     }
+	}
+
+	return classified; 
+}
+
+//---------------------------------------------------------
+
 IplImage* BodyPartSegmentation::SegmentParts( CvMat* seg_depth, CvMat* seg_edge )
 {
+	cv::Mat labels; 
+	classifyParts( seg_depth, seg_edge, labels, NULL ); 
 
+	cv::Mat colorMat; 
+	colorizeLabels( labels, false, colorMat ); 
+	IplImage* color = cvCreateImage( cvSize(colorMat.cols, colorMat.rows), IPL_DEPTH_8U, 3); 
+	IplImage colorIpl = colorMat; 
+	cvCopy( &colorIpl, color ); 
+
+	return color; 
+}
+
+//---------------------------------------------------------
+
+void BodyPartSegmentation::classifyParts( CvMat* seg_depth, CvMat* seg_edge, cv::Mat& labels, cv::Mat* probs, bool temporal )
+{
 	int height = seg_depth->height; 
 	int width = seg_depth->width; 
 
-	IplImage* color = cvCreateImage( cvSize(width, height), IPL_DEPTH_8U, 3); 
+	labels.create( height, width, CV_8UC1 ); 
+	if ( probs )
+		probs->create( height, width, CV_32FC(PART_SIZE) ); 
 
+	// rows of the data, as expected by the features
 	float* vote = new float [ PART_SIZE ]; 
 	float ** filtered_depth = new float* [height]; 
 	for ( int m=0; m<height; m++ )
-	{	filtered_depth[m] = new float [width]; 
-		for ( int n=0; n<width; n++ )
-			filtered_depth[m][n] = *(seg_depth->data.fl+m*width+n); 
-	}
+		filtered_depth[m] = seg_depth->data.fl + m*width; 
 	
 	float ** filtered_edge = 0; 
 	if ( seg_edge )
 	{	filtered_edge = new float* [height]; 
 		for ( int m=0; m<height; m++ )
-		{	filtered_edge[m] = new float [width]; 
+			filtered_edge[m] = seg_edge->data.fl + m*width; 
+	}
+
+	// in temporal coherence mode, find the pixels that can't have changed 
+	// since the previous frame: neither their depth nor the depth at any
+	// position they may probe changed more than the tolerance
+	bool keepVotes = temporal && temporalCoherence && prevHumanDepth != NULL 
+		&& prevHumanDepth->height == height && prevHumanDepth->width == width;
+	bool reuse = keepVotes && hasPrevFrame && seg_edge == NULL;
+	float maxOffset = maxProbeOffset * std::max( offsetScaleRow, offsetScaleCol ); 
+	if ( reuse )
+	{	// integral image of the changed pixels
+		int istep = width + 1; 
+		memset( changedIntegral, 0, istep*sizeof(int) ); 
+		for ( int m=0; m<height; m++ )
+		{	int row_sum = 0; 
+			int* integral = changedIntegral + (m+1)*istep; 
+			integral[0] = 0; 
 			for ( int n=0; n<width; n++ )
-				filtered_edge[m][n] = *(seg_edge->data.fl+m*width+n); 
+			{	float cur = filtered_depth[m][n]; 
+				float prev = *(prevHumanDepth->data.fl+m*width+n); 
+				bool changed; 
+				if ( cur==FIXED_INF || prev==FIXED_INF )
+					changed = ( cur!=prev ); 
+				else
+					changed = ( fabs(cur - prev) > temporalTolerance ); 
+				row_sum += changed ? 1 : 0; 
+				integral[n+1] = integral[n+1-istep] + row_sum; 
+			}
 		}
 	}
 
 	for ( int m=0; m<height; m++ )
+	{	unsigned char* label = labels.ptr<unsigned char>(m); 
+		float* prob = probs ? probs->ptr<float>(m) : NULL; 
 		for ( int n=0; n<width; n++ )
 		{
 			if ( filtered_depth[m][n]!=FIXED_INF )
-			{	Feature* feat_depth = new Feature( DEPT, cvPoint( m, n), filtered_depth, height, width, FIXED_INF );
-				Feature* feat_rgb = NULL;
-				if ( seg_edge ) 
-					feat_rgb = new Feature( EDGE_MAG, cvPoint( m, n ), filtered_edge, height, width, FIXED_INF );
-				Feature* feat_rgb_ori = NULL; 
- 				FeatureVector* feat_vec = new FeatureVector( feat_depth, FIXED_INF ); 
-				feat_vec->add_feature( feat_rgb ); 
-				feat_vec->add_feature( feat_rgb_ori ); 
-
-				forest->testFeatInForest( feat_vec, vote, PART_SIZE ); 		
-										
-				float max = 0; 
-				int classified = -1; 
-				for ( int w=0; w<PART_SIZE; w++ )
-				{	if ( vote[w]>max )
-					{	max = vote[w];  classified = w;     }
+			{	int classified = -1; 
+				const float* pixel_vote = vote; 
+				bool reused = false; 
+				if ( reuse )
+				{	// probes are at most maxOffset/depth pixels away
+					float depth = filtered_depth[m][n]; 
+					int radius = std::max( height, width ); 
+					if ( depth==0 )
+						radius = (int) maxOffset + 1; 
+					else if ( maxOffset / depth < radius )
+						radius = (int) ( maxOffset / depth ) + 1; 
+					int top = std::max( m - radius, 0 ); 
+					int bottom = std::min( m + radius + 1, height ); 
+					int left = std::max( n - radius, 0 ); 
+					int right = std::min( n + radius + 1, width ); 
+					int istep = width + 1; 
+					int changed = changedIntegral[bottom*istep+right] - changedIntegral[top*istep+right]
+						- changedIntegral[bottom*istep+left] + changedIntegral[top*istep+left]; 
+					if ( changed==0 )
+					{	// same result as in the previous frame
+						pixel_vote = prevVotes + (m*width+n)*PART_SIZE; 
+						float max = 0; 
+						for ( int w=0; w<PART_SIZE; w++ )
+						{	if ( pixel_vote[w]>max )
+							{	max = pixel_vote[w];  classified = w;     }
+						}
+						reused = true; 
+					}
 				}
-				delete feat_vec; 
-
-				switch ( classified )
-				{
-					case 0:  cvSet2D( color, m, n, cvScalar(0, 0, 255) ); break;   // head
-					case 1:  cvSet2D( color, m, n, cvScalar(0, 255, 0) ); break;   // neck
-					case 2:  cvSet2D( color, m, n, cvScalar(125, 50, 0) ); break;  // left shoulder
-					case 3:  cvSet2D( color, m, n, cvScalar(50, 0, 125) ); break;  // right shoulder
-					case 4:  cvSet2D( color, m, n, cvScalar(192, 182, 32) ); break;  // left upper arm    (0, 125, 50)
-					case 5:  cvSet2D( color, m, n, cvScalar(25, 100, 0) ); break;  // left forearm
-					case 6:  cvSet2D( color, m, n, cvScalar(9, 246, 253) ); break;  // right upper arm    (0, 25, 100)
-					case 7:  cvSet2D( color, m, n, cvScalar(8, 165, 255)  ); break;  // right forearm    (100, 0, 25)
-					case 8:  cvSet2D( color, m, n, cvScalar(255, 0, 0) ); break;   // left hip (wrist)
-					case 9:  cvSet2D( color, m, n, cvScalar(26, 80, 255) ); break;   // right hip   (100, 125, 125)
-					case 10:  cvSet2D( color, m, n, cvScalar(255, 255, 255) ); break;   // other parts  cvScalar (147, 94, 213)
+				if ( reused )
+					stats.reusedPixels++; 
+				else
+				{	stats.classifiedPixels++; 
+					classified = ClassifyPixel( filtered_depth, filtered_edge, height, width, m, n, vote ); 
+					if ( keepVotes )
+					{	// the votes stay valid as long as the depth stays close to 
+						// the one they were computed from
+						memcpy( prevVotes + (m*width+n)*PART_SIZE, vote, PART_SIZE*sizeof(float) ); 
+						*(prevHumanDepth->data.fl+m*width+n) = filtered_depth[m][n]; 
+					}
 				}
+
+				label[n] = ( classified<0 ) ? BACKGROUND_LABEL : classified; 
+				if ( prob )
+					memcpy( prob + n*PART_SIZE, pixel_vote, PART_SIZE*sizeof(float) ); 
 			} else 
-				cvSet2D( color, m, n, cvScalar(0, 0, 0) );
+			{	label[n] = BACKGROUND_LABEL; 
+				if ( prob )
+					memset( prob + n*PART_SIZE, 0, PART_SIZE*sizeof(float) ); 
+				if ( keepVotes )
+					*(prevHumanDepth->data.fl+m*width+n) = FIXED_INF; 
+			}
 		}
+	}
 
 	// release the memories 
-	for ( int m=0; m<height; m++ )		
-		delete[] filtered_depth[m]; 
-	if ( seg_edge )
-	{	for ( int m=0; m<height; m++ )
-			delete[] filtered_edge[m]; 
-		delete[] filtered_edge; 
-	}
+	delete[] filtered_edge; 
 	delete[] filtered_depth; 
 	delete[] vote; 
+}
 
-	return color; 
+//---------------------------------------------------------
 
+void BodyPartSegmentation::colorizeLabels(const cv::Mat& labels, bool bLegend, cv::Mat& outputImg)
+{
+	outputImg.create( labels.rows, labels.cols, CV_8UC3 ); 
+	for ( int m=0; m<labels.rows; m++ )
+	{	const unsigned char* label = labels.ptr<unsigned char>(m); 
+		unsigned char* color = outputImg.ptr<unsigned char>(m); 
+		for ( int n=0; n<labels.cols; n++, color += 3 )
+		{	if ( label[n]<PART_COLOURS_COUNT )
+			{	color[0] = PART_COLOURS[label[n]][0]; 
+				color[1] = PART_COLOURS[label[n]][1]; 
+				color[2] = PART_COLOURS[label[n]][2]; 
+			} else
+				color[0] = color[1] = color[2] = 0; 
+		}
+	}
+
+	// display legend on output image
+	if( bLegend && ground != NULL )
+	{
+		cv::Rect roi( 0, 0, std::min( ground->width, outputImg.cols), std::min( ground->height, outputImg.rows)); 
+		cv::Mat legend = cv::cvarrToMat(ground); 
+		cv::Mat outputRoi = outputImg(roi); 
+		legend(roi).copyTo(outputRoi); 
+	}
+}
+
+//---------------------------------------------------------
+
+void BodyPartSegmentation::labelsFromColors(const cv::Mat& colorImg, cv::Mat& labels)
+{
+	labels.create( colorImg.rows, colorImg.cols, CV_8UC1 ); 
+	for ( int m=0; m<colorImg.rows; m++ )
+	{	const unsigned char* color = colorImg.ptr<unsigned char>(m); 
+		unsigned char* label = labels.ptr<unsigned char>(m); 
+		for ( int n=0; n<colorImg.cols; n++, color += 3 )
+		{	label[n] = BACKGROUND_LABEL; 
+			for ( int w=0; w<PART_COLOURS_COUNT; w++ )
+			{	if ( color[0]==PART_COLOURS[w][0] && color[1]==PART_COLOURS[w][1] && color[2]==PART_COLOURS[w][2] )
+				{	label[n] = w;  break;	}
+			}
+		}
+	}
 }
 
 //------------------------------------------------------------
 
 void BodyPartSegmentation::run(const cv::Mat& depthImg, bool bLegend, cv::Mat& outputImg)
 {
-	if( depthImg.empty() || depthImg.rows != 480 || depthImg.cols != 640 || depthImg.channels() != 1 || depthImg.depth() != CV_16U )
+	if( ! run( depthImg, labelsBuf) )
+		return;
+	colorizeLabels( labelsBuf, bLegend, outputImg);
+}
+
+//------------------------------------------------------------
+
+bool BodyPartSegmentation::run(const cv::Mat& depthImg, cv::Mat& labels, cv::Mat* probs)
+{
+	if( depthImg.empty() || depthImg.channels() != 1 || depthImg.depth() != CV_16U )
 	{
 		// bad input, exit
-		printf( "BodyPartSegmentation::run: input depth image must be a 1 channel, 16 bits, 640x480 pixels image.\n");
-		return;
+		printf( "BodyPartSegmentation::run: input depth image must be a 1 channel, 16 bits image.\n");
+		return false;
 	}
 
+	int64 start = cv::getTickCount(); 
+	stats = Statistics(); 
+
+	if( halfResolution && depthImg.rows >= 2 && depthImg.cols >= 2 )
+	{
+		// segment a decimated depth image, then enlarge the results
+		int height = depthImg.rows / 2; 
+		int width = depthImg.cols / 2; 
+		halfDepthBuf.create( height, width, CV_16UC1 ); 
+		for( int m = 0; m < height; m++ )
+		{
+			const unsigned short* src = depthImg.ptr<unsigned short>(2*m); 
+			unsigned short* half = halfDepthBuf.ptr<unsigned short>(m); 
+			for( int n = 0; n < width; n++ )
+				half[n] = src[2*n]; 
+		}
+		stats.resizeTime += elapsedMs( start ); 
+		processDepth( halfDepthBuf, halfLabelsBuf, probs ? &halfProbsBuf : NULL); 
+		int64 resizeStart = cv::getTickCount(); 
+		cv::Size fullSize( depthImg.cols, depthImg.rows); 
+		cv::resize( halfLabelsBuf, labels, fullSize, 0, 0, cv::INTER_NEAREST); 
+		if( probs )
+			cv::resize( halfProbsBuf, *probs, fullSize, 0, 0, cv::INTER_NEAREST); 
+		stats.resizeTime += elapsedMs( resizeStart ); 
+	}
+	else
+		processDepth( depthImg, labels, probs); 
+
+	stats.totalTime = elapsedMs( start ); 
+	return true;
+}
+
+//------------------------------------------------------------
+
+void BodyPartSegmentation::processDepth(const cv::Mat& depthImg, cv::Mat& labels, cv::Mat* probs)
+{
 	int height = depthImg.rows; 
 	int width = depthImg.cols; 
-	CvMat* mask = cvCreateMat( height, width, CV_8UC1 ); 
-	CvMat* pro_mat = cvCreateMat( height, width, CV_32FC1 ); 
-	CvMat* dst = cvCreateMat( height, width, CV_32FC1 ); 
+
+	// (re)allocate buffers when resolution changes
+	if( smoothBuf == NULL || smoothBuf->height != height || smoothBuf->width != width )
+		allocateBuffers( height, width);
+	if( temporalCoherence && ( prevSmoothDepth == NULL || prevSmoothDepth->height != height || prevSmoothDepth->width != width ) )
+		allocateTemporalState( height, width);
+
+	// forest offsets are learned on TRAIN_WIDTH x TRAIN_HEIGHT images
+	offsetScaleRow = height / (float) TRAIN_HEIGHT; 
+	offsetScaleCol = width / (float) TRAIN_WIDTH; 
 
 	// do your image processing
-	computePersonMask( depthImg, mask, pro_mat);
-	ExtractDepthHuman( pro_mat, mask, dst );  
-	IplImage *tmpOutputImg = SegmentParts( dst, NULL );
+	int thres = smoothDepth( depthImg, temporalCoherence && hasPrevFrame );
+	int64 start = cv::getTickCount(); 
+	extractHuman( thres, humanBuf );  
+	stats.extractTime += elapsedMs( start ); 
+	start = cv::getTickCount(); 
+	classifyParts( humanBuf, NULL, labels, probs );
+	stats.classifyTime += elapsedMs( start ); 
+
+	// keep current frame for the next one
+	if( temporalCoherence )
+	{
+		cvCopy( smoothBuf, prevSmoothDepth);
+		hasPrevFrame = true;
+	}
+}
 
-	// display legend on output image
-	if( bLegend && ground != NULL )
+//------------------------------------------------------------
+
+bool BodyPartSegmentation::extractHumanDepth(const cv::Mat& depthImg, cv::Mat& humanDepth)
+{
+	if( depthImg.empty() || depthImg.channels() != 1 || depthImg.depth() != CV_16U )
 	{
-		cvSetImageROI( tmpOutputImg, cvRect( 0, 0, ground->width, ground->height)); 
-		cvCopy( ground, tmpOutputImg); 
-		cvResetImageROI(tmpOutputImg);
+		printf( "BodyPartSegmentation::extractHumanDepth: input depth image must be a 1 channel, 16 bits image.\n");
+		return false;
 	}
 
-	outputImg = cv::cvarrToMat(tmpOutputImg, true);
+	int height = depthImg.rows;
+	int width = depthImg.cols;
+	if( smoothBuf == NULL || smoothBuf->height != height || smoothBuf->width != width )
+		allocateBuffers( height, width);
+
+	humanDepth.create( height, width, CV_32FC1 );
+	CvMat human = humanDepth;
+	// the histogram is rebuilt from scratch, the next frame can't be 
+	// updated incrementally
+	hasPrevFrame = false;
+	int thres = smoothDepth( depthImg, false );
+	extractHuman( thres, &human );
 
-	cvReleaseMat( &dst ); 
-	cvReleaseMat( &pro_mat ); 
-	cvReleaseMat( &mask ); 
-	cvReleaseImage( &tmpOutputImg ); 
+	return true;
+}
+
+//------------------------------------------------------------
+
+void BodyPartSegmentation::classifyHumanDepth(const cv::Mat& humanDepth, cv::Mat& labels, cv::Mat* probs)
+{
+	offsetScaleRow = humanDepth.rows / (float) TRAIN_HEIGHT;
+	offsetScaleCol = humanDepth.cols / (float) TRAIN_WIDTH;
+
+	// classifyParts() only reads the data, the temporal state belongs to 
+	// the processDepth() stream
+	CvMat human = humanDepth;
+	classifyParts( &human, NULL, labels, probs, false );
 }
 
 //------------------------------------------------------------
@@ -242,56 +611,152 @@ void BodyPartSegmentation::computePersonMask(const cv::Mat& depthImg, CvMat* mas
 	int height = depthImg.rows; 
 	int width = depthImg.cols; 
 
-	// define the tmp variables
-	CvMat* pre_mat = cvCreateMat( height, width, CV_32FC1 ); 
+	if( smoothBuf == NULL || smoothBuf->height != height || smoothBuf->width != width )
+		allocateBuffers( height, width);
+
+	// the histogram is rebuilt from scratch, the next frame can't be 
+	// updated incrementally
+	hasPrevFrame = false;
+	int thres = smoothDepth( depthImg, false );
+
+	for ( int i=0; i<height*width; i++ )
+	{	int smooth_value = smoothBuf->data.i[i]; 
+		int depth_value = smooth_value >> 4; 
+		*(pro_mat->data.fl+i) = smooth_value / 16.f; 
+		if ( depth_value<=thres && depth_value>0 )
+			*(mask->data.ptr+i) = 1; 
+		else
+			*(mask->data.ptr+i) = 0; 
+	}
+} 
+
+//------------------------------------------------------------
 
-	// convert depth values to float
-	assert( sizeof(unsigned short) == 2 );
-	unsigned short* data= (unsigned short*) depthImg.data; 
-	for( int m=0; m<height; m++)
+void BodyPartSegmentation::filterDepthRow(const cv::Mat& depthImg, int row, int* hsum)
+{
+	int width = depthImg.cols; 
+	const unsigned short* data = depthImg.ptr<unsigned short>(row); 
+	int* raw = rowBuf; 
+
+	// convert depth values to raw depth
+	if( depthIsInMillimeters )
 	{
 		for( int n=0; n<width; n++)
-		{
-			if( depthIsInMillimeters )
-			{
-				float depthInMeters = (*(data + m*width + n)) / 1000.0;
-				*(pre_mat->data.fl+m*width+n) = meters_to_raw_depth(depthInMeters); 
-			}
-			else
-			{
-				*(pre_mat->data.fl+m*width+n)=(float)*(data+m*width+n); 
-				// if depth is coded on the 11 most significant bits
-				//*(pre_mat->data.fl+m*width+n) /= 32;
-			}
-		}
+			raw[n] = mmToRaw[data[n]]; 
+	}
+	else
+	{
+		for( int n=0; n<width; n++)
+			raw[n] = data[n]; 
+		// if depth is coded on the 11 most significant bits
+		//	raw[n] = data[n] / 32;
 	}
 
-	// smooth the depth image
-	cvSmooth( pre_mat, pro_mat, CV_GAUSSIAN );
+	// horizontal [1 2 1] filter, replicated borders
+	if( width == 1 )
+	{
+		hsum[0] = 4*raw[0]; 
+		return; 
+	}
+	hsum[0] = 3*raw[0] + raw[1]; 
+	for( int n=1; n<width-1; n++)
+		hsum[n] = raw[n-1] + 2*raw[n] + raw[n+1]; 
+	hsum[width-1] = raw[width-2] + 3*raw[width-1]; 
+}
+
+//------------------------------------------------------------
 
-	// Create new histogram to get a thresold to get a mask
-	Histogram<float>* H = new Histogram<float> (1086, 0, 1085, true);
-	H->clear(); 
+int BodyPartSegmentation::smoothDepth(const cv::Mat& depthImg, bool incremental)
+{
+	int height = depthImg.rows; 
+	int width = depthImg.cols; 
 
-	// Add image depth values to the histogram
+	// The depth image is converted to raw depth and smoothed with the 
+	// 3x3 gaussian kernel [1 2 1]'[1 2 1]/16 and replicated borders, in 
+	// one pass over the image. Rows are filtered horizontally once and 
+	// kept in a ring of 3 rows. Sums are kept in integers: smoothBuf 
+	// receives 16 times the smoothed depth, which is exactly the float 
+	// result of cvSmooth( CV_GAUSSIAN ).
+	// The histogram of the smoothed depth in ]0,1086[ is filled in the 
+	// same pass, or only updated with the changed values if incremental.
+	int64 start = cv::getTickCount(); 
+	int* ring[3] = { rowBuf + width, rowBuf + 2*width, rowBuf + 3*width }; 
+	int* H = depthHist->bins; 
+	const int maxSum = 1086*16; 
+	if ( ! incremental )
+		depthHist->clear(); 
+
+	filterDepthRow( depthImg, 0, ring[0] ); 
+	int* prev_row = ring[0]; 
+	int* cur_row = ring[0]; 
 	for ( int m=0; m<height; m++ )
-		for ( int n=0; n<width; n++ ) 
-    		{	float depth_value = *(pro_mat->data.fl+m*width+n); 
-			if ( depth_value>0 && depth_value<1086 )
-				H->add(depth_value);
+	{
+		int* next_row = cur_row; 
+		if ( m+1<height )
+		{	next_row = ring[(m+1)%3]; 
+			filterDepthRow( depthImg, m+1, next_row ); 
 		}
-	
-	// Compute the threshold
-	int thres = H->getThresholdValueFisher (-1,-1, NULL, NULL);
-	for ( int m=0; m<height; m++ )
-		for ( int n=0; n<width; n++ )
-		{	int depth_value = (int)*(pro_mat->data.fl+m*width+n); 
-			if ( depth_value<=thres && depth_value>0 )
-				*(mask->data.ptr+m*width+n) = 1; 
-			else
-				*(mask->data.ptr+m*width+n) = 0; 
+
+		int* smooth = smoothBuf->data.i + m*width; 
+		if ( incremental )
+		{	const int* prev_smooth = prevSmoothDepth->data.i + m*width; 
+			for ( int n=0; n<width; n++ )
+			{	int sum = prev_row[n] + 2*cur_row[n] + next_row[n]; 
+				smooth[n] = sum; 
+				int prev_sum = prev_smooth[n]; 
+				if ( sum==prev_sum )
+					continue; 
+				if ( prev_sum>0 && prev_sum<maxSum )
+					--H[prev_sum >> 4]; 
+				if ( sum>0 && sum<maxSum )
+					++H[sum >> 4]; 
+			}
+		}
+		else
+		{	for ( int n=0; n<width; n++ )
+			{	int sum = prev_row[n] + 2*cur_row[n] + next_row[n]; 
+				smooth[n] = sum; 
+				if ( sum>0 && sum<maxSum )
+					++H[sum >> 4]; 
+			}
 		}
 
-	cvReleaseMat( &pre_mat ); 
-	delete H; 	
-} 
+		prev_row = cur_row; 
+		cur_row = next_row; 
+	}
+
+	stats.smoothTime += elapsedMs( start ); 
+
+	// Compute the threshold
+	start = cv::getTickCount(); 
+	int thres = depthHist->getThresholdValueFisher (-1,-1, NULL, NULL);
+	stats.thresholdTime += elapsedMs( start ); 
+	return thres;
+}
+
+//------------------------------------------------------------
+
+void BodyPartSegmentation::extractHuman(int thres, CvMat* dst)
+{
+	int size = dst->height * dst->width; 
+	const int* smooth = smoothBuf->data.i; 
+	float* human = dst->data.fl; 
+
+	// distance of the pixels in the person mask, and max distance value
+	float max_value = 0; 
+	for ( int i=0; i<size; i++ )
+	{	int depth_value = smooth[i] >> 4; 
+		if ( depth_value<=thres && depth_value>0 )
+		{	human[i] = rawToMeters[depth_value]; 
+			if ( human[i]>max_value )
+				max_value = human[i]; 
+		} else
+			human[i] = FIXED_INF; 
+	}
+
+	// normalized into 4m 
+	for ( int i=0; i<size; i++ )
+	{	if ( human[i]!=FIXED_INF )
+			human[i] = 4 * (human[i] / max_value); 
+	}
+}
@@ -3,6 +3,9 @@
 
 #include "RandomForest.h"
 
+template <class T> class Histogram;
+struct SharedForest;
+
 #ifdef D_BUILDWINDLL
 	#define DLL_EXPORT __declspec(dllexport)
 #else
@@ -15,10 +18,36 @@
 class DLL_EXPORT BodyPartSegmentation
 {
 public:
+	// label of the pixels that don't belong to any body part
+	enum { BACKGROUND_LABEL = 255 };
+
+	// resolution of the training depth images, the forest offsets 
+	// are learned for this resolution
+	enum { TRAIN_WIDTH = 640, TRAIN_HEIGHT = 480 };
+
+	// forest inference implementations, see setForestBackend()
+	enum { LEGACY_FOREST, COMPILED_FOREST };
+
+	/**
+	 * Processing statistics of a frame. Times are in milliseconds.
+	 */
+	struct Statistics
+	{
+		double smoothTime;	// depth conversion, smoothing and depth histogram
+		double thresholdTime;	// Fisher threshold
+		double extractTime;	// human depth extraction
+		double classifyTime;	// forest inference
+		double resizeTime;	// half resolution decimation and enlargement
+		double totalTime;	// whole run() call
+		long long classifiedPixels;	// pixels run through the forest
+		long long reusedPixels;	// pixels whose votes were kept (temporal coherence mode)
+		long long visitedNodes;	// decision nodes visited, in all the trees
+	};
+
 	/*
 	 * Constructor.
 	 * @param  forestParamFileName  Forest configuration file name.
-	 * @param  groundImgFileName  Ground truth (legend) file name.
+	 * @param  groundImgFileName  Ground truth (legend) file name, empty for no legend.
 	 * @param _rawDepthInMillimeters  If true, depth values are 
 	 *        supposed to be in millimeters (MS Kinect SDK case), 
 	 *        if false depth values are supposed to be coded 
@@ -33,6 +62,97 @@ public:
 	// run for each frame
 	void run(const cv::Mat& depthImg, bool bLegend, cv::Mat& outputImg);
 
+	/**
+	 * Segment a depth image into body parts.
+	 * Output images are (re)allocated only if their size or type differ.
+	 * @param  depthImg  the 1 channel, 16 bits depth image.
+	 * @param  labels  CV_8UC1 image receiving the body part index of each
+	 *         pixel, in [0,PART_SIZE[, or BACKGROUND_LABEL.
+	 * @param  probs  if not NULL, CV_32FC(PART_SIZE) image receiving the 
+	 *         forest votes of each part (zero for the background).
+	 * @return  false if the depth image is not valid.
+	 */
+	bool run(const cv::Mat& depthImg, cv::Mat& labels, cv::Mat* probs = NULL);
+
+	/**
+	 * First stage of run(): extract the normalised human depth data.
+	 * Only uses the smoothing buffers, so that it can run in a thread
+	 * while classifyHumanDepth() runs in another thread on another frame.
+	 * The temporal coherence and half resolution modes are not used.
+	 * @param  depthImg  the 1 channel, 16 bits depth image.
+	 * @param  humanDepth  CV_32FC1 image receiving the human depth data.
+	 * @return  false if the depth image is not valid.
+	 */
+	bool extractHumanDepth(const cv::Mat& depthImg, cv::Mat& humanDepth);
+
+	/**
+	 * Second stage of run(): classify the human depth data.
+	 * The temporal coherence and half resolution modes are not used.
+	 * @param  humanDepth  CV_32FC1 human depth data, as given by
+	 *         extractHumanDepth().
+	 * @param  labels  CV_8UC1 image receiving the body part indices.
+	 * @param  probs  if not NULL, image receiving the forest votes.
+	 */
+	void classifyHumanDepth(const cv::Mat& humanDepth, cv::Mat& labels, cv::Mat* probs = NULL);
+
+	/**
+	 * Build the colour visualization of a label image.
+	 * @param  labels  CV_8UC1 label image, as given by run().
+	 * @param  bLegend  if true, the legend is displayed on the output image.
+	 * @param  outputImg  CV_8UC3 colour image.
+	 */
+	void colorizeLabels(const cv::Mat& labels, bool bLegend, cv::Mat& outputImg);
+
+	/**
+	 * Convert a colour visualization back to a label image.
+	 * Pixels that don't have a body part colour are background.
+	 * @param  colorImg  CV_8UC3 colour image, as given by colorizeLabels().
+	 * @param  labels  CV_8UC1 label image.
+	 */
+	static void labelsFromColors(const cv::Mat& colorImg, cv::Mat& labels);
+
+	/**
+	 * Enable or disable the temporal coherence mode, for depth videos.
+	 * In this mode, the smoothed depth, the depth histogram and the 
+	 * forest votes of the previous frame are kept. Only the pixels whose 
+	 * depth, or the depth of any pixel they may probe, changed by more 
+	 * than the tolerance are classified again, and the Fisher threshold 
+	 * is computed from a histogram updated with the changed pixels only.
+	 * @param  enable  true to enable the mode.
+	 * @param  tolerance  maximum depth change of an unchanged pixel
+	 *         (in normalised depth units, human depth being in [0,4]).
+	 */
+	void setTemporalCoherence(bool enable, float tolerance = 0.01);
+
+	/**
+	 * Forget the previous frame: the next frame is fully processed.
+	 * To be called when the depth stream is not continuous any more.
+	 */
+	void resetTemporalState(void);
+
+	/**
+	 * Enable or disable the half resolution mode: the depth image is
+	 * decimated by 2 in both directions before segmentation, and the 
+	 * segmented image is enlarged back to the input resolution.
+	 * About 4 times faster.
+	 * @param  enable  true to enable the mode.
+	 */
+	void setHalfResolution(bool enable);
+
+	/**
+	 * Select the forest inference implementation. COMPILED_FOREST 
+	 * (default) uses the flat copy of the forest, and falls back to 
+	 * LEGACY_FOREST (the tree nodes) when the forest has features it 
+	 * does not support. Both give the same results.
+	 * @param  backend  LEGACY_FOREST or COMPILED_FOREST.
+	 */
+	void setForestBackend(int backend);
+
+	/**
+	 * Statistics of the last run() call.
+	 */
+	const Statistics& getStatistics(void) const { return stats; }
+
 	/**
 	 * Extract the data of human in the mask area and also
 	 * Normalise the the human distance data into 4m
@@ -48,7 +168,7 @@ public:
 	 * @param  raw_depth  raw depth value.
 	 * @return  distance in meters.
 	 */
-	float raw_depth_to_meters(int raw_depth);  
+	static float raw_depth_to_meters(int raw_depth);  
 
 	/**
 	 * Converts a distance in meters to a raw depth value
@@ -56,7 +176,7 @@ public:
 	 * @param  depthInMeters  depth in meters.
 	 * @return  raw depth value in [0,2047].
 	 */
-	int meters_to_raw_depth(float depthInMeters);
+	static int meters_to_raw_depth(float depthInMeters);
 
 	/**
 	 * segment the data from the human using random forest 
@@ -67,20 +187,120 @@ public:
 	 */
 	IplImage* SegmentParts( CvMat* seg_depth, CvMat* seg_edge=NULL ); 
 
+	/**
+	 * segment the data from the human using random forest 
+	 * @param seg_depth the segmented depth data
+	 * @param seg_edge the segmented edge data
+	 * @param labels the body part of each pixel (CV_8UC1)
+	 * @param probs if not NULL, the forest votes (CV_32FC(PART_SIZE))
+	 * @param temporal if false, the temporal coherence state is neither used nor updated
+	 */
+	void classifyParts( CvMat* seg_depth, CvMat* seg_edge, cv::Mat& labels, cv::Mat* probs=NULL, bool temporal=true ); 
+
 	/**
 	 * Segment the forground person from the depth image using Fisher's method
 	 * @param mask the person's mask (1 is human and 0 is others)
 	 * @param pro_mat the smooth depth mat
+	 * In temporal coherence mode, the next frame is fully processed.
 	*/
 	void computePersonMask(const cv::Mat& depthImg, CvMat* mask, CvMat* pro_mat);
 
 
+	// forest and legend are shared by the instances using the same
+	// files (see ForestCache), they must not be modified
 	RandomForest* forest; 
 	IplImage *ground; // body parts legend
 	bool depthIsInMillimeters; // input depth image in millimeters
 
 protected:
+	SharedForest* model; // shared forest and legend
+
+	/**
+	 * Segment a depth image at its own resolution.
+	 * The forest offsets are scaled by the ratio between the image 
+	 * resolution and the training resolution (640x480).
+	 * @param depthImg the 16 bits depth image
+	 * @param labels the body part of each pixel
+	 * @param probs if not NULL, the forest votes
+	 */
+	void processDepth(const cv::Mat& depthImg, cv::Mat& labels, cv::Mat* probs);
+
+	/**
+	 * Convert the depth image to raw depth, smooth it into smoothBuf
+	 * (16 times the smoothed raw depth) and compute the person depth
+	 * threshold with Fisher's method, in a single pass.
+	 * @param depthImg the 16 bits depth image
+	 * @param incremental if true, the depth histogram of the previous 
+	 *        frame is updated with the changed pixels only
+	 * return the raw depth threshold
+	 */
+	int smoothDepth(const cv::Mat& depthImg, bool incremental);
+
+	/**
+	 * Convert and filter horizontally one row of the depth image.
+	 * @param depthImg the 16 bits depth image
+	 * @param row the row index
+	 * @param hsum the filtered row
+	 */
+	void filterDepthRow(const cv::Mat& depthImg, int row, int* hsum);
+
+	/**
+	 * Same as ExtractDepthHuman, from smoothBuf and the threshold.
+	 * @param thres the raw depth threshold
+	 * @param dst the data of human area
+	 */
+	void extractHuman(int thres, CvMat* dst);
+
+	/**
+	 * Classify one pixel of the human depth data with the forest.
+	 * @param filtered_depth the human depth data
+	 * @param filtered_edge the edge data (can be NULL)
+	 * @param height the data height
+	 * @param width the data width
+	 * @param m the pixel row
+	 * @param n the pixel column
+	 * @param vote the forest votes (PART_SIZE values)
+	 * return the part index, or -1 if no part got a vote
+	 */
+	int ClassifyPixel( float** filtered_depth, float** filtered_edge, int height, int width, int m, int n, float* vote );
+
+	/**
+	 * (Re)allocate the temporal coherence buffers for the given size.
+	 */
+	void allocateTemporalState(int height, int width);
+	void releaseTemporalState(void);
+
+	/**
+	 * (Re)allocate the processing buffers for the given size.
+	 */
+	void allocateBuffers(int height, int width);
+	void releaseBuffers(void);
+
+	bool halfResolution; // process decimated images
+	int forestBackend; // forest inference implementation
+	Statistics stats; // statistics of the last frame
+	float offsetScaleRow; // forest offsets scale along rows
+	float offsetScaleCol; // forest offsets scale along columns
+	CvMat *smoothBuf; // smoothed raw depth, times 16
+	CvMat *humanBuf; // human depth data
+	int *rowBuf; // smoothing rows
+	cv::Mat labelsBuf; // labels, for the colour output
+	cv::Mat halfDepthBuf; // decimated depth image
+	cv::Mat halfLabelsBuf; // labels at half resolution
+	cv::Mat halfProbsBuf; // votes at half resolution
+	float *rawToMeters; // raw depth to meters table
+	unsigned short *mmToRaw; // millimeters to raw depth table
 
+	// temporal coherence mode
+	bool temporalCoherence;
+	float temporalTolerance;
+	bool hasPrevFrame; // true if the buffers below hold the previous frame
+	CvMat *prevSmoothDepth; // smoothed raw depth (times 16) of the previous frame
+	CvMat *prevHumanDepth; // human depth each pixel was last classified at
+	float *prevVotes; // last computed forest votes of each pixel (PART_SIZE per pixel)
+	int *changedIntegral; // integral image of the changed pixels
+	Histogram<int> *depthHist; // smoothed depth histogram
+	int maxProbeOffset; // largest probe offset of the forest
 };
 
 #endif // BODYPARTSEGMENTATION_H
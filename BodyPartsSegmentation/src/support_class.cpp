@@ -11,7 +11,11 @@ enum { DIFF, SUM, BOTH };               /* feature_type */
 //-----------------------------------------------------
 /* feature class */ 
 
-Feature::Feature() {}
+Feature::Feature()
+{
+	scale_x = 1; 
+	scale_y = 1; 
+}
 
 
 Feature::Feature( int id, CvPoint point, float** matrix, int M, int N, int flag )
@@ -23,6 +27,8 @@ Feature::Feature( int id, CvPoint point, float** matrix, int M, int N, int flag
 	col = N; 
 	label = flag; 
 	value = 0;
+	scale_x = 1; 
+	scale_y = 1; 
 }
 
 
@@ -36,6 +42,13 @@ void Feature::set_offset ( CvPoint u, CvPoint v )
 }
 
 
+void Feature::set_scale ( float sx, float sy )
+{
+	scale_x = sx;
+	scale_y = sy;
+}
+
+
 void Feature::set_type ( int type )
 {
 	feat_type = type; 
@@ -50,15 +63,15 @@ void Feature::computeFeature()
 	float depth = data[center.x][center.y];
 	int nora_x, nora_y; 
 	if ( feat_id!=DEPT ) {
-		nora_x = offset_1.x ; // /(depth+0.01)
-		nora_y = offset_1.y;	
+		nora_x = offset_1.x * scale_x; // /(depth+0.01)
+		nora_y = offset_1.y * scale_y;	
 	} else {
 		if ( depth !=0 )
-		{	nora_x = offset_1.x / depth;
-			nora_y = offset_1.y / depth;
+		{	nora_x = offset_1.x * scale_x / depth;
+			nora_y = offset_1.y * scale_y / depth;
 		} else {
-			nora_x = offset_1.x;
-			nora_y = offset_1.y;
+			nora_x = offset_1.x * scale_x;
+			nora_y = offset_1.y * scale_y;
 		}
 	}
 	int left_x = center.x + nora_x;
@@ -76,15 +89,15 @@ void Feature::computeFeature()
 	//cout << depth << " " <<  offset_1.x << " " << offset_1.y << " " << left_x << " " << left_y << " " << left_depth << " "; 
 
 	if ( feat_id!=DEPT ) {
-		nora_x = offset_2.x;  // /(depth+0.01)
-		nora_y = offset_2.y;	
+		nora_x = offset_2.x * scale_x; // /(depth+0.01)
+		nora_y = offset_2.y * scale_y;	
 	} else {
 		if ( depth !=0 )
-		{	nora_x = offset_2.x / depth;
-			nora_y = offset_2.y / depth;
+		{	nora_x = offset_2.x * scale_x / depth;
+			nora_y = offset_2.y * scale_y / depth;
 		} else {
-			nora_x = offset_2.x;
-			nora_y = offset_2.y;
+			nora_x = offset_2.x * scale_x;
+			nora_y = offset_2.y * scale_y;
 		}
 	}
 	left_x = center.x + nora_x;
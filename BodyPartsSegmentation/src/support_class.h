@@ -18,8 +18,11 @@ class Feature {
 		int label;
 		float value;
 		int feat_type; 
+		float scale_x;		// scale of the offsets along rows
+		float scale_y;		// scale of the offsets along columns
 
 		void set_offset ( CvPoint u, CvPoint v );
+		void set_scale ( float sx, float sy );
 		void set_type ( int type ); 
 		void computeFeature( );
 
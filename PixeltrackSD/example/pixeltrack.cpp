@@ -19,6 +19,9 @@
 
 
 #include <getopt.h>
+#include <string.h>
+#include <thread>
+#include <vector>
 #ifdef PROFILE
 #include <google/profiler.h>
 #endif
@@ -28,10 +31,14 @@
 #include "../src/ImageOutput.h"
 //ELrm #include "utils_cv.h"
 #include "../src/VideoOutput.h"
+#include "../src/OutputXMLFile.h"
+#include "../src/OutputTXTFile.h"
 #include "../src/Timer.h"
 #include "../src/Error.h"
+#include "../src/BoundedQueue.h"
 
 #include "../src/PixelTracker.h"
+#include "../src/LUTCache.h"
 
 using namespace TLImageProc;
 using namespace TLInOut;
@@ -54,6 +61,10 @@ typedef struct params
 	bool output;
 	float detector_update_factor;
 	float segmentation_update_factor;;
+	string lut_cache;
+	int scales;
+	int ring_size;
+	float time_budget;
 } params;
 
 
@@ -69,6 +80,10 @@ void set_default_params(params* p)
 	p->output=false;
 	p->detector_update_factor=0.1;
 	p->segmentation_update_factor=0.1;
+	p->lut_cache="";
+	p->scales=1;
+	p->ring_size=4;
+	p->time_budget=0;
 }
 
 
@@ -80,9 +95,13 @@ void print_usage(params* p)
 	cout << "Usage: pixeltrack <options> <video_file>" << endl;
 	cout << "  options:" << endl;
 	cout << "    -b (--bbox) x,y,w,h   initial bounding box parameters (default: " << p->bbox << ")" << endl;
+	cout << "    -c (--scales) N       adapt the box size, voting at N scales: 1 (fixed size), 3 or 5 (default: " << p->scales << ")" << endl;
+	cout << "    -d (--deadline) MS    lower the tracking quality to process each frame in MS milliseconds (default: " << p->time_budget << ", full quality)" << endl;
 	cout << "    -f (--from) N         start from frame number N (default: " << p->from_frame << ")" << endl;
 	cout << "    -k (--skip_frames) N  skip N frames at each iteration(default: " << p->skip_frames << ")" << endl;
+	cout << "    -l (--lut_cache) DIR  save and reuse the LUTs in directory DIR (default: none)" << endl;
 	cout << "    -o (--output)         output result in a video file (default: " << p->output << ")" << endl;
+	cout << "    -r (--ring) N         frames in the decoding, tracking and output pipeline (default: " << p->ring_size << ")" << endl;
 
 	cout << "    -s (--silent)         no image output  (default: " << p->silent << ")" << endl;
 	cout << "    -t (--to) N           stop at frame number N (default: " << p->to_frame << ")" << endl;
@@ -92,6 +111,46 @@ void print_usage(params* p)
 }
 
 
+// frame of the pipeline ring, with its tracking result
+struct frame_t
+{
+	Image<unsigned char>* image;
+	int number;
+	unsigned long long timestamp;
+	Rectangle bb;
+	int quality_level; // see PixelTracker::setTimeBudget()
+	// maps shown when not silent (allocated with the first one)
+	Image<float>* voting_map;
+	Image<float>* bp_img;
+	Image<float>* segmentation;
+
+	frame_t() : image(NULL), number(0), timestamp(0), quality_level(0), voting_map(NULL), bp_img(NULL), segmentation(NULL) {}
+};
+
+
+// decoded frame copied in a frame of the ring (the decoder reuses its buffer)
+void copyFrame(Image<unsigned char>* src, Image<unsigned char>* dst)
+{
+	int w = min(src->width(), dst->width())*3;
+	int h = min(src->height(), dst->height());
+	for(int i=0; i<h; i++)
+		memcpy(dst->data()+i*dst->widthStep(), src->data()+i*src->widthStep(), w);
+}
+
+
+// map of the tracker copied for the output thread
+void copyMap(Image<float>* map, Image<float>*& copy)
+{
+	if (!copy || copy->width()!=map->width() || copy->height()!=map->height())
+	{
+		delete copy;
+		copy = new Image<float>(map->width(), map->height(), 1);
+	}
+	copy->setOffset(map->offsetX(), map->offsetY());
+	map->copyTo(copy);
+}
+
+
 int main(int argc, char** argv)
 {
 	setlocale(LC_ALL, "C");
@@ -104,9 +163,13 @@ int main(int argc, char** argv)
 	static struct option long_options[] =
 	{
 		{"bbox",          required_argument, 0, 'b'},
+		{"scales",        required_argument, 0, 'c'},
+		{"deadline",      required_argument, 0, 'd'},
 		{"from",          required_argument, 0, 'f'},
 		{"skip_frames",   required_argument, 0, 'k'},
+		{"lut_cache",     required_argument, 0, 'l'},
 		{"output",        no_argument,       0, 'o'},
+		{"ring",          required_argument, 0, 'r'},
 		{"silent",        no_argument,       0, 's'},
 		{"to",            required_argument, 0, 't'},
 		{"det_update",    required_argument, 0, 'u'},
@@ -116,7 +179,7 @@ int main(int argc, char** argv)
 	};
 	do
 	{
-		opt = getopt_long(argc, argv, "b:f:k:ost:u:v:w:", long_options, &option_index);
+		opt = getopt_long(argc, argv, "b:c:d:f:k:l:or:st:u:v:w:", long_options, &option_index);
 		if (opt==-1)
 			break;
 
@@ -125,15 +188,27 @@ int main(int argc, char** argv)
 			case 'b':
 				par.bbox = optarg;
 				break;
+			case 'c':
+				par.scales = atoi(optarg);
+				break;
+			case 'd':
+				par.time_budget = atof(optarg);
+				break;
 			case 'f':
 				par.from_frame = atoi(optarg);
 				break;
 			case 'k':
 				par.skip_frames = atoi(optarg);
 				break;
+			case 'l':
+				par.lut_cache = optarg;
+				break;
 			case 'o':
 				par.output = true;
 				break;
+			case 'r':
+				par.ring_size = atoi(optarg);
+				break;
 			case 's':
 				par.silent = true;
 				break;
@@ -155,6 +230,11 @@ int main(int argc, char** argv)
 		}
 	} while (opt!=-1);
 
+	if (par.ring_size<1)
+	{
+		print_usage(&par);
+		return -1;
+	}
 	if (argc!=optind+1)
 	{
 		cerr << "Please specify video input file." << endl;
@@ -162,6 +242,7 @@ int main(int argc, char** argv)
 		return -1;
 	}
 	par.filename = argv[optind];
+	LUTCache::setDiskCache(par.lut_cache);
 
 	VideoInput* vinput = new VideoInputFile(par.filename);
 	ImageOutput output_window("pixeltrack output");
@@ -210,7 +291,14 @@ int main(int argc, char** argv)
 		voutput = new VideoOutput("out.avi", width, height, vinput->getFPS());
 	}
 
+	// tracking results in output.xml and output.txt (deleted after the tracker)
+	OutputXMLFile xml_output("output.xml");
+	OutputTXTFile txt_output("output.txt");
 	PixelTracker tracker(initial_rect.miFirstColumn, initial_rect.miFirstLine, initial_rect.miWidth, initial_rect.miHeight, par.detector_update_factor, par.segmentation_update_factor, par.search_size);
+	tracker.addOutput(&xml_output);
+	tracker.addOutput(&txt_output);
+	tracker.setScaleSearch(par.scales);
+	tracker.setTimeBudget(par.time_budget);
 	tracker.process( cur_image, current_frame, vinput->getCurrentTimestampMs(), vinput->getCurrentTimestampMs());
 
 	output_window.setCurrentImage(cur_image);
@@ -259,25 +347,78 @@ int main(int argc, char** argv)
 	// 
 	// MAIN TRACKING LOOP
 	// 
-	current_time = avgfps_timer.getRunTime();
-	do
+	// pipeline of three threads: the decoder fills the free frames of the
+	// ring, the tracker processes them in order, and this thread draws,
+	// shows and encodes them before putting them back in the ring
+	vector<frame_t> frames(par.ring_size);
+	BoundedQueue<int> free_frames(par.ring_size);
+	BoundedQueue<int> decoded_frames(par.ring_size);
+	BoundedQueue<int> tracked_frames(par.ring_size);
+	for(int i=0; i<par.ring_size; i++)
 	{
-		current_frame++;
-		MESSAGE(0, "+++++++++++ Frame: " << current_frame << "++++++++++++++++++++++++")
+		frames[i].image = new Image<unsigned char>(width, height, 3);
+		free_frames.push(i);
+	}
 
-		// retrieve next image
-		for(int i=0; i<par.skip_frames; i++)
+	thread decoder([&]() {
+		int f;
+		do
 		{
-			if (!vinput->nextImage())
-				break;
 			current_frame++;
+
+			// retrieve next image
+			for(int i=0; i<par.skip_frames; i++)
+			{
+				if (!vinput->nextImage())
+					break;
+				current_frame++;
+			}
+
+			Image<unsigned char>* image = vinput->nextImage();
+			if (!image || !free_frames.pop(f))
+				break;
+			copyFrame(image, frames[f].image);
+			frames[f].number = current_frame;
+			frames[f].timestamp = vinput->getCurrentTimestampMs();
+			decoded_frames.push(f);
+		} while (vinput->nextImageAvailable() && current_frame<=par.to_frame);
+		decoded_frames.close();
+	});
+
+	thread tracking([&]() {
+		int f;
+		while (decoded_frames.pop(f))
+		{
+			frame_t& frame = frames[f];
+			tracker.process( frame.image, frame.number, frame.timestamp, frame.timestamp);
+			frame.bb = *tracker.getCurBb();
+			frame.quality_level = tracker.getQualityLevel();
+			// the maps are copied, the tracker goes on with the next frames
+			if (!par.silent)
+			{
+				copyMap(tracker.getVotingMapNormalised(), frame.voting_map);
+				copyMap(tracker.getBpImgNormalised(), frame.bp_img);
+				copyMap(tracker.getSegmentation(), frame.segmentation);
+			}
+			tracked_frames.push(f);
 		}
+		tracked_frames.close();
+	});
 
-		cur_image = vinput->nextImage();
-		if (!cur_image)
-			break;
+	current_time = avgfps_timer.getRunTime();
+	int f;
+	int output_frames = 0;
+	while (tracked_frames.pop(f))
+	{
+		frame_t& frame = frames[f];
+		cur_image = frame.image;
 
-		tracker.process( cur_image, current_frame, vinput->getCurrentTimestampMs(), vinput->getCurrentTimestampMs());
+		// printed here, in the order of the frames and of the other messages
+		MESSAGE(0, "+++++++++++ Frame: " << frame.number << "++++++++++++++++++++++++")
+		if (par.time_budget>0)
+		{
+			MESSAGE(0, "Quality level: " << frame.quality_level)
+		}
 
 		// display result
 		output_window.setCurrentImage(cur_image);
@@ -292,8 +433,7 @@ int main(int argc, char** argv)
 			   output_window.draw(cur_bb.centerX(), cur_bb.centerY(), Colour(0,255,0), 3);
 			   */
 			// draw just a red cross with centre position
-			Rectangle *cur_bb = tracker.getCurBb();
-			output_window.draw(cur_bb->centerX(), cur_bb->centerY(), Colour(255,0,0), 3);
+			output_window.draw(frame.bb.centerX(), frame.bb.centerY(), Colour(255,0,0), 3);
 		}
 
 		// output video
@@ -312,27 +452,42 @@ int main(int argc, char** argv)
 			//ELrm bp_window.showFloatImage(bp_img_normalised, 2);
 			//ELrm segmentation->binarise(0.5);
 			//ELrm seg_window.showFloatImage(segmentation, 2);
-			voting_window.showFloatImage(tracker.getVotingMapNormalised(), 2);
-			bp_window.showFloatImage(tracker.getBpImgNormalised(), 2);
-			tracker.getSegmentation()->binarise(0.5);
-			seg_window.showFloatImage(tracker.getSegmentation(), 2);
+			voting_window.showFloatImage(frame.voting_map, 2);
+			bp_window.showFloatImage(frame.bp_img, 2);
+			frame.segmentation->binarise(0.5);
+			seg_window.showFloatImage(frame.segmentation, 2);
 
 			output_window.wait(0);
 		}
+		free_frames.push(f);
 
 
 		// calculate average processing time
 		prev_time = current_time;
 		current_time = avgfps_timer.getRunTime();
+		output_frames++;
 
-		if (current_frame<=3)
+		if (output_frames<=3)
 			avgfps = 1000000.0/avgfps_timer.computeDelta(current_time, prev_time);
 		else
 			avgfps = 0.99*avgfps + 0.01* 1000000.0/avgfps_timer.computeDelta(current_time, prev_time);
 
 		MESSAGE(0, "Average processing speed: " << avgfps << " fps");
+	}
+	// the decoder may be waiting for a free frame
+	free_frames.close();
+	decoder.join();
+	tracking.join();
 
-	} while (vinput->nextImageAvailable() && current_frame<=par.to_frame);
+	for(int i=0; i<par.ring_size; i++)
+	{
+		delete frames[i].image;
+		delete frames[i].voting_map;
+		delete frames[i].bp_img;
+		delete frames[i].segmentation;
+	}
+	delete voutput;
+	delete vinput;
 
 #ifdef PROFILE
 	ProfilerStop();
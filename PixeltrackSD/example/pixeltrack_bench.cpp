@@ -0,0 +1,360 @@
+/*
+   Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   */
+
+/*
+ * PixelTracker benchmark.
+ *
+ * Tracks an object moving on synthetic frames with each tracker
+ * configuration and reports as JSON the time of the first frame
+ * (initialisation), of the following frames and of their voting stage
+ * (PixelTracker::STAGE_LOCATE). Tracking results of the configurations
+ * are compared.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../src/Image.h"
+#include "../src/Rectangle.h"
+#include "../src/Timer.h"
+
+#include "../src/PixelTracker.h"
+#include "../src/LUTCache.h"
+
+using namespace std;
+using namespace TLImageProc;
+using namespace TLUtil;
+
+typedef struct params
+{
+	int frames;
+	int width;
+	int height;
+	float object_size;
+	string colour;
+	string gradient;
+	string maps;
+	int voting_threads;
+	string output_file;
+	string lut_cache;
+} params;
+
+
+void set_default_params(params* p)
+{
+	p->frames = 100;
+	p->width = 640;
+	p->height = 480;
+	p->object_size = 0.2;
+	p->colour = "both";
+	p->gradient = "full";
+	p->maps = "full";
+	p->voting_threads = 1;
+	p->output_file = "";
+	p->lut_cache = "";
+}
+
+
+void print_usage(params* p)
+{
+	cout << "Usage: pixeltrack_bench <options>" << endl;
+	cout << "  options:" << endl;
+	cout << "    -n (--frames) N       tracked frames (default: " << p->frames << ")" << endl;
+	cout << "    -W (--width) N        frames width (default: " << p->width << ")" << endl;
+	cout << "    -H (--height) N       frames height (default: " << p->height << ")" << endl;
+	cout << "    -s (--size) F         object size relative to the frame height (default: " << p->object_size << ")" << endl;
+	cout << "    -c (--colour) NAME    colour binning: full, compact or both (default: " << p->colour << ")" << endl;
+	cout << "    -g (--gradient) NAME  gradient binning: full, compact or both (default: " << p->gradient << ")" << endl;
+	cout << "    -m (--maps) NAME      map buffers: full, window or both (default: " << p->maps << ")" << endl;
+	cout << "    -j (--vote_threads) N also run each configuration with N voting threads (default: " << p->voting_threads << ", none)" << endl;
+	cout << "    -l (--lut_cache) DIR  save and reuse the LUTs in directory DIR (default: none)" << endl;
+	cout << "    -o (--output) FILE    JSON output file (default: standard output)" << endl;
+}
+
+
+// synthetic frame: textured object moving on a textured background
+void make_frame(int index, const params& par, Image<unsigned char>* img)
+{
+	int w = par.width;
+	int h = par.height;
+	float cx = w*0.5 + w*0.25*sin(index*0.07);
+	float cy = h*0.5 + h*0.2*cos(index*0.05);
+	float rx = h*par.object_size*0.4;
+	float ry = h*par.object_size*0.6;
+	for (int y=0; y<h; y++)
+	{
+		for (int x=0; x<w; x++)
+		{
+			unsigned char* p = img->data() + y*img->widthStep() + x*3;
+			float dx = (x-cx)/rx;
+			float dy = (y-cy)/ry;
+			if (dx*dx+dy*dy < 1)
+			{
+				p[0] = (unsigned char)(30 + 20*((x/3)&1));
+				p[1] = (unsigned char)(50 + 60*(dy>0));
+				p[2] = (unsigned char)(200 + 40*sin(x*0.3+y*0.2));
+			}
+			else
+			{
+				int t = ((x/8 + y/8) & 1) ? 40 : 0;
+				p[0] = (unsigned char)(60 + t + 30*sin(x*0.11+y*0.03));
+				p[1] = (unsigned char)(120 + t/2 + 40*cos(y*0.09));
+				p[2] = (unsigned char)(70 + 20*sin((x+y)*0.05));
+			}
+		}
+	}
+}
+
+
+struct config
+{
+	string name;
+	int colour_binning;
+	int gradient_binning;
+	bool windowed_maps;
+	int voting_threads;
+};
+
+
+struct result
+{
+	string name;
+	double first_frame_ms;
+	double frame_ms;
+	double locate_ms; // voting, segmentation and backprojection
+	vector<Rectangle> boxes;
+};
+
+
+void run_config(const config& cfg, const params& par, result& res)
+{
+	Image<unsigned char> img(par.width, par.height, 3);
+	int bw = int(par.height*par.object_size*0.8);
+	int bh = int(par.height*par.object_size*1.2);
+	int bx = int(par.width*0.5 - bw/2);
+	int by = int(par.height*0.7 - bh/2);
+
+	res.name = cfg.name;
+	res.boxes.clear();
+	Timer timer;
+
+	make_frame(0, par, &img);
+	timer.reset();
+	PixelTracker tracker(bx, by, bw, bh, 0.1, 0.1, 2);
+	tracker.setColourBinning(cfg.colour_binning);
+	tracker.setGradientBinning(cfg.gradient_binning);
+	tracker.setWindowedMaps(cfg.windowed_maps);
+	tracker.setVotingThreads(cfg.voting_threads);
+	tracker.process(&img, 0);
+	res.first_frame_ms = timer.stop()/1000.0;
+	res.boxes.push_back(*tracker.getCurBb());
+
+	long long total = 0;
+	double locate = 0;
+	for (int i=1; i<=par.frames; i++)
+	{
+		make_frame(i, par, &img);
+		timer.reset();
+		tracker.process(&img, i);
+		total += timer.stop();
+		locate += tracker.getStageTime(PixelTracker::STAGE_LOCATE);
+		res.boxes.push_back(*tracker.getCurBb());
+	}
+	res.frame_ms = total/1000.0/par.frames;
+	res.locate_ms = locate/par.frames;
+}
+
+
+bool same_boxes(const result& a, const result& b)
+{
+	if (a.boxes.size() != b.boxes.size())
+		return false;
+	for (unsigned int i=0; i<a.boxes.size(); i++)
+	{
+		const Rectangle& r1 = a.boxes[i];
+		const Rectangle& r2 = b.boxes[i];
+		if (r1.miFirstColumn!=r2.miFirstColumn || r1.miFirstLine!=r2.miFirstLine || r1.miWidth!=r2.miWidth || r1.miHeight!=r2.miHeight)
+			return false;
+	}
+	return true;
+}
+
+
+void write_json(ostream& out, const params& par, const vector<result>& results)
+{
+	bool same = true;
+	for (unsigned int i=1; i<results.size(); i++)
+		same = same && same_boxes(results[0], results[i]);
+
+	out << "{" << endl;
+	out << "  \"width\": " << par.width << "," << endl;
+	out << "  \"height\": " << par.height << "," << endl;
+	out << "  \"frames\": " << par.frames << "," << endl;
+	out << "  \"same_results\": " << (same ? "true" : "false") << "," << endl;
+	out << "  \"configurations\": [" << endl;
+	for (unsigned int i=0; i<results.size(); i++)
+	{
+		const result& r = results[i];
+		out << "    {" << endl;
+		out << "      \"name\": \"" << r.name << "\"," << endl;
+		out << "      \"first_frame_ms\": " << r.first_frame_ms << "," << endl;
+		out << "      \"frame_ms\": " << r.frame_ms << "," << endl;
+		out << "      \"locate_ms\": " << r.locate_ms << "," << endl;
+		out << "      \"frames_per_second\": " << (r.frame_ms > 0 ? 1000.0/r.frame_ms : 0) << endl;
+		out << "    }" << (i+1 < results.size() ? "," : "") << endl;
+	}
+	out << "  ]" << endl;
+	out << "}" << endl;
+}
+
+
+int main(int argc, char** argv)
+{
+	setlocale(LC_ALL, "C");
+	params par;
+	set_default_params(&par);
+
+	int option_index=0;
+	int opt;
+	opterr=0;
+	static struct option long_options[] =
+	{
+		{"colour",        required_argument, 0, 'c'},
+		{"gradient",      required_argument, 0, 'g'},
+		{"height",        required_argument, 0, 'H'},
+		{"vote_threads",  required_argument, 0, 'j'},
+		{"lut_cache",     required_argument, 0, 'l'},
+		{"maps",          required_argument, 0, 'm'},
+		{"frames",        required_argument, 0, 'n'},
+		{"output",        required_argument, 0, 'o'},
+		{"size",          required_argument, 0, 's'},
+		{"width",         required_argument, 0, 'W'},
+		{0, 0, 0, 0}
+	};
+	do
+	{
+		opt = getopt_long(argc, argv, "c:g:H:j:l:m:n:o:s:W:", long_options, &option_index);
+		if (opt==-1)
+			break;
+
+		switch (opt)
+		{
+			case 'c':
+				par.colour = optarg;
+				break;
+			case 'g':
+				par.gradient = optarg;
+				break;
+			case 'H':
+				par.height = atoi(optarg);
+				break;
+			case 'j':
+				par.voting_threads = atoi(optarg);
+				break;
+			case 'l':
+				par.lut_cache = optarg;
+				break;
+			case 'm':
+				par.maps = optarg;
+				break;
+			case 'n':
+				par.frames = atoi(optarg);
+				break;
+			case 'o':
+				par.output_file = optarg;
+				break;
+			case 's':
+				par.object_size = atof(optarg);
+				break;
+			case 'W':
+				par.width = atoi(optarg);
+				break;
+			default:
+				print_usage(&par);
+				return -1;
+		}
+	} while (opt!=-1);
+
+	bool colour_ok = par.colour=="full" || par.colour=="compact" || par.colour=="both";
+	bool gradient_ok = par.gradient=="full" || par.gradient=="compact" || par.gradient=="both";
+	bool maps_ok = par.maps=="full" || par.maps=="window" || par.maps=="both";
+	if (argc!=optind || !colour_ok || !gradient_ok || !maps_ok || par.frames<1 || par.width<32 || par.height<32 || par.object_size<=0 || par.object_size>0.8)
+	{
+		print_usage(&par);
+		return -1;
+	}
+
+	LUTCache::setDiskCache(par.lut_cache);
+
+	// all the combinations of the selected binnings and map buffers,
+	// with serial and parallel voting
+	const char* names[2] = { "full", "compact" };
+	int modes[2] = { PixelTracker::FULL_LUT, PixelTracker::COMPACT_LUT };
+	const char* map_names[2] = { "full", "window" };
+	vector<config> configs;
+	for (int c=0; c<2; c++)
+	{
+		if (par.colour != "both" && par.colour != names[c])
+			continue;
+		for (int g=0; g<2; g++)
+		{
+			if (par.gradient != "both" && par.gradient != names[g])
+				continue;
+			for (int m=0; m<2; m++)
+			{
+				if (par.maps != "both" && par.maps != map_names[m])
+					continue;
+				config cfg;
+				cfg.name = string("colour:") + names[c] + " gradient:" + names[g] + " maps:" + map_names[m];
+				cfg.colour_binning = modes[c];
+				cfg.gradient_binning = modes[g];
+				cfg.windowed_maps = m==1;
+				cfg.voting_threads = 1;
+				configs.push_back(cfg);
+				if (par.voting_threads != 1)
+				{
+					cfg.name += " vote_threads:" + to_string(par.voting_threads);
+					cfg.voting_threads = par.voting_threads;
+					configs.push_back(cfg);
+				}
+			}
+		}
+	}
+
+	vector<result> results(configs.size());
+	for (unsigned int i=0; i<configs.size(); i++)
+		run_config(configs[i], par, results[i]);
+
+	if (par.output_file.empty())
+		write_json(cout, par, results);
+	else
+	{
+		ofstream out(par.output_file.c_str());
+		if (!out.is_open())
+		{
+			cerr << "Failed to open output file " << par.output_file << "." << endl;
+			return EXIT_FAILURE;
+		}
+		write_json(out, par, results);
+	}
+
+	return EXIT_SUCCESS;
+}
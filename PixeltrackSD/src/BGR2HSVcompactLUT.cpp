@@ -0,0 +1,74 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Error.h"
+#include "BGR2HSVcompactLUT.h"
+
+namespace TLImageProc
+{
+
+BGR2HSVcompactLUT::BGR2HSVcompactLUT(int _h_bins,
+				     int _s_bins,
+				     int _v_bins,
+				     float s_threshold,
+				     float v_threshold){
+  ASSERT(_s_bins <= ACHROMATIC && _v_bins <= ACHROMATIC, "BGR2HSVcompactLUT: at most 128 saturation and value bins");
+  h_bins = _h_bins;
+  s_bins = _s_bins;
+  v_bins = _v_bins;
+  h_step = 360./h_bins;
+
+  compute_luts(s_threshold,
+	       v_threshold);
+}
+
+// Compute the tables, with the same operations as RGBtoHSV()
+// and BGR2HSVhistLUT::compute_luts()
+void BGR2HSVcompactLUT::compute_luts(float s_threshold,
+				     float v_threshold){
+
+  double s_step = 1./s_bins;
+  double v_step = 1./v_bins;
+  double norm = 1.0/255;
+
+  for(int c=0;c<256;c++)
+    channel[c] = c*norm;
+
+  for(int vmax=0;vmax<256;vmax++){
+    for(int vmin=0;vmin<256;vmin++){
+      if (vmin > vmax){
+	max_min_to_bin[(vmax<<8) + vmin] = 0;
+	continue;
+      }
+      double v = channel[vmax];
+      double diff = v - channel[vmin];
+      double s = diff/(float)(fabs(v) + FLT_EPSILON);
+
+      int s_index = floor(s/s_step);
+      if(s_index == s_bins) s_index = s_bins-1;
+      int v_index = floor(v/v_step);
+      if(v_index == v_bins) v_index = v_bins-1;
+
+      if (s<s_threshold || v<v_threshold)
+	max_min_to_bin[(vmax<<8) + vmin] = ACHROMATIC + v_index;
+      else
+	max_min_to_bin[(vmax<<8) + vmin] = s_index;
+    }
+  }
+}
+
+}
@@ -0,0 +1,91 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TL_BGR2HSV_COMPACT
+#define TL_BGR2HSV_COMPACT
+
+#include <math.h>
+#include <float.h>
+
+namespace TLImageProc
+{
+
+/*
+ * Compact BGR to HSV bin conversion, giving the same bins as the
+ * 16M entries tables of BGR2HSVhistLUT and BGR2HSVdistLUT (same
+ * floating point operations) with a 66 KB memory footprint.
+ * The value bin, the saturation bin and the achromatic test only
+ * depend on the largest and smallest channels, they are read from a
+ * 64K entries table. The hue bin is computed for chromatic pixels.
+ */
+class BGR2HSVcompactLUT {
+  public:
+    // channel value in [0,1]
+    double channel[256];
+    // indexed by (max channel<<8)+min channel: the saturation bin, or
+    // ACHROMATIC + the value bin if the pixel is achromatic
+    unsigned char max_min_to_bin[256*256];
+
+    enum { ACHROMATIC = 0x80 };
+
+    int h_bins;
+    int s_bins;
+    int v_bins;
+    double h_step;
+
+    BGR2HSVcompactLUT(int h_bins,
+                      int s_bins,
+                      int v_bins,
+                      float s_threshold=0.1,
+                      float v_threshold=0.2);
+
+    void compute_luts(float s_threshold,
+                      float v_threshold);
+
+    inline int hsv_bin(int r, int g, int b){
+      // same channel order as the full LUTs
+      int x = b, y = g, z = r;
+      int vmax = x, vmin = x;
+      if (vmax < y) vmax = y;
+      if (vmax < z) vmax = z;
+      if (vmin > y) vmin = y;
+      if (vmin > z) vmin = z;
+
+      int sv = max_min_to_bin[(vmax<<8) + vmin];
+      if (sv & ACHROMATIC)
+        return h_bins*s_bins + (sv & ~ACHROMATIC);
+
+      double v = channel[vmax];
+      double diff = (float)(60./(v - channel[vmin] + FLT_EPSILON));
+      double h;
+      if (vmax == x)
+        h = (channel[y] - channel[z])*diff;
+      else if (vmax == y)
+        h = (channel[z] - channel[x])*diff + 120.f;
+      else
+        h = (channel[x] - channel[y])*diff + 240.f;
+      if (h < 0) h += 360.f;
+
+      int h_index = floor(h/h_step);
+      if (h_index == h_bins) h_index = h_bins-1;
+      return h_index*s_bins + sv;
+    }
+};
+
+}
+
+#endif
@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <math.h>
 #include <float.h>
+#include "Parallel.h"
 #include "BGR2HSVdistLUT.h"
 
 
@@ -24,18 +25,56 @@ BGR2HSVdistLUT::BGR2HSVdistLUT(int _h_bins,
 			       int _s_bins,
 			       int _v_bins,
 			       float s_threshold,
-			       float v_threshold){
+			       float v_threshold,
+			       bool compact_lut){
   h_bins = _h_bins;
   s_bins = _s_bins;
   v_bins = _v_bins;
 
-  bgr_to_dist = new unsigned short int[256*256*256];
+  if (compact_lut)
+  {
+    // 66 KB of tables instead of 32 MB, same bins
+    bgr_to_dist = NULL;
+    computed_lut = NULL;
+    compact = new TLImageProc::BGR2HSVcompactLUT(h_bins, s_bins, v_bins, s_threshold, v_threshold);
+    return;
+  }
+  compact = NULL;
+  computed_lut = new unsigned short int[256*256*256];
+  bgr_to_dist = computed_lut;
   compute_luts(s_threshold,
 	       v_threshold);
 }
 
+BGR2HSVdistLUT::BGR2HSVdistLUT(int _h_bins,
+			       int _s_bins,
+			       int _v_bins,
+			       const unsigned short int* lut_data){
+  h_bins = _h_bins;
+  s_bins = _s_bins;
+  v_bins = _v_bins;
+  computed_lut = NULL;
+  compact = NULL;
+  bgr_to_dist = lut_data;
+}
+
 BGR2HSVdistLUT::~BGR2HSVdistLUT(){
-  delete[] bgr_to_dist;
+  delete[] computed_lut;
+  delete compact;
+}
+
+void BGR2HSVdistLUT::hsv_bins(const unsigned char* bgr, int n, int step, unsigned short* bins){
+  int pixelstep = 3*step;
+  if (bgr_to_dist)
+  {
+    for(int k=0; k<n; k++, bgr+=pixelstep)
+      bins[k] = bgr_to_dist[(((bgr[0]<<8) + bgr[1])<<8) + bgr[2]];
+  }
+  else
+  {
+    for(int k=0; k<n; k++, bgr+=pixelstep)
+      bins[k] = compact->hsv_bin(bgr[2], bgr[1], bgr[0]);
+  }
 }
 
 // r,g,b values are from 0 to 1
@@ -66,41 +105,44 @@ void RGBtoHSV( const double r, const double g, const double b,
 
 // Compute LUTs for histogram computation
 // directly from the RGB pixel values
+// (blue ranges are computed in parallel threads)
 void BGR2HSVdistLUT::compute_luts(float s_threshold,
 				  float v_threshold){
 
-  double h, s, v;
-
-  double h_step = 360./h_bins;
-  double s_step = 1./s_bins;
-  double v_step = 1./v_bins;
-  double norm = 1.0/255;
-  int indtmp1, indtmp2, ind;
-
-  // changed to order BGR 
-  for(int b=0;b<256;b++){
-    indtmp1 = b*256;
-    for(int g=0;g<256;g++){
-      indtmp2 = (indtmp1 + g)*256;
-      for(int r=0;r<256;r++){
-	RGBtoHSV(b*norm, g*norm, r*norm, h, s, v);
-
-	ind = indtmp2 + r;
-
-	int h_index = floor(h/h_step);
-	if(h_index == h_bins) h_index = h_bins-1;
-	int s_index = floor(s/s_step);
-	if(s_index == s_bins) s_index = s_bins-1;
-	int v_index = floor(v/v_step);
-	if(v_index == v_bins) v_index = v_bins-1;
-
-	if (s<s_threshold || v<v_threshold)
-	  bgr_to_dist[ind] = h_bins*s_bins + v_index;
-	else
-	  bgr_to_dist[ind] = h_index*s_bins + s_index;
+  TLUtil::parallelFor(0, 256, [=](int first_b, int last_b){
+    double h, s, v;
+
+    double h_step = 360./h_bins;
+    double s_step = 1./s_bins;
+    double v_step = 1./v_bins;
+    double norm = 1.0/255;
+    int indtmp1, indtmp2, ind;
+
+    // changed to order BGR 
+    for(int b=first_b;b<last_b;b++){
+      indtmp1 = b*256;
+      for(int g=0;g<256;g++){
+	indtmp2 = (indtmp1 + g)*256;
+	for(int r=0;r<256;r++){
+	  RGBtoHSV(b*norm, g*norm, r*norm, h, s, v);
+
+	  ind = indtmp2 + r;
+
+	  int h_index = floor(h/h_step);
+	  if(h_index == h_bins) h_index = h_bins-1;
+	  int s_index = floor(s/s_step);
+	  if(s_index == s_bins) s_index = s_bins-1;
+	  int v_index = floor(v/v_step);
+	  if(v_index == v_bins) v_index = v_bins-1;
+
+	  if (s<s_threshold || v<v_threshold)
+	    computed_lut[ind] = h_bins*s_bins + v_index;
+	  else
+	    computed_lut[ind] = h_index*s_bins + s_index;
+	}
       }
     }
-  }
+  });
 }
 
 
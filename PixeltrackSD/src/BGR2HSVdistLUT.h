@@ -18,13 +18,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef TL_BGR2HSV_DIST_HISTOGRAM 
 #define TL_BGR2HSV_DIST_HISTOGRAM
 
+#include "BGR2HSVcompactLUT.h"
+
 void RGBtoHSV( const double r, const double g, const double b, double& h, double& s, double& v); 
 
 class BGR2HSVdistLUT {
   //private: 
   public:
     // LUT
-    unsigned short int* bgr_to_dist;
+    const unsigned short int* bgr_to_dist; // NULL in compact mode
+    TLImageProc::BGR2HSVcompactLUT* compact;
+    unsigned short int* computed_lut; // bgr_to_dist if computed here, NULL if external
 
   public:
     int h_bins;
@@ -35,15 +39,31 @@ class BGR2HSVdistLUT {
                    int s_bins, 
                    int v_bins,
                    float s_threshold=0.1,
-                   float v_threshold=0.2);
+                   float v_threshold=0.2,
+                   bool compact_lut=false);
+
+    // use a precomputed table (not copied, not freed, only read)
+    BGR2HSVdistLUT(int h_bins,
+                   int s_bins,
+                   int v_bins,
+                   const unsigned short int* lut_data);
 
     ~BGR2HSVdistLUT();
 
     void compute_luts(float h_threshold,
                       float v_threshold);
+    // bin of one pixel, the loops over pixels use hsv_bins()
     inline int hsv_bin(int r, int g, int b){
-	  return bgr_to_dist[(((b<<8) + g)<<8) + r];
+	  if (bgr_to_dist)
+	    return bgr_to_dist[(((b<<8) + g)<<8) + r];
+	  return compact->hsv_bin(r, g, b);
     }
+
+    /*
+     * Bins of n pixels of a BGR line, step pixels apart. The LUT (full
+     * or compact) is chosen once for the line.
+     */
+    void hsv_bins(const unsigned char* bgr, int n, int step, unsigned short* bins);
 };
 
 
@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <math.h>
 #include <float.h>
+#include "Parallel.h"
 #include "BGR2HSVhistLUT.h"
 
 namespace TLImageProc
@@ -26,19 +27,57 @@ BGR2HSVhistLUT::BGR2HSVhistLUT(int _h_bins,
 			       int _s_bins,
 			       int _v_bins,
 			       float s_threshold,
-			       float v_threshold){
+			       float v_threshold,
+			       bool compact_lut){
   h_bins = _h_bins;
   s_bins = _s_bins;
   v_bins = _v_bins;
 
-  bgr_to_hsv_bin = new unsigned short int[256*256*256];
+  if (compact_lut)
+  {
+    // 66 KB of tables instead of 32 MB, same bins
+    bgr_to_hsv_bin = NULL;
+    computed_lut = NULL;
+    compact = new BGR2HSVcompactLUT(h_bins, s_bins, v_bins, s_threshold, v_threshold);
+    return;
+  }
+  compact = NULL;
+  computed_lut = new unsigned short int[256*256*256];
+  bgr_to_hsv_bin = computed_lut;
   //bgr_to_v_bin  = new unsigned short int[256*256*256];
   compute_luts(s_threshold,
 	       v_threshold);
 }
 
+BGR2HSVhistLUT::BGR2HSVhistLUT(int _h_bins,
+			       int _s_bins,
+			       int _v_bins,
+			       const unsigned short int* lut_data){
+  h_bins = _h_bins;
+  s_bins = _s_bins;
+  v_bins = _v_bins;
+  computed_lut = NULL;
+  compact = NULL;
+  bgr_to_hsv_bin = lut_data;
+}
+
 BGR2HSVhistLUT::~BGR2HSVhistLUT(){
-  delete[] bgr_to_hsv_bin;
+  delete[] computed_lut;
+  delete compact;
+}
+
+void BGR2HSVhistLUT::hsv_bins(const unsigned char* bgr, int n, int step, unsigned short* bins){
+  int pixelstep = 3*step;
+  if (bgr_to_hsv_bin)
+  {
+    for(int k=0; k<n; k++, bgr+=pixelstep)
+      bins[k] = bgr_to_hsv_bin[(((bgr[0]<<8) + bgr[1])<<8) + bgr[2]];
+  }
+  else
+  {
+    for(int k=0; k<n; k++, bgr+=pixelstep)
+      bins[k] = compact->hsv_bin(bgr[2], bgr[1], bgr[0]);
+  }
 }
 
 // r,g,b values are from 0 to 1
@@ -69,44 +108,44 @@ void RGBtoHSV( const double r, const double g, const double b,
 
 // Compute LUTs for histogram computation
 // directly from the RGB pixel values
+// (blue ranges are computed in parallel threads)
 void BGR2HSVhistLUT::compute_luts(float s_threshold,
 				  float v_threshold){
 
-  double h, s, v;
-
-  double h_step = 360./h_bins;
-  double s_step = 1./s_bins;
-  double v_step = 1./v_bins;
-  double norm = 1.0/255;
-  int indtmp1, indtmp2, ind;
-
-  // changed to order BGR 
-  for(int b=0;b<256;b++){
-    indtmp1 = b*256;
-    for(int g=0;g<256;g++){
-      indtmp2 = (indtmp1 + g)*256;
-      for(int r=0;r<256;r++){
-	RGBtoHSV(b*norm, g*norm, r*norm, h, s, v);
-
-	ind = indtmp2 + r;
-
-	int h_index = floor(h/h_step);
-	if(h_index == h_bins) h_index = h_bins-1;
-	int s_index = floor(s/s_step);
-	if(s_index == s_bins) s_index = s_bins-1;
-	//bgr_to_hs_bin[ind] = h_index*s_bins + s_index;
-	int v_index = floor(v/v_step);
-	if(v_index == v_bins) v_index = v_bins-1;
-	//bgr_to_v_bin[ind]  = v_index;
-
-	if (s<s_threshold || v<v_threshold)
-	  bgr_to_hsv_bin[ind] = h_bins*s_bins + v_index;
-	else
-	  bgr_to_hsv_bin[ind] = h_index*s_bins + s_index;
-
+  TLUtil::parallelFor(0, 256, [=](int first_b, int last_b){
+    double h, s, v;
+
+    double h_step = 360./h_bins;
+    double s_step = 1./s_bins;
+    double v_step = 1./v_bins;
+    double norm = 1.0/255;
+    int indtmp1, indtmp2, ind;
+
+    // changed to order BGR 
+    for(int b=first_b;b<last_b;b++){
+      indtmp1 = b*256;
+      for(int g=0;g<256;g++){
+	indtmp2 = (indtmp1 + g)*256;
+	for(int r=0;r<256;r++){
+	  RGBtoHSV(b*norm, g*norm, r*norm, h, s, v);
+
+	  ind = indtmp2 + r;
+
+	  int h_index = floor(h/h_step);
+	  if(h_index == h_bins) h_index = h_bins-1;
+	  int s_index = floor(s/s_step);
+	  if(s_index == s_bins) s_index = s_bins-1;
+	  int v_index = floor(v/v_step);
+	  if(v_index == v_bins) v_index = v_bins-1;
+
+	  if (s<s_threshold || v<v_threshold)
+	    computed_lut[ind] = h_bins*s_bins + v_index;
+	  else
+	    computed_lut[ind] = h_index*s_bins + s_index;
+	}
       }
     }
-  }
+  });
 }
 
 }
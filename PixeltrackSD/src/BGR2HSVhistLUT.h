@@ -18,6 +18,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef TL_BGR2HSV_HISTOGRAM 
 #define TL_BGR2HSV_HISTOGRAM
 
+#include "BGR2HSVcompactLUT.h"
+
 namespace TLImageProc
 {
 
@@ -25,7 +27,9 @@ class BGR2HSVhistLUT {
   //private: 
   public:
     // LUTs
-    unsigned short int* bgr_to_hsv_bin;
+    const unsigned short int* bgr_to_hsv_bin; // NULL in compact mode
+    BGR2HSVcompactLUT* compact;
+    unsigned short int* computed_lut; // bgr_to_hsv_bin if computed here, NULL if external
 
   public:
     int h_bins;
@@ -36,15 +40,31 @@ class BGR2HSVhistLUT {
                    int s_bins, 
                    int v_bins,
                    float s_threshold=0.1,
-                   float v_threshold=0.2);
+                   float v_threshold=0.2,
+                   bool compact_lut=false);
+
+    // use a precomputed table (not copied, not freed, only read)
+    BGR2HSVhistLUT(int h_bins,
+                   int s_bins,
+                   int v_bins,
+                   const unsigned short int* lut_data);
 
     ~BGR2HSVhistLUT();
 
     void compute_luts(float h_threshold,
                       float v_threshold);
+    // bin of one pixel, the loops over pixels use hsv_bins()
     inline int hsv_bin(int r, int g, int b){
-	  return bgr_to_hsv_bin[(((b<<8) + g)<<8) + r];
+	  if (bgr_to_hsv_bin)
+	    return bgr_to_hsv_bin[(((b<<8) + g)<<8) + r];
+	  return compact->hsv_bin(r, g, b);
     }
+
+    /*
+     * Bins of n pixels of a BGR line, step pixels apart. The LUT (full
+     * or compact) is chosen once for the line.
+     */
+    void hsv_bins(const unsigned char* bgr, int n, int step, unsigned short* bins);
     /*
     inline int v_bin(int r, int g, int b){
       return bgr_to_v_bin[(((r<<8) + g)<<8) + b];
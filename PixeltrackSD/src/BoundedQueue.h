@@ -0,0 +1,96 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TL_BOUNDEDQUEUE_H
+#define TL_BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace TLUtil
+{
+
+/*
+ * First in first out queue of at most capacity items, between threads.
+ * push() waits while the queue is full, so that a producer cannot get
+ * ahead of its consumer by more than capacity items, and pop() waits
+ * while it is empty. The items are kept in a ring allocated once.
+ */
+template <class T> class BoundedQueue
+{
+  public:
+    BoundedQueue(int capacity) : items(capacity > 0 ? capacity : 1), first(0), count(0), closed(false) {}
+
+    /*
+     * Add item at the end of the queue, waiting for a free place.
+     * @return  false if the queue is closed (item not added).
+     */
+    bool push(const T& item)
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      not_full.wait(lock, [this]{ return closed || count < (int)items.size(); });
+      if (closed)
+        return false;
+      items[(first+count) % items.size()] = item;
+      count++;
+      not_empty.notify_one();
+      return true;
+    }
+
+    /*
+     * Remove the first item of the queue, waiting for one.
+     * @return  false if the queue is closed and empty.
+     */
+    bool pop(T& item)
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      not_empty.wait(lock, [this]{ return closed || count > 0; });
+      if (count == 0)
+        return false;
+      item = items[first];
+      first = (first+1) % items.size();
+      count--;
+      not_full.notify_one();
+      return true;
+    }
+
+    /*
+     * No more items: pop() returns the remaining items, then false,
+     * and push() returns false.
+     */
+    void close()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+      not_empty.notify_all();
+      not_full.notify_all();
+    }
+
+  private:
+    std::vector<T> items;
+    int first;
+    int count;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
+
+}
+
+#endif
@@ -0,0 +1,68 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include "GaussianKernel.h"
+
+namespace TLImageProc
+{
+
+GaussianKernel::GaussianKernel()
+{
+  miNx = miNy = miCx = miCy = -1;
+  mfSigmaX = mfSigmaY = 0;
+  mdFactor = 0;
+}
+
+const float* GaussianKernel::weights(int nx, int ny, int cx, int cy, float sigma_x, float sigma_y, double factor)
+{
+  nx = nx>0 ? nx : 0;
+  ny = ny>0 ? ny : 0;
+  if (nx==miNx && ny==miNy && cx==miCx && cy==miCy && sigma_x==mfSigmaX && sigma_y==mfSigmaY && factor==mdFactor)
+    return mWeights.data();
+
+  float dx, dy;
+  mXTerms.resize(nx);
+  for(int x=0; x<nx; x++)
+  {
+    dx = x-cx;
+    mXTerms[x] = dx*dx/sigma_x/sigma_x;
+  }
+  mYTerms.resize(ny);
+  for(int y=0; y<ny; y++)
+  {
+    dy = y-cy;
+    mYTerms[y] = dy*dy/sigma_y/sigma_y;
+  }
+
+  mWeights.resize(nx*ny);
+  float* w = mWeights.data();
+  for(int y=0; y<ny; y++)
+    for(int x=0; x<nx; x++)
+      *w++ = factor*exp(-0.5*(mXTerms[x]+mYTerms[y]));
+
+  miNx = nx;
+  miNy = ny;
+  miCx = cx;
+  miCy = cy;
+  mfSigmaX = sigma_x;
+  mfSigmaY = sigma_y;
+  mdFactor = factor;
+  return mWeights.data();
+}
+
+}
@@ -0,0 +1,58 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TL_GAUSSIANKERNEL_H
+#define TL_GAUSSIANKERNEL_H
+
+#include <vector>
+
+namespace TLImageProc
+{
+
+/*
+ * Gaussian spatial prior weights of a grid, kept for the following
+ * calls with the same parameters (the ROI size is usually the same from
+ * one image to the next).
+ * The weight of point (x,y) is
+ *   factor*exp(-0.5*(dx*dx/sigma_x/sigma_x + dy*dy/sigma_y/sigma_y))
+ * with dx=x-cx and dy=y-cy, the exponent computed in single precision
+ * as in the pixel loops it replaces. Its x and y terms are computed once
+ * per column and per line.
+ */
+class GaussianKernel
+{
+  public:
+    GaussianKernel();
+
+    /*
+     * Weights of the nx x ny grid, line by line.
+     * @return  nx*ny weights, valid until the next call.
+     */
+    const float* weights(int nx, int ny, int cx, int cy, float sigma_x, float sigma_y, double factor=1);
+
+  private:
+    int miNx, miNy, miCx, miCy;
+    float mfSigmaX, mfSigmaY;
+    double mdFactor;
+    std::vector<float> mXTerms;
+    std::vector<float> mYTerms;
+    std::vector<float> mWeights;
+};
+
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Error.h"
+#include "GradDispCompactLUT.h"
+
+
+GradDispCompactLUT::GradDispCompactLUT(int _o_bins, int _m_bins, float _m_threshold)
+{
+  ASSERT(_m_bins <= MAX_MBINS, "GradDispCompactLUT: too many magnitude bins");
+  o_bins = _o_bins;
+  m_bins = _m_bins;
+  m_threshold = _m_threshold;
+  maxmag = sqrtf(2*1025*1025);
+  o_scale = o_bins/(2*M_PI);
+
+  compute_luts();
+}
+
+// same computation as GradDispLUT::compute_luts()
+int GradDispCompactLUT::exact_obin(float gx, float gy)
+{
+  float angle = atan2f(gy, gx);
+  int obin = int((angle+M_PI)/(2*M_PI)*o_bins); 
+  if (obin>=o_bins)
+    obin=o_bins-1;
+  return obin;
+}
+
+int GradDispCompactLUT::exact_mbin(float gx, float gy)
+{
+  return magnitude_bin(sqrtf(gx*gx+gy*gy));
+}
+
+int GradDispCompactLUT::magnitude_bin(float magnitude)
+{
+  int mbin = int((float)magnitude/maxmag * m_bins);
+  if (mbin>=m_bins)
+    mbin=m_bins-1;
+  return mbin;
+}
+
+void GradDispCompactLUT::compute_luts()
+{
+  low_bin = o_bins*m_bins-1;
+
+  // the magnitude and its bin increase with gx*gx+gy*gy, which is
+  // exact in float for the LUT range: find the bin boundaries by
+  // dichotomy on the squared magnitude
+  int r2_max = 2*1025*1025;
+  int lo = 0, hi = r2_max+1;
+  while (lo < hi)
+  {
+    int mid = (lo+hi)/2;
+    if (sqrtf((float)mid) < m_threshold)
+      lo = mid+1;
+    else
+      hi = mid;
+  }
+  r2_threshold = lo;
+
+  for(int b=1; b<m_bins; b++)
+  {
+    lo = 0;
+    hi = r2_max+1;
+    while (lo < hi)
+    {
+      int mid = (lo+hi)/2;
+      if (magnitude_bin(sqrtf((float)mid)) < b)
+	lo = mid+1;
+      else
+	hi = mid;
+    }
+    r2_mbin[b-1] = lo;
+  }
+
+  for(int i=0; i<=ATAN_STEPS; i++)
+    atan_table[i] = atan((double)i/ATAN_STEPS);
+
+  // atan2f() only depends on the direction on the octant edges
+  static const int edge_x[9] = { 1, 1, 0, -1, -1, -1, 0, 1, 0 };
+  static const int edge_y[9] = { 0, 1, 1, 1, 0, -1, -1, -1, 0 };
+  for(int e=0; e<9; e++)
+    edge_obin[e] = exact_obin(edge_x[e], edge_y[e]);
+}
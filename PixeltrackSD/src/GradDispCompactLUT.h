@@ -0,0 +1,119 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TL_GRADDISP_COMPACT
+#define TL_GRADDISP_COMPACT
+
+#include <stdlib.h>
+#ifdef D_API_WIN32
+// Windows
+#define _USE_MATH_DEFINES  // for M_PI
+#endif
+#include <math.h>
+
+#define ATAN_STEPS 1024
+#define MAX_MBINS 64
+
+/*
+ * Compact gradient bin computation, giving the same bins as the
+ * 8M entries table of GradDispLUT with 8 KB of tables.
+ * The magnitude bin only depends on gx*gx+gy*gy, it is found by
+ * comparing it with the squared magnitude of each bin boundary.
+ * The orientation is folded into the first octant and read from a
+ * table of atan(). Gradients on the octant edges use the bins of the
+ * edge directions. Gradients whose orientation is too close to a bin
+ * boundary for the table precision use the atan2f() computation of
+ * GradDispLUT.
+ */
+class GradDispCompactLUT {
+  public:
+    int o_bins;
+    int m_bins;
+    float m_threshold;
+    int maxmag;
+
+    // bin of the gradients below the magnitude threshold
+    unsigned int low_bin;
+    // smallest gx*gx+gy*gy above the magnitude threshold
+    int r2_threshold;
+    // smallest gx*gx+gy*gy of the magnitude bins 1 to m_bins-1
+    int r2_mbin[MAX_MBINS];
+    // atan() of [0,1] with ATAN_STEPS steps
+    double atan_table[ATAN_STEPS+1];
+    // orientation bins of the directions 0, pi/4, ..., 7*pi/4
+    // and of the null gradient
+    int edge_obin[9];
+    double o_scale;
+
+    GradDispCompactLUT(int o_bins, int m_bins, float m_threshold=50);
+
+    void compute_luts();
+
+    // the GradDispLUT computation
+    int exact_obin(float gx, float gy);
+    int exact_mbin(float gx, float gy);
+    int magnitude_bin(float magnitude);
+
+    inline unsigned int get_bin(short gx, short gy){
+      int r2 = gx*gx + gy*gy;
+      if (r2 < r2_threshold)
+	return low_bin;
+      int mbin = 0;
+      while (mbin < m_bins-1 && r2 >= r2_mbin[mbin])
+	mbin++;
+      return orientation_bin(gx, gy)*m_bins + mbin;
+    }
+
+    inline int orientation_bin(short gx, short gy){
+      int ax = abs(gx);
+      int ay = abs(gy);
+
+      // octant edges and null gradient
+      if (gy == 0)
+	return edge_obin[gx > 0 ? 0 : (gx < 0 ? 4 : 8)];
+      if (gx == 0)
+	return edge_obin[gy > 0 ? 2 : 6];
+      if (ax == ay)
+	return edge_obin[gx > 0 ? (gy > 0 ? 1 : 7) : (gy > 0 ? 3 : 5)];
+
+      // angle in the first octant, then in ]-pi,pi]
+      double t = ax > ay ? (double)ay/ax : (double)ax/ay;
+      double p = t*ATAN_STEPS;
+      int i = (int)p;
+      double angle = atan_table[i] + (p-i)*(atan_table[i+1]-atan_table[i]);
+      if (ay > ax)
+	angle = M_PI_2 - angle;
+      if (gx < 0)
+	angle = M_PI - angle;
+      if (gy < 0)
+	angle = -angle;
+
+      // the table error is below 1e-7 radians, atan2f() is within a
+      // few float ulps: if far enough from a bin boundary, the bin is
+      // the same as the one of atan2f()
+      double u = (angle + M_PI)*o_scale;
+      int obin = (int)u;
+      double frac = u - obin;
+      if (frac < 1e-4 || frac > 1-1e-4)
+	return exact_obin(gx, gy);
+      if (obin >= o_bins)
+	obin = o_bins-1;
+      return obin;
+    }
+};
+
+#endif
@@ -26,58 +26,97 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <float.h>
 #include "BGR2HSVdistLUT.h"
 #include "GradDispLUT.h"
+#include "Parallel.h"
 
 
-GradDispLUT::GradDispLUT(int _o_bins, int _m_bins, float m_threshold)
+GradDispLUT::GradDispLUT(int _o_bins, int _m_bins, float m_threshold, bool compact_lut)
 {
   o_bins = _o_bins;
   m_bins = _m_bins;
-  grad_to_disp = new unsigned int[(2050<<12)+2050];
+  if (compact_lut)
+  {
+    // 8 KB of tables instead of 33 MB, same bins
+    grad_to_disp = NULL;
+    computed_lut = NULL;
+    compact = new GradDispCompactLUT(o_bins, m_bins, m_threshold);
+    return;
+  }
+  compact = NULL;
+  // zeroed: the entries between the rows are not computed
+  computed_lut = new unsigned int[(2050<<12)+2050]();
+  grad_to_disp = computed_lut;
 
   compute_luts(m_threshold);
 }
 
+GradDispLUT::GradDispLUT(int _o_bins, int _m_bins, const unsigned int* lut_data)
+{
+  o_bins = _o_bins;
+  m_bins = _m_bins;
+  computed_lut = NULL;
+  compact = NULL;
+  grad_to_disp = lut_data;
+}
+
 GradDispLUT::~GradDispLUT(){
-  delete[] grad_to_disp;
+  delete[] computed_lut;
+  delete compact;
+}
+
+void GradDispLUT::get_bins(const short* gx, const short* gy, int n, int step, unsigned short* bins)
+{
+  if (grad_to_disp)
+  {
+    for(int k=0; k<n; k++, gx+=step, gy+=step)
+      bins[k] = grad_to_disp[((*gx+1025)<<12) + *gy+1025];
+  }
+  else
+  {
+    for(int k=0; k<n; k++, gx+=step, gy+=step)
+      bins[k] = compact->get_bin(*gx, *gy);
+  }
 }
 
 
 // Compute LUTs for histogram computation
 // directly from the RGB pixel values
+// (x ranges are computed in parallel threads)
 void GradDispLUT::compute_luts(float m_threshold)
 {
-  unsigned int indtmp1, ind;
-  float gx, gy;
-  float angle, magnitude;
-  int obin, mbin;
-  int maxmag = sqrtf(2*1025*1025);
-
-  // changed to order BGR 
-  for(int x=0; x<2050; x++){
-    indtmp1 = x<<12;
-    for(int y=0; y<2050; y++){
-      ind = indtmp1 + y;
-
-      gx = x-1025;
-      gy = y-1025;
-      angle = atan2f(gy, gx);
-      magnitude = sqrtf(gx*gx+gy*gy);
-      if (magnitude<m_threshold)
-      {
-	grad_to_disp[ind] = (o_bins*m_bins-1);
-      }
-      else
-      {
-	obin = int((angle+M_PI)/(2*M_PI)*o_bins); 
-	if (obin>=o_bins)
-	  obin=o_bins-1;
-	mbin = int((float)magnitude/maxmag * m_bins);
-	if (mbin>=m_bins)
-	  mbin=m_bins-1;
-	grad_to_disp[ind] = obin*m_bins + mbin;
+  TLUtil::parallelFor(0, 2050, [=](int first_x, int last_x){
+    unsigned int indtmp1, ind;
+    float gx, gy;
+    float angle, magnitude;
+    int obin, mbin;
+    int maxmag = sqrtf(2*1025*1025);
+
+    // changed to order BGR 
+    for(int x=first_x; x<last_x; x++){
+      indtmp1 = x<<12;
+      for(int y=0; y<2050; y++){
+	ind = indtmp1 + y;
+
+	gx = x-1025;
+	gy = y-1025;
+	angle = atan2f(gy, gx);
+	magnitude = sqrtf(gx*gx+gy*gy);
+	if (magnitude<m_threshold)
+	{
+	  computed_lut[ind] = (o_bins*m_bins-1);
+	}
+	else
+	{
+	  obin = int((angle+M_PI)/(2*M_PI)*o_bins); 
+	  if (obin>=o_bins)
+	    obin=o_bins-1;
+	  mbin = int((float)magnitude/maxmag * m_bins);
+	  if (mbin>=m_bins)
+	    mbin=m_bins-1;
+	  computed_lut[ind] = obin*m_bins + mbin;
+	}
       }
     }
-  }
+  });
 }
 
 
@@ -18,24 +18,40 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef TL_GRADDISP_HISTOGRAM 
 #define TL_GRADDISP_HISTOGRAM
 
+#include "GradDispCompactLUT.h"
+
 class GradDispLUT {
   //private: 
   public:
     // LUT
-    unsigned int* grad_to_disp;
+    const unsigned int* grad_to_disp; // NULL in compact mode
+    GradDispCompactLUT* compact;
+    unsigned int* computed_lut; // grad_to_disp if computed here, NULL if external
 
   public:
     int o_bins;
     int m_bins;
     
-    GradDispLUT(int o_bins, int m_bins, float m_threshold=50);
+    GradDispLUT(int o_bins, int m_bins, float m_threshold=50, bool compact_lut=false);
+
+    // use a precomputed table (not copied, not freed, only read)
+    GradDispLUT(int o_bins, int m_bins, const unsigned int* lut_data);
 
     ~GradDispLUT();
 
     void compute_luts(float m_threshold);
+    // bin of one pixel, the loops over pixels use get_bins()
     inline unsigned int get_bin(short gx, short gy){
-	  return grad_to_disp[((gx+1025)<<12) + gy+1025];
+	  if (grad_to_disp)
+	    return grad_to_disp[((gx+1025)<<12) + gy+1025];
+	  return compact->get_bin(gx, gy);
     }
+
+    /*
+     * Bins of n pixels of the gradient lines gx and gy, step pixels
+     * apart. The LUT (full or compact) is chosen once for the line.
+     */
+    void get_bins(const short* gx, const short* gy, int n, int step, unsigned short* bins);
 };
 
 
@@ -20,6 +20,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "tltypes.h"
 #include "HSVPixelGradientModel.h"
 #include "BGR2HSVdistLUT.h"
+#include "LUTCache.h"
+#include "ThreadPool.h"
 
 using namespace std;
 //using namespace cv;
@@ -43,7 +45,7 @@ bool disp_less_count(displacement_t lhs, displacement_t rhs)
 
 
 
-HSVPixelGradientModel::HSVPixelGradientModel(int nb_hsbins, int nb_vbins, int nb_obins, int nb_mbins, float mag_thresh)
+HSVPixelGradientModel::HSVPixelGradientModel(int nb_hsbins, int nb_vbins, int nb_obins, int nb_mbins, float mag_thresh, bool compact_colour_lut, bool compact_gradient_lut)
 {
   h_bins = nb_hsbins;
   s_bins = nb_hsbins;
@@ -54,88 +56,257 @@ HSVPixelGradientModel::HSVPixelGradientModel(int nb_hsbins, int nb_vbins, int nb
   totalbins = (h_bins*s_bins+v_bins)*(o_bins*m_bins+1);
   magnitude_threshold = mag_thresh;
 
-  disp = new list<displacement_t>*[totalbins];
-  for(int i=0; i<totalbins; i++)
-    disp[i] = new list<displacement_t>;
-
-  m_LUTColour = new BGR2HSVdistLUT(h_bins, s_bins, v_bins); 
-  m_LUTGradient = new GradDispLUT(o_bins, m_bins); 
+  // shared with the other models using the same bins
+  m_LUTColour = LUTCache::acquireDistLUT(h_bins, s_bins, v_bins, 0.1, 0.2, compact_colour_lut); 
+  m_LUTGradient = LUTCache::acquireGradLUT(o_bins, m_bins, 50, compact_gradient_lut); 
+  bin_img = NULL;
+  grid_step = 1;
+  vote_limit = MAXVOTES;
   reset();
 }
 
 HSVPixelGradientModel::~HSVPixelGradientModel()
 {
-  for(int i=0; i<totalbins; i++)
-    delete disp[i];
-  delete [] disp;
-  delete m_LUTColour;
-  delete m_LUTGradient;
+  LUTCache::release(m_LUTColour);
+  LUTCache::release(m_LUTGradient);
 }
 
 void HSVPixelGradientModel::reset()
 {
+  disp.clear();
+  disp_start.assign(totalbins+1, 0);
+  disp_min_x = disp_max_x = disp_min_y = disp_max_y = 0;
+}
+
+
+unsigned int HSVPixelGradientModel::hashDisplacement(int bin, int x, int y)
+{
+  unsigned int h = (unsigned int)bin*2654435761u ^ (unsigned int)x*73856093u ^ (unsigned int)y*19349663u;
+  return (h ^ (h>>15)) & staged_hash_mask;
+}
+
+void HSVPixelGradientModel::beginLearning(int max_new_displacements)
+{
+  // the buffers grow with some headroom, then they are reused by the
+  // next updates without allocation
+  unsigned int needed = disp.size()+max_new_displacements;
+  if (staged.capacity() < needed)
+  {
+    staged.reserve(2*needed);
+    sort_index.reserve(2*needed);
+    disp.reserve(2*needed);
+  }
+
+  // the model displacements, in the order of increasing count
+  staged.clear();
+  staged_displacement_t sd;
   for(int i=0; i<totalbins; i++)
-    disp[i]->clear();
+  {
+    sd.bin = i;
+    for(int k=disp_start[i+1]-1; k>=disp_start[i]; k--)
+    {
+      sd.d = disp[k];
+      staged.push_back(sd);
+    }
+  }
+
+  // at most half full
+  unsigned int hash_size = 16;
+  while (hash_size < 2*staged.capacity())
+    hash_size *= 2;
+  staged_hash_mask = hash_size-1;
+  staged_hash.assign(hash_size, -1);
+  for(unsigned int k=0; k<staged.size(); k++)
+  {
+    unsigned int h = hashDisplacement(staged[k].bin, staged[k].d.x, staged[k].d.y);
+    while (staged_hash[h]!=-1)
+      h = (h+1) & staged_hash_mask;
+    staged_hash[h] = k;
+  }
+}
+
+// index of the staged displacement, -1 if there is none
+int HSVPixelGradientModel::findDisplacement(int bin, const displacement_t& d)
+{
+  unsigned int h = hashDisplacement(bin, d.x, d.y);
+  while (staged_hash[h]!=-1)
+  {
+    const staged_displacement_t& sd = staged[staged_hash[h]];
+    if (sd.bin==bin && sd.d.x==d.x && sd.d.y==d.y)
+      return staged_hash[h];
+    h = (h+1) & staged_hash_mask;
+  }
+  return -1;
+}
+
+void HSVPixelGradientModel::addDisplacement(int bin, const displacement_t& d)
+{
+  unsigned int h = hashDisplacement(bin, d.x, d.y);
+  while (staged_hash[h]!=-1)
+    h = (h+1) & staged_hash_mask;
+  staged_hash[h] = staged.size();
+  staged_displacement_t sd;
+  sd.d = d;
+  sd.bin = bin;
+  staged.push_back(sd);
+}
+
+// Sort the staged displacements back into the model, keeping the
+// max_votes ones with the highest count in each bin (all if 0).
+// The order is the one of a stable sort by increasing count, reversed.
+void HSVPixelGradientModel::endLearning(int max_votes)
+{
+  // group by bin, keeping the staging order
+  disp_start.assign(totalbins+1, 0);
+  for(unsigned int k=0; k<staged.size(); k++)
+    disp_start[staged[k].bin]++;
+  for(int i=1; i<totalbins; i++)
+    disp_start[i] += disp_start[i-1];
+  disp_start[totalbins] = staged.size();
+  sort_index.resize(staged.size());
+  for(int k=staged.size()-1; k>=0; k--)
+    sort_index[--disp_start[staged[k].bin]] = k;
+
+  const vector<staged_displacement_t>& sd = staged;
+  disp.clear();
+  for(int i=0; i<totalbins; i++)
+  {
+    int first = disp_start[i];
+    int last = disp_start[i+1];
+    sort(sort_index.begin()+first, sort_index.begin()+last, [&sd](int a, int b){
+      return sd[a].d.count>sd[b].d.count || (sd[a].d.count==sd[b].d.count && a>b);
+    });
+    if (max_votes>0 && last-first>max_votes)
+      last = first+max_votes;
+    disp_start[i] = disp.size();
+    for(int k=first; k<last; k++)
+      disp.push_back(sd[sort_index[k]].d);
+  }
+  disp_start[totalbins] = disp.size();
+
+  disp_min_x = disp_max_x = disp_min_y = disp_max_y = 0;
+  for(unsigned int k=0; k<disp.size(); k++)
+  {
+    disp_min_x = min(disp_min_x, disp[k].x);
+    disp_max_x = max(disp_max_x, disp[k].x);
+    disp_min_y = min(disp_min_y, disp[k].y);
+    disp_max_y = max(disp_max_y, disp[k].y);
+  }
+}
+
+Rectangle HSVPixelGradientModel::voteArea(Image8U* img, Rectangle bb, float scale)
+{
+  // same window as vote(), the votes go to pixel - displacement
+  Rectangle imgBB(1, 1, img->width()-1, img->height()-1);
+  bb.intersection(imgBB);
+  float s = CLUSTER_SIZE*scale;
+  Rectangle area(int(floorf(bb.miFirstColumn-disp_max_x*s)), int(floorf(bb.miFirstLine-disp_max_y*s)),
+		 int(ceilf(bb.lastColumn()-disp_min_x*s)), int(ceilf(bb.lastLine()-disp_min_y*s)));
+  area.intersection(imgBB);
+  return area;
+}
+
+
+void HSVPixelGradientModel::computeBins(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle roi, Image<unsigned short>* bins)
+{
+  Rectangle imageBB(img->width(), img->height());
+  roi.intersection(imageBB);
+  if ((int)grad_line.size() < img->width())
+    grad_line.resize(img->width());
+
+  for(int i=roi.miFirstLine; i<=roi.lastLine(); i++)
+    lutBins(img, xgradimg, ygradimg, i, roi.miFirstColumn, roi.miWidth, 1, bins->data(roi.miFirstColumn, i), grad_line.data());
+}
+
+
+void HSVPixelGradientModel::lutBins(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, int i, int first_column, int n, int step, unsigned short* bins, unsigned short* grad_bins)
+{
+  m_LUTColour->hsv_bins(img->data() + i*img->widthStep() + first_column*3, n, step, bins);
+  m_LUTGradient->get_bins(xgradimg->data(first_column, i), ygradimg->data(first_column, i), n, step, grad_bins);
+  for(int k=0; k<n; k++)
+    bins[k] = grad_bins[k]*maxcolourbin + bins[k];
+}
+
+
+const unsigned short* HSVPixelGradientModel::lineBins(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, int i, int first_column, int n, int step, int& bin_step)
+{
+  if (bin_img)
+  {
+    bin_step = step;
+    return bin_img->data(first_column, i);
+  }
+  lutBins(img, xgradimg, ygradimg, i, first_column, n, step, line_bins.data(), grad_line.data());
+  bin_step = 1;
+  return line_bins.data();
+}
+
+
+// the buffers are kept for the next images, and not used with a bin
+// image (parallel calls of vote())
+void HSVPixelGradientModel::reserveLineBins(int width)
+{
+  if (!bin_img && (int)line_bins.size() < width)
+  {
+    line_bins.resize(width);
+    grad_line.resize(width);
+  }
 }
 
 
 void HSVPixelGradientModel::learn(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* segmentation)
 {
   int curline, curcol;
-  unsigned int index_colour, index_gradient, index;
+  unsigned int index;
   displacement_t cur_disp;
-  list<displacement_t>::iterator it;
+  int k;
   int pi, pj;
-  Colour pix;
-  short gx, gy;
   int ii, jj;
   Rectangle imageBB;
   imageBB.initPosAndSize(1, 1, img->width()-2, img->height()-2);
   bb.intersection(imageBB);
-  int ll=bb.lastLine(), lc = bb.lastColumn();
+  // the segmentation is zero out of its area
+  Rectangle seg_area = segmentation->area();
+  int fl = max(bb.miFirstLine, seg_area.miFirstLine), fc = max(bb.miFirstColumn, seg_area.miFirstColumn);
+  int ll = min(bb.lastLine(), seg_area.lastLine()+1), lc = min(bb.lastColumn(), seg_area.lastColumn()+1);
 
-  ii=0;
-  for(int i=bb.miFirstLine; i<ll; i++)
+  reserveLineBins(img->width());
+  int bin_step;
+
+  beginLearning(max(0, bb.miWidth)*max(0, bb.miHeight));
+  for(int i=fl; i<ll; i++)
   {
-    jj=0;
-    for(int j=bb.miFirstColumn; j<lc; j++)
+    ii = i-bb.miFirstLine;
+    const unsigned short* bins = lineBins(img, xgradimg, ygradimg, i, fc, lc-fc, 1, bin_step);
+    for(int j=fc; j<lc; j++)
     {
+      jj = j-bb.miFirstColumn;
       if (segmentation->get(j, i)>0.5)
       {
-      pix = img->getColourBGR(j, i);
-      gx = xgradimg->get(j, i);
-      gy = ygradimg->get(j, i);
-      
-      index_colour = m_LUTColour->hsv_bin(pix.r, pix.g, pix.b);
-      index_gradient = m_LUTGradient->get_bin(gx, gy);
-      index = index_gradient*maxcolourbin+index_colour;
+      index = bins[(j-fc)*bin_step];
       cur_disp.y=ii-bb.miHeight/2; 
       cur_disp.x=jj-bb.miWidth/2; 
       cur_disp.x = cur_disp.x/CLUSTER_SIZE;
       cur_disp.y = cur_disp.y/CLUSTER_SIZE;
 
-      it = find(disp[index]->begin(), disp[index]->end(), cur_disp);
-      if (it==disp[index]->end())
+      k = findDisplacement(index, cur_disp);
+      if (k<0)
       {
 	cur_disp.count=1;
-	disp[index]->push_back(cur_disp);
+	addDisplacement(index, cur_disp);
       }
       else
-        it->count++;
+        staged[k].d.count++;
       }
-      jj++;
     }
-    ii++;
   }
-  for(int i=0; i<totalbins; i++)
-    disp[i]->sort(disp_less_count); 
+  endLearning(0);
 }
 
 
 void HSVPixelGradientModel::vote(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* voting_map)
 {
   int lastline, lastcol;
-  int index_colour, index_gradient, index; 
+  int index;
   displacement_t cur_disp;
   int width, height;
   width = img->width();
@@ -144,78 +315,56 @@ void HSVPixelGradientModel::vote(Image8U* img, Image<short>* xgradimg, Image<sho
   bb.intersection(imgBB); 
   lastline = bb.lastLine();
   lastcol = bb.lastColumn();
-  list<displacement_t>::iterator it;
-  list<displacement_t>::iterator beg;
+  const displacement_t* it;
+  const displacement_t* end;
   int counter;
-  unsigned char r, g, b;
   float* voting_ptr;
   int nx, ny;
   int ii, jj;
   float xtrans, ytrans;
   int i, j;
   int si, sj;
-  int xgrid_step = 1; //max(1,bb.miWidth/30);
-  int ygrid_step = 1; //max(1,bb.miHeight/30);
-  unsigned char* iptr;
-  short *xptr, *yptr;
-  int ws = img->widthStep();
+  int xgrid_step = grid_step;
+  int ygrid_step = grid_step;
   int vmws = voting_map->widthStep();
   int roinx = bb.miWidth/xgrid_step;
   int roiny = bb.miHeight/ygrid_step;
-  int pixelstep = (xgrid_step-1)*3;
-  int xstep = ws-xgrid_step*roinx*3 + (ygrid_step-1)*ws;
-  int gradpixelstep = (xgrid_step-1);
-  int gradxstep = xgradimg->widthStep()-xgrid_step*roinx + (ygrid_step-1)*xgradimg->widthStep();
-  iptr = (unsigned char*)img->data()+bb.miFirstLine*ws + bb.miFirstColumn*3;
-  xptr = xgradimg->data()+bb.miFirstLine*xgradimg->widthStep() + bb.miFirstColumn;
-  yptr = ygradimg->data()+bb.miFirstLine*ygradimg->widthStep() + bb.miFirstColumn;
+  int bin_step;
+  reserveLineBins(width);
   float* vmd = voting_map->data();
-  short gx, gy;
+  int vm_origin = vmws*voting_map->offsetY() + voting_map->offsetX();
 
   for(si=0; si<roiny; si++)
   {
     i=bb.miFirstLine+si*ygrid_step;
+    const unsigned short* bins = lineBins(img, xgradimg, ygradimg, i, bb.miFirstColumn, roinx, xgrid_step, bin_step);
     for(sj=0; sj<roinx; sj++)
     {
       j=bb.miFirstColumn+sj*xgrid_step;
-      b = *iptr++; 
-      g = *iptr++;
-      r = *iptr++;
-      gx = *xptr++;
-      gy = *yptr++;
-
-      index_colour = m_LUTColour->hsv_bin(r, g, b);
-      index_gradient = m_LUTGradient->get_bin(gx, gy);
-      index = index_gradient*maxcolourbin+index_colour;
-      it=disp[index]->end();
-      beg=disp[index]->begin();
+      index = bins[sj*bin_step];
+      it=disp.data()+disp_start[index];
+      end=disp.data()+disp_start[index+1];
       counter=0;
-      while (counter<MAXVOTES && it!=beg)
+      while (counter<vote_limit && it!=end)
       {
-	--it;
 	ny = int(i-it->y*CLUSTER_SIZE);
 	nx = int(j-it->x*CLUSTER_SIZE);
 	if (ny>0 && nx>0 && ny<height && nx<width)
 	{
-	  voting_ptr = &(( (float*)(vmd + vmws*(ny)) )[nx]);
+	  voting_ptr = vmd + (vmws*ny + nx - vm_origin);
 	  *voting_ptr += it->count;
 	}
 	counter++;
+	it++;
       }
-      iptr+=pixelstep;
-      xptr+=gradpixelstep;
-      yptr+=gradpixelstep;
     }
-    iptr+=xstep;
-    xptr+=gradxstep;
-    yptr+=gradxstep;
   }
 }
 
 void HSVPixelGradientModel::vote(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* voting_map, float scale, float angle)
 {
   int lastline, lastcol;
-  int index_colour, index_gradient, index; 
+  int index;
   displacement_t cur_disp;
   int width, height;
   width = img->width();
@@ -224,78 +373,174 @@ void HSVPixelGradientModel::vote(Image8U* img, Image<short>* xgradimg, Image<sho
   bb.intersection(imgBB); 
   lastline = bb.lastLine();
   lastcol = bb.lastColumn();
-  list<displacement_t>::iterator it;
-  list<displacement_t>::iterator beg;
+  const displacement_t* it;
+  const displacement_t* end;
   int counter;
-  unsigned char r, g, b;
   float* voting_ptr;
   int nx, ny;
   int ii, jj;
   float xtrans, ytrans;
   int i, j;
   int si, sj;
-  int xgrid_step = 1; //max(1,bb.miWidth/30);
-  int ygrid_step = 1; //max(1,bb.miHeight/30);
-  unsigned char* iptr;
-  short *xptr, *yptr;
-  int ws = img->widthStep();
+  int xgrid_step = grid_step;
+  int ygrid_step = grid_step;
   int vmws = voting_map->widthStep();
   int roinx = bb.miWidth/xgrid_step;
   int roiny = bb.miHeight/ygrid_step;
-  int pixelstep = (xgrid_step-1)*3;
-  int xstep = ws-xgrid_step*roinx*3 + (ygrid_step-1)*ws;
-  int gradpixelstep = (xgrid_step-1);
-  int gradxstep = xgradimg->widthStep()-xgrid_step*roinx + (ygrid_step-1)*xgradimg->widthStep();
-  iptr = (unsigned char*)img->data()+bb.miFirstLine*ws + bb.miFirstColumn*3;
-  xptr = xgradimg->data()+bb.miFirstLine*xgradimg->widthStep() + bb.miFirstColumn;
-  yptr = ygradimg->data()+bb.miFirstLine*ygradimg->widthStep() + bb.miFirstColumn;
+  int bin_step;
+  reserveLineBins(width);
   float* vmd = voting_map->data();
-  short gx, gy;
+  int vm_origin = vmws*voting_map->offsetY() + voting_map->offsetX();
 
   for(si=0; si<roiny; si++)
   {
     i=bb.miFirstLine+si*ygrid_step;
+    const unsigned short* bins = lineBins(img, xgradimg, ygradimg, i, bb.miFirstColumn, roinx, xgrid_step, bin_step);
     for(sj=0; sj<roinx; sj++)
     {
       j=bb.miFirstColumn+sj*xgrid_step;
-      b = *iptr++; 
-      g = *iptr++;
-      r = *iptr++;
-      gx = *xptr++;
-      gy = *yptr++;
-
-      index_colour = m_LUTColour->hsv_bin(r, g, b);
-      index_gradient = m_LUTGradient->get_bin(gx, gy);
-      index = index_gradient*maxcolourbin+index_colour;
-      it=disp[index]->end();
-      beg=disp[index]->begin();
+      index = bins[sj*bin_step];
+      it=disp.data()+disp_start[index];
+      end=disp.data()+disp_start[index+1];
       counter=0;
-      while (counter<MAXVOTES && it!=beg)
+      while (counter<vote_limit && it!=end)
       {
-	--it;
 	ny = int(i-it->y*CLUSTER_SIZE*scale);
 	nx = int(j-it->x*CLUSTER_SIZE*scale);
 	if (ny>0 && nx>0 && ny<height && nx<width)
 	{
-	  voting_ptr = &(( (float*)(vmd + vmws*(ny)) )[nx]);
+	  voting_ptr = vmd + (vmws*ny + nx - vm_origin);
 	  *voting_ptr += it->count;
 	}
 	counter++;
+	it++;
       }
-      iptr+=pixelstep;
-      xptr+=gradpixelstep;
-      yptr+=gradpixelstep;
     }
-    iptr+=xstep;
-    xptr+=gradxstep;
-    yptr+=gradxstep;
   }
 }
 
+void HSVPixelGradientModel::voteParallel(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* voting_map, TLUtil::ThreadPool* pool, float scale)
+{
+  int width = img->width();
+  int height = img->height();
+  Rectangle imgBB(1, 1, width-1, height-1);
+  bb.intersection(imgBB);
+  Rectangle area = voteArea(img, bb, scale);
+  // sampled pixels of bb (all of them with the default quality)
+  int roinx = bb.miWidth/grid_step;
+  int roiny = bb.miHeight/grid_step;
+  int nthreads = min(pool->size(), min(roiny, area.miHeight));
+  if (nthreads <= 1)
+  {
+    if (scale==1)
+      vote(img, xgradimg, ygradimg, bb, voting_map);
+    else
+      vote(img, xgradimg, ygradimg, bb, voting_map, scale, 0);
+    return;
+  }
+
+  // the lines of the voting map are split in nthreads bands, the votes
+  // out of the area (none) go to the nearest band.
+  // At most vote_limit votes per sampled pixel: the lists only grow with
+  // the box, not with the distribution of the votes
+  if ((int)vote_lists.size() < nthreads)
+    vote_lists.resize(nthreads);
+  if ((int)vote_ends.size() < nthreads*nthreads)
+    vote_ends.resize(nthreads*nthreads);
+  for(int t=0; t<nthreads; t++)
+  {
+    unsigned int max_votes = (roiny*(t+1)/nthreads - roiny*t/nthreads)*roinx*vote_limit;
+    if (vote_lists[t].size() < max_votes)
+      vote_lists[t].resize(max_votes);
+  }
+  // colour and gradient bins of a line, by band, without bin image
+  if (!bin_img && (int)band_bins.size() < nthreads*2*roinx)
+    band_bins.resize(nthreads*2*roinx);
+
+  int vmws = voting_map->widthStep();
+  float* vmd = voting_map->data();
+  int vm_origin = vmws*voting_map->offsetY() + voting_map->offsetX();
+
+  // votes of the source bands (bands of sampled lines of bb), same order as
+  // vote(), grouped by destination band: the first pass counts them, the
+  // second one stores them
+  pool->run(nthreads, [&](int t){
+    vote_t* votes = vote_lists[t].data();
+    int* ends = &vote_ends[t*nthreads];
+    unsigned short* line = bin_img ? NULL : &band_bins[t*2*roinx];
+    int first_row = roiny*t/nthreads;
+    int end_row = roiny*(t+1)/nthreads;
+    for(int k=0; k<nthreads; k++)
+      ends[k] = 0;
+    for(int pass=0; pass<2; pass++)
+    {
+      for(int si=first_row; si<end_row; si++)
+      {
+        int i = bb.miFirstLine + si*grid_step;
+        const unsigned short* bins = line;
+        int bin_step = 1;
+        if (bin_img)
+        {
+          bins = bin_img->data(bb.miFirstColumn, i);
+          bin_step = grid_step;
+        }
+        else
+          lutBins(img, xgradimg, ygradimg, i, bb.miFirstColumn, roinx, grid_step, line, line+roinx);
+        for(int sj=0; sj<roinx; sj++)
+        {
+          int j = bb.miFirstColumn + sj*grid_step;
+          int index = bins[sj*bin_step];
+
+          const displacement_t* it = disp.data()+disp_start[index];
+          const displacement_t* end = disp.data()+min(disp_start[index+1], disp_start[index]+vote_limit);
+          for(; it!=end; it++)
+          {
+            int ny = int(i-it->y*CLUSTER_SIZE*scale);
+            int nx = int(j-it->x*CLUSTER_SIZE*scale);
+            if (ny>0 && nx>0 && ny<height && nx<width)
+            {
+              int band = min(max(ny-area.miFirstLine, 0), area.miHeight-1)*nthreads/area.miHeight;
+              if (pass==0)
+                ends[band]++;
+              else
+              {
+                vote_t v = { vmws*ny + nx - vm_origin, it->count };
+                votes[ends[band]++] = v;
+              }
+            }
+          }
+        }
+      }
+      if (pass==0)
+      {
+        // start of each destination band, ends[] after the second pass
+        int start = 0;
+        for(int k=0; k<nthreads; k++)
+        {
+          int count = ends[k];
+          ends[k] = start;
+          start += count;
+        }
+      }
+    }
+  });
+
+  // add the votes of each destination band, by increasing source band
+  pool->run(nthreads, [&](int k){
+    for(int t=0; t<nthreads; t++)
+    {
+      const vote_t* votes = vote_lists[t].data();
+      const int* ends = &vote_ends[t*nthreads];
+      for(int v=(k>0 ? ends[k-1] : 0); v<ends[k]; v++)
+        vmd[votes[v].offset] += votes[v].count;
+    }
+  });
+}
+
 void HSVPixelGradientModel::backproject(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* bpimg, int maxlocx, int maxlocy)
 {
   int lastline, lastcol;
-  int index_colour, index_gradient, index; 
+  int index;
   displacement_t cur_disp;
   int width, height;
   width = img->width();
@@ -304,30 +549,20 @@ void HSVPixelGradientModel::backproject(Image8U* img, Image<short>* xgradimg, Im
   bb.intersection(imgBB); 
   lastline = bb.lastLine();
   lastcol = bb.lastColumn();
-  list<displacement_t>::iterator it;
-  list<displacement_t>::iterator beg;
+  const displacement_t* it;
+  const displacement_t* end;
   int counter;
-  unsigned char r, g, b;
   float* voting_ptr;
   int nx, ny;
   int ii, jj;
   int i, j;
   int si, sj;
-  int xgrid_step = 1; //max(1,bb.miWidth/30);
-  int ygrid_step = 1; //max(1,bb.miHeight/30);
-  unsigned char* iptr;
-  short *xptr, *yptr;
-  int ws = img->widthStep();
+  int xgrid_step = grid_step;
+  int ygrid_step = grid_step;
   int roinx = bb.miWidth/xgrid_step;
   int roiny = bb.miHeight/ygrid_step;
-  int pixelstep = (xgrid_step-1)*3;
-  int xstep = ws-xgrid_step*roinx*3 + (ygrid_step-1)*ws;
-  int gradpixelstep = (xgrid_step);
-  int gradxstep = xgradimg->widthStep()-xgrid_step*roinx + (ygrid_step-1)*xgradimg->widthStep();
-  iptr = (unsigned char*)img->data()+bb.miFirstLine*ws + bb.miFirstColumn*3;
-  xptr = xgradimg->data()+bb.miFirstLine*xgradimg->widthStep() + bb.miFirstColumn;
-  yptr = ygradimg->data()+bb.miFirstLine*ygradimg->widthStep() + bb.miFirstColumn;
-  short gx, gy;
+  int bin_step;
+  reserveLineBins(width);
   int i_minus_maxlocy, j_minus_maxlocx;
   int xtrans, ytrans;
   float center_dist;
@@ -336,42 +571,34 @@ void HSVPixelGradientModel::backproject(Image8U* img, Image<short>* xgradimg, Im
   {
     i=bb.miFirstLine+si*ygrid_step;
     i_minus_maxlocy = i-maxlocy;
+    const unsigned short* bins = lineBins(img, xgradimg, ygradimg, i, bb.miFirstColumn, roinx, xgrid_step, bin_step);
     for(sj=0; sj<roinx; sj++)
     {
       j=bb.miFirstColumn+sj*xgrid_step;
       j_minus_maxlocx = j-maxlocx;
-      b = *iptr++; 
-      g = *iptr++;
-      r = *iptr++;
-      gx = *xptr;
-      gy = *yptr;
-
-      index_colour = m_LUTColour->hsv_bin(r, g, b);
-      index_gradient = m_LUTGradient->get_bin(gx, gy);
-      index = index_gradient*maxcolourbin+index_colour;
-      it=disp[index]->end();
-      beg=disp[index]->begin();
+      index = bins[sj*bin_step];
+      it=disp.data()+disp_start[index];
+      end=disp.data()+disp_start[index+1];
       center_dist=0;
       counter=0;
-      while (counter<MAXVOTES && it!=beg)
+      while (counter<vote_limit && it!=end)
       {
-	--it;
 	xtrans = it->x*CLUSTER_SIZE; 
 	ytrans = it->y*CLUSTER_SIZE; 
 	center_dist += sqrtf((ytrans-i_minus_maxlocy)*(ytrans-i_minus_maxlocy) + (xtrans-j_minus_maxlocx)*(xtrans-j_minus_maxlocx));
 	if (center_dist<CLUSTER_SIZE)
 	  counter+=it->count;
+	it++;
       }
       if (counter>0)
-	bpimg->set(j, i, counter*exp(-0.3*center_dist/CLUSTER_SIZE));
+      {
+	if (grid_step==1)
+	  bpimg->set(j, i, counter*exp(-0.3*center_dist/CLUSTER_SIZE));
+	else
+	  bpimg->init(counter*exp(-0.3*center_dist/CLUSTER_SIZE), bb.gridCell(j, i, grid_step));
+      }
 
-      iptr+=pixelstep;
-      xptr+=gradpixelstep;
-      yptr+=gradpixelstep;
     }
-    iptr+=xstep;
-    xptr+=gradxstep;
-    yptr+=gradxstep;
   }
 }
 
@@ -379,7 +606,7 @@ void HSVPixelGradientModel::backproject(Image8U* img, Image<short>* xgradimg, Im
 void HSVPixelGradientModel::backproject(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* bpimg, int maxlocx, int maxlocy, Image<float>* segmentation, float& mean_pos, float& variance_pos, float& mean_neg, float& variance_neg)
 {
   int lastline, lastcol;
-  int index_colour, index_gradient, index; 
+  int index;
   displacement_t cur_disp;
   int width, height;
   width = img->width();
@@ -388,10 +615,9 @@ void HSVPixelGradientModel::backproject(Image8U* img, Image<short>* xgradimg, Im
   bb.intersection(imgBB); 
   lastline = bb.lastLine();
   lastcol = bb.lastColumn();
-  list<displacement_t>::iterator it;
-  list<displacement_t>::iterator beg;
+  const displacement_t* it;
+  const displacement_t* end;
   int counter;
-  unsigned char r, g, b;
   float* voting_ptr;
   int nx, ny;
   int ii, jj;
@@ -399,19 +625,10 @@ void HSVPixelGradientModel::backproject(Image8U* img, Image<short>* xgradimg, Im
   int si, sj;
   int xgrid_step = 1; //max(1,bb.miWidth/30);
   int ygrid_step = 1; //max(1,bb.miHeight/30);
-  unsigned char* iptr;
-  short *xptr, *yptr;
-  int ws = img->widthStep();
   int roinx = bb.miWidth/xgrid_step;
   int roiny = bb.miHeight/ygrid_step;
-  int pixelstep = (xgrid_step-1)*3;
-  int xstep = ws-xgrid_step*roinx*3 + (ygrid_step-1)*ws;
-  int gradpixelstep = (xgrid_step);
-  int gradxstep = xgradimg->widthStep()-xgrid_step*roinx + (ygrid_step-1)*xgradimg->widthStep();
-  iptr = (unsigned char*)img->data()+bb.miFirstLine*ws + bb.miFirstColumn*3;
-  xptr = xgradimg->data()+bb.miFirstLine*xgradimg->widthStep() + bb.miFirstColumn;
-  yptr = ygradimg->data()+bb.miFirstLine*ygradimg->widthStep() + bb.miFirstColumn;
-  short gx, gy;
+  int bin_step;
+  reserveLineBins(width);
   int i_minus_maxlocy, j_minus_maxlocx;
   int xtrans, ytrans;
   float vote_err_pos=0, vote_err_pos2=0;
@@ -424,6 +641,7 @@ void HSVPixelGradientModel::backproject(Image8U* img, Image<short>* xgradimg, Im
   {
     i=bb.miFirstLine+si*ygrid_step;
     i_minus_maxlocy = i-maxlocy;
+    const unsigned short* bins = lineBins(img, xgradimg, ygradimg, i, bb.miFirstColumn, roinx, xgrid_step, bin_step);
     for(sj=0; sj<roinx; sj++)
     {
       j=bb.miFirstColumn+sj*xgrid_step;
@@ -431,32 +649,24 @@ void HSVPixelGradientModel::backproject(Image8U* img, Image<short>* xgradimg, Im
       fg = segmentation->get(j, i);
       bg = 1.0-fg;
 
-      b = *iptr++; 
-      g = *iptr++;
-      r = *iptr++;
-      gx = *xptr;
-      gy = *yptr;
-
-      index_colour = m_LUTColour->hsv_bin(r, g, b);
-      index_gradient = m_LUTGradient->get_bin(gx, gy);
-      index = index_gradient*maxcolourbin+index_colour;
-      it=disp[index]->end();
-      beg=disp[index]->begin();
+      index = bins[sj*bin_step];
+      it=disp.data()+disp_start[index];
+      end=disp.data()+disp_start[index+1];
       center_dist=0;
       mcd=FLT_MAX;;
       counter=0;
       int count_votes=0;
       if (fg>0.5)
       {
-	while (counter<MAXVOTES && it!=beg)
+	while (counter<MAXVOTES && it!=end)
 	{
-	  --it;
 	  xtrans = it->x*CLUSTER_SIZE; 
 	  ytrans = it->y*CLUSTER_SIZE; 
 	  center_dist += sqrtf((ytrans-i_minus_maxlocy)*(ytrans-i_minus_maxlocy) + (xtrans-j_minus_maxlocx)*(xtrans-j_minus_maxlocx));
 	  count_votes++;
 	  if (center_dist<CLUSTER_SIZE)
 	    counter+=it->count;
+	  it++;
 	}
 	if (counter>0)
 	{
@@ -468,15 +678,15 @@ void HSVPixelGradientModel::backproject(Image8U* img, Image<short>* xgradimg, Im
       }
       else
       {
-	while (counter<MAXVOTES && it!=beg)
+	while (counter<MAXVOTES && it!=end)
 	{
-	  --it;
 	  xtrans = it->x*CLUSTER_SIZE; 
 	  ytrans = it->y*CLUSTER_SIZE; 
 	  center_dist += sqrtf((ytrans-i_minus_maxlocy)*(ytrans-i_minus_maxlocy) + (xtrans-j_minus_maxlocx)*(xtrans-j_minus_maxlocx));
 	  count_votes++;
 	  if (center_dist<CLUSTER_SIZE)
 	    counter+=it->count;
+	  it++;
 	}
 	if (counter>0)
 	{
@@ -486,13 +696,7 @@ void HSVPixelGradientModel::backproject(Image8U* img, Image<short>* xgradimg, Im
 	  bpimg->set(j, i, counter);
 	}
       }
-      iptr+=pixelstep;
-      xptr+=gradpixelstep;
-      yptr+=gradpixelstep;
     }
-    iptr+=xstep;
-    xptr+=gradxstep;
-    yptr+=gradxstep;
   }
   if (fg_sum>0)
   {
@@ -518,66 +722,56 @@ void HSVPixelGradientModel::backproject(Image8U* img, Image<short>* xgradimg, Im
 void HSVPixelGradientModel::update(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* segmentation, float update_factor)
 {
   int curline, curcol;
-  unsigned int index_colour, index_gradient, index;
+  unsigned int index;
   displacement_t cur_disp;
-  list<displacement_t>::iterator it;
+  int k;
   int pi, pj;
-  Colour pix;
-  short gx, gy;
   int ii, jj;
   float one_minus_uf = 1.0-update_factor;
   Rectangle imageBB;
   imageBB.initPosAndSize(1, 1, img->width()-2, img->height()-2);
   bb.intersection(imageBB);
-  int ll=bb.lastLine(), lc = bb.lastColumn();
+  // the segmentation is zero out of its area
+  Rectangle seg_area = segmentation->area();
+  int fl = max(bb.miFirstLine, seg_area.miFirstLine), fc = max(bb.miFirstColumn, seg_area.miFirstColumn);
+  int ll = min(bb.lastLine(), seg_area.lastLine()+1), lc = min(bb.lastColumn(), seg_area.lastColumn()+1);
 
   // down-weight all previous votes
-  for(int i=0; i<totalbins; i++)
-    for(it=disp[i]->begin(); it!=disp[i]->end(); ++it)
-      it->count*=one_minus_uf;
+  for(unsigned int d=0; d<disp.size(); d++)
+    disp[d].count*=one_minus_uf;
+
+  reserveLineBins(img->width());
+  int bin_step;
 
-  ii=0;
-  for(int i=bb.miFirstLine; i<ll; i++)
+  beginLearning(max(0, bb.miWidth)*max(0, bb.miHeight));
+  for(int i=fl; i<ll; i++)
   {
-    jj=0;
-    for(int j=bb.miFirstColumn; j<lc; j++)
+    ii = i-bb.miFirstLine;
+    const unsigned short* bins = lineBins(img, xgradimg, ygradimg, i, fc, lc-fc, 1, bin_step);
+    for(int j=fc; j<lc; j++)
     {
+      jj = j-bb.miFirstColumn;
       if (segmentation->get(j, i)>0.3)
       {
-      pix = img->getColourBGR(j, i);
-      gx = xgradimg->get(j, i);
-      gy = ygradimg->get(j, i);
-      
-      index_colour = m_LUTColour->hsv_bin(pix.r, pix.g, pix.b);
-      index_gradient = m_LUTGradient->get_bin(gx, gy);
-      index = index_gradient*maxcolourbin+index_colour;
+      index = bins[(j-fc)*bin_step];
       cur_disp.y=ii-bb.miHeight/2; 
       cur_disp.x=jj-bb.miWidth/2; 
       cur_disp.x = cur_disp.x/CLUSTER_SIZE;
       cur_disp.y = cur_disp.y/CLUSTER_SIZE;
 
-      it = find(disp[index]->begin(), disp[index]->end(), cur_disp);
-      if (it==disp[index]->end())
+      k = findDisplacement(index, cur_disp);
+      if (k<0)
       {
 	cur_disp.count=1.0*update_factor*segmentation->get(j,i); 
-	disp[index]->push_back(cur_disp);
+	addDisplacement(index, cur_disp);
       }
       else
-        it->count=update_factor*segmentation->get(j,i);
+        staged[k].d.count=update_factor*segmentation->get(j,i);
       }
-      jj++;
     }
-    ii++;
-  }
-  for(int i=0; i<totalbins; i++)
-  {
-    disp[i]->sort(disp_less_count); 
-    // cut off irrelevant votes
-    it = disp[i]->end();
-	for(int di=0; it!=disp[i]->begin() && di<MAXVOTES; di++)
-      --it;
-    disp[i]->erase(disp[i]->begin(), it);
   }
+  // cut off irrelevant votes
+  endLearning(MAXVOTES);
 }
 
 
@@ -18,12 +18,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef HSVPIXELGRADIENTMODEL_H
 #define HSVPIXELGRADIENTMODEL_H
 
-#include <list>
+#include <vector>
 #include "Image.h"
 #include "Rectangle.h"
 #include "GradDispLUT.h"
 #include "BGR2HSVdistLUT.h"
 
+namespace TLUtil
+{
+  class ThreadPool;
+}
+
 #define CLUSTER_SIZE 3
 #define MAXVOTES 20 // 1000
 
@@ -43,26 +48,115 @@ typedef struct displacement_t
   
 bool disp_less(displacement_t lhs, displacement_t rhs);
 bool disp_less_count(displacement_t lhs, displacement_t rhs);
+
+// displacement being learnt, with its bin
+typedef struct staged_displacement_t
+{
+  displacement_t d;
+  int bin;
+} staged_displacement_t;
   
 
 class HSVPixelGradientModel
 {
   public:
-    HSVPixelGradientModel(int nb_hsbins, int nb_vbins, int nb_obins, int nb_mbins, float mag_thresh);
+    // compact_colour_lut, compact_gradient_lut: use the compact LUTs (same bins, less memory)
+    HSVPixelGradientModel(int nb_hsbins, int nb_vbins, int nb_obins, int nb_mbins, float mag_thresh, bool compact_colour_lut=false, bool compact_gradient_lut=false);
     ~HSVPixelGradientModel();
 
     void reset();
     void learn(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* segmentation);
     void vote(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* voting_map);
     void vote(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* voting_map, float scale, float angle);
+
+    /*
+     * vote() shared between threads, with the same result. The lines of
+     * bb are split between the threads, which sort their votes by band
+     * of lines of the voting map. Each band is then added by one thread,
+     * its pixels receiving their votes in the order of vote().
+     * @param pool  threads of the voting (one band per thread), kept
+     * between the images.
+     */
+    void voteParallel(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* voting_map, TLUtil::ThreadPool* pool, float scale=1);
     void backproject(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* bpimg, int maxlocx, int maxlocy);
     void backproject(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* bpimg, int maxlocx, int maxlocy, Image<float>* segmentation, float& mean_pos, float& variance_pos, float& mean_neg, float& variance_neg);
     void update(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle bb, Image<float>* segmentation, float update_factor);
 
+    /*
+     * Compute the model bin (colour and gradient) of the pixels of roi.
+     * The bin image can be shared by the models with the same bins.
+     */
+    void computeBins(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, Rectangle roi, Image<unsigned short>* bins);
+
+    /*
+     * Read the pixel bins from a bin image computed by computeBins() for
+     * the current image, instead of computing them. Without a bin image,
+     * the bins of each line are computed in a buffer of the model: the
+     * calls of vote() must not run in parallel then.
+     * @param bins  bin image, NULL to compute the bins (default).
+     */
+    void setBinImage(Image<unsigned short>* bins) { bin_img = bins; }
+
+    /*
+     * Rectangle containing all the pixels vote() can write for bb.
+     */
+    Rectangle voteArea(Image8U* img, Rectangle bb, float scale=1);
+
+    /*
+     * Trade accuracy for speed in vote(), voteParallel() and backproject():
+     * the pixels of bb are sampled every step pixels in both directions,
+     * and each one gives at most max_votes displacements. backproject()
+     * sets the step x step block of each sample.
+     * @param step  sampling step, 1 for all the pixels (default),
+     * @param max_votes  votes per pixel, MAXVOTES by default.
+     */
+    void setVoteQuality(int step, int max_votes) { grid_step = max(1, step); vote_limit = max(1, max_votes); }
+
   private:
+    // learning: the displacements of the model are copied to a staging
+    // array, indexed by a hash table on (bin, x, y), where the new
+    // displacements are added, then sorted back into the model
+    void beginLearning(int max_new_displacements);
+    int findDisplacement(int bin, const displacement_t& d);
+    void addDisplacement(int bin, const displacement_t& d);
+    void endLearning(int max_votes);
+    unsigned int hashDisplacement(int bin, int x, int y);
+
+    // bins of the n pixels first_column+k*step of line i, computed with
+    // the LUTs (their mode is chosen once for the line), grad_bins is a
+    // buffer of n bins
+    void lutBins(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, int i, int first_column, int n, int step, unsigned short* bins, unsigned short* grad_bins);
+    // bins of the same pixels, read in bin_img (bin_step = step) or
+    // computed in line_bins (bin_step = 1, see reserveLineBins())
+    const unsigned short* lineBins(Image8U* img, Image<short>* xgradimg, Image<short>* ygradimg, int i, int first_column, int n, int step, int& bin_step);
+    void reserveLineBins(int width);
+
     BGR2HSVdistLUT* m_LUTColour;
     GradDispLUT* m_LUTGradient;
-    list<displacement_t>** disp;
+    Image<unsigned short>* bin_img;
+    int grid_step;
+    int vote_limit;
+    // displacements of bin i: disp[disp_start[i]] to disp[disp_start[i+1]-1],
+    // by decreasing count (decreasing learning order for equal counts)
+    vector<displacement_t> disp;
+    vector<int> disp_start;
+    int disp_min_x, disp_max_x, disp_min_y, disp_max_y; // bounds of the displacements
+    vector<staged_displacement_t> staged;
+    vector<int> staged_hash; // staged index, -1 if empty
+    unsigned int staged_hash_mask;
+    vector<int> sort_index;
+    // votes of voteParallel(): position in the voting map and count,
+    // by source band, grouped by destination band
+    typedef struct vote_t
+    {
+      int offset;
+      float count;
+    } vote_t;
+    vector< vector<vote_t> > vote_lists;
+    vector<int> vote_ends; // end of each destination band in vote_lists, by source band
+    // bins of a line computed with the LUTs, and their gradient bins
+    vector<unsigned short> line_bins, grad_line;
+    vector<unsigned short> band_bins; // same for each band of voteParallel()
     int h_bins;        
     int s_bins;  
     int v_bins;
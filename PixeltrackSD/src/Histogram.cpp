@@ -23,6 +23,7 @@ Histogram::Histogram(int h_bins, int s_bins, int v_bins, int _niScales, int imgw
     miNVBins[s] = v_bins*(s+1);
   }
   mImageBB.initPosAndSize(0, 0, imgw, imgh);
+  mLineBins.resize(niScales*imgw);
 }
 
 Histogram::~Histogram(){
@@ -32,6 +33,12 @@ Histogram::~Histogram(){
   delete [] miNVBins;
 }
 
+// the LUT mode is chosen once per line and scale, not for each pixel
+void Histogram::lineBins(const unsigned char* bgr, BGR2HSVhistLUT** luts, int n, int step){
+  for(int s=0;s<niScales;s++)
+    luts[s]->hsv_bins(bgr, n, step, &mLineBins[s*mImageBB.miWidth]);
+}
+
 // Loop over the ROI and compute
 // the histogram using the lut
 int Histogram::compute(Image<unsigned char>* img, BGR2HSVhistLUT** luts, Rectangle* roi, Image<float>* mask/*=NULL*/, bool set_zero/*=true*/, bool normalise_hist/*=true*/, bool grid/*=true*/){
@@ -43,24 +50,18 @@ int Histogram::compute(Image<unsigned char>* img, BGR2HSVhistLUT** luts, Rectang
     return 0;
 
   int n_fg_pixels = 0;
-  unsigned char r,g,b;
   int i,j,s;
   int rgb=0;
   unsigned char* prgb;
   unsigned char *ptr; 
   float *ptr_mask;
   unsigned char *pdat; 
-  float* pmdat;
   int ws = img->widthStep();
-  int mws;
-  if (mask)
-  {
-    mws = mask->widthStep();
-    pmdat = (float*)mask->data();
-  }
-  int xstep = ws-roi->miWidth*3;
   pdat = img->data();
   n_fg_pixels = roi->miWidth*roi->miHeight;
+  // bins of the current line, mLineBins[s*w+i] at scale s
+  const unsigned short* bins = mLineBins.data();
+  int w = mImageBB.miWidth;
 
   if(mask == NULL){  
     ptr = ((unsigned char *)(pdat + roi->miFirstLine*ws)) + roi->miFirstColumn*3;
@@ -70,62 +71,51 @@ int Histogram::compute(Image<unsigned char>* img, BGR2HSVhistLUT** luts, Rectang
       int ygrid_step = max(1, roi->miHeight/20);
       int roinx = roi->miWidth/xgrid_step;
       int roiny = roi->miHeight/ygrid_step;
-      int pixelstep = (xgrid_step-1)*3;
-      xstep = ws-xgrid_step*roinx*3 + (ygrid_step-1)*ws;
       for(j=0;j<roiny;j++){
+	lineBins(ptr, luts, roinx, xgrid_step);
 	for(i=0;i<roinx;i++){
-	  b = *(ptr++);
-	  g = *(ptr++);
-	  r = *(ptr++);
 	  for(s=0;s<niScales;s++){
-	    hsv_count[s][luts[s]->bgr_to_hsv_bin[(((b<<8) + g)<<8) + r]]++;
+	    hsv_count[s][bins[s*w+i]]++;
 	  }
-	  ptr+=pixelstep;
 	}
-	ptr+=xstep;
+	ptr+=ygrid_step*ws;
       }
       n_fg_pixels = roinx*roiny;
     }
     else
     {
       for(j=0;j<roi->miHeight;j++){
+	lineBins(ptr, luts, roi->miWidth, 1);
 	for(i=0;i<roi->miWidth;i++){
-	  b = *(ptr++);
-	  g = *(ptr++);
-	  r = *(ptr++);
 	  for(s=0;s<niScales;s++){
-	    hsv_count[s][luts[s]->bgr_to_hsv_bin[(((b<<8) + g)<<8) + r]]++;
+	    hsv_count[s][bins[s*w+i]]++;
 	  }
-	  //ptr+=3;
 	}
-	ptr+=xstep;
+	ptr+=ws;
       }
       //n_fg_pixels = roi->miWidth*roi->miHeight;
     }
   }
   else {
-    ASSERT(mask->width() == img->width() && mask->height() == img->height(), "Image and mask must have the same size. In Histogram::compute().");
+    Rectangle covered = *roi;
+    Rectangle mask_area = mask->area();
+    covered.intersection(mask_area);
+    ASSERT(covered.area() == roi->area(), "The mask must cover the roi. In Histogram::compute().");
 
-    int mxstep = mws-mask->width();
     for(j=roi->miFirstLine;j<roi->miHeight+roi->miFirstLine;j++){
       ptr = ((unsigned char *)(pdat + j*ws)) + roi->miFirstColumn*3;
-      //ptr_mask = ((unsigned char *)(pmdat + j*mws)) + roi->miFirstColumn;
-      ptr_mask = ((float*)(pmdat) + j*mws) + roi->miFirstColumn;
+      ptr_mask = mask->data(roi->miFirstColumn, j);
+      lineBins(ptr, luts, roi->miWidth, 1);
       for(i=0;i<roi->miWidth;i++){
-	b = *(ptr++);
-	g = *(ptr++);
-	r = *(ptr++);
 	if (*ptr_mask>0.5)
 	{
 	  for(s=0;s<niScales;s++){
-	      hsv_count[s][luts[s]->bgr_to_hsv_bin[(((b<<8) + g)<<8) + r]]++;
+	      hsv_count[s][bins[s*w+i]]++;
 	  }
 	}
 	n_fg_pixels++;
 	ptr_mask++;
       }
-      ptr+=xstep;
-      ptr_mask+=mxstep;
     }
   }
   
@@ -151,7 +141,6 @@ int Histogram::compute(Image<unsigned char>* img, BGR2HSVhistLUT** luts,
   roi->intersection(mImageBB);
 
   int n_fg_pixels = 0;
-  unsigned char r,g,b;
   int i,j,s;
   int rgb=0;
   unsigned char* prgb;
@@ -159,11 +148,12 @@ int Histogram::compute(Image<unsigned char>* img, BGR2HSVhistLUT** luts,
   unsigned char *pdat, *pmdat;
   int ws = img->widthStep();
   int mws;
-  int xstep = ws-roi->miWidth*3;
   pdat = img->data();
   n_fg_pixels = roi->miWidth*roi->miHeight;
+  // bins of the current line, mLineBins[s*w+i] at scale s
+  const unsigned short* bins = mLineBins.data();
+  int w = mImageBB.miWidth;
   float spatial_prior;
-  float dx, dy;
   int rw2=roi->miWidth/2, rh2=roi->miHeight/2;
 
 
@@ -174,43 +164,33 @@ int Histogram::compute(Image<unsigned char>* img, BGR2HSVhistLUT** luts,
       int ygrid_step = max(1, roi->miHeight/20);
       int roinx = roi->miWidth/xgrid_step;
       int roiny = roi->miHeight/ygrid_step;
-      int pixelstep = (xgrid_step-1)*3;
-      xstep = ws-xgrid_step*roinx*3 + (ygrid_step-1)*ws;
+      const float* kernel = mKernel.weights(roinx, roiny, rw2, rh2, kernel_sigma_x, kernel_sigma_y);
       for(j=0;j<roiny;j++){
-        dy = j-rh2;
+	lineBins(ptr, luts, roinx, xgrid_step);
 	for(i=0;i<roinx;i++){
-	  dx = i-rw2;
-	  spatial_prior = exp(-0.5*(dx*dx/kernel_sigma_x/kernel_sigma_x+dy*dy/kernel_sigma_y/kernel_sigma_y));
+	  spatial_prior = *kernel++;
 
-	  b = *(ptr++);
-	  g = *(ptr++);
-	  r = *(ptr++);
 	  for(s=0;s<niScales;s++){
-	    hsv_count[s][luts[s]->bgr_to_hsv_bin[(((b<<8) + g)<<8) + r]]+=spatial_prior;
+	    hsv_count[s][bins[s*w+i]]+=spatial_prior;
 	  }
-	  ptr+=pixelstep;
 	}
-	ptr+=xstep;
+	ptr+=ygrid_step*ws;
       }
       n_fg_pixels = roinx*roiny;
     }
     else
     {
+      const float* kernel = mKernel.weights(roi->miWidth, roi->miHeight, rw2, rh2, kernel_sigma_x, kernel_sigma_y);
       for(j=0;j<roi->miHeight;j++){
-        dy = j-rh2;
+	lineBins(ptr, luts, roi->miWidth, 1);
 	for(i=0;i<roi->miWidth;i++){
-	  dx = i-rw2;
-	  spatial_prior = exp(-0.5*(dx*dx/kernel_sigma_x/kernel_sigma_x+dy*dy/kernel_sigma_y/kernel_sigma_y));
+	  spatial_prior = *kernel++;
 
-	  b = *(ptr++);
-	  g = *(ptr++);
-	  r = *(ptr++);
 	  for(s=0;s<niScales;s++){
-	    hsv_count[s][luts[s]->bgr_to_hsv_bin[(((b<<8) + g)<<8) + r]]+=spatial_prior;
+	    hsv_count[s][bins[s*w+i]]+=spatial_prior;
 	  }
-	  //ptr+=3;
 	}
-	ptr+=xstep;
+	ptr+=ws;
       }
       //n_fg_pixels = roi->miWidth*roi->miHeight;
     }
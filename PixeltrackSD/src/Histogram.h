@@ -19,9 +19,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define TL_HISTOGRAM_H
 
 #include <valarray>
+#include <vector>
 #include "Image.h"
 #include "Rectangle.h"
 #include "BGR2HSVhistLUT.h"
+#include "GaussianKernel.h"
 
 using namespace std;
 using namespace TLImageProc;
@@ -35,6 +37,11 @@ class Histogram {
     int* miNHSBins;
     int* miNVBins;
     Rectangle mImageBB;
+    GaussianKernel mKernel; // spatial prior of compute()
+    vector<unsigned short> mLineBins; // bins of a line of compute(), by scale
+
+    // bins of n pixels of a BGR line, step pixels apart, in mLineBins
+    void lineBins(const unsigned char* bgr, BGR2HSVhistLUT** luts, int n, int step);
 
   public:
     int niScales;
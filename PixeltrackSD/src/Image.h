@@ -2,9 +2,11 @@
 #define TL_IMAGE_H
 
 #include <string.h>
+#include <vector>
 #include "tltypes.h"
 #include "Rectangle.h"
 #include "Error.h"
+#include "ImageSIMD.h"
 #include <opencv2/opencv.hpp>
 
 #ifdef D_API_WIN32
@@ -26,10 +28,14 @@ class Image
     int miHeight;
     int miChannels;
     int miWidthStep;
+    int miOffsetX;
+    int miOffsetY;
     bool mbExternalData;;
     Rectangle mBB;
     Type* mData;  
 
+    void morphology(Image<Type>* result, Rectangle roi, const std::vector<int>& element, bool minimum);
+
   public:
     Image<Type>(int width, int height, int channels);
     Image<Type>(int width, int height, int channels, int widthstep, Type* data, bool externaldata=true);
@@ -40,24 +46,39 @@ class Image
     int widthStep() { return miWidthStep; };
     int nChannels() { return miChannels; };
     Type* data() { return mData; };
+    // pointer to pixel (x,y) of a single channel image
+    Type* data(int x, int y) { return mData+miWidthStep*(y-miOffsetY) + x-miOffsetX; };
+
+    // An image can be a window of a larger image: its first pixel is then
+    // pixel (offsetX(),offsetY()) of the larger image, and all the pixel
+    // coordinates and rectangles are given in the larger image (area() is
+    // the part of it covered). The offset is (0,0) by default.
+    int offsetX() { return miOffsetX; };
+    int offsetY() { return miOffsetY; };
+    void setOffset(int x, int y);
+    Rectangle area() { return mBB; };
+
     Type operator()(int x, int y) { return get(x,y); };
-    Type get(int x, int y) { return *(mData+miWidthStep*y + x); };
-    Type get(int x, int y, int channel) { return *(mData+miWidthStep*y + miChannels*x + channel); };
-    void set(int x, int y, Type value) { ASSERT(miChannels==1, "Image::set() only for single channel images."); *(mData+miWidthStep*y + x) = value; };
-    void set(int x, int y, int channel, Type value) { *(mData+miWidthStep*y + x*miChannels + channel) = value; };
-    void add(int x, int y, Type value) { *(mData+miWidthStep*y + x) += value; };
-    void inc(int x, int y) { (*(mData+miWidthStep*y + x))++; };
+    Type get(int x, int y) { return *(mData+miWidthStep*(y-miOffsetY) + x-miOffsetX); };
+    Type get(int x, int y, int channel) { return *(mData+miWidthStep*(y-miOffsetY) + miChannels*(x-miOffsetX) + channel); };
+    void set(int x, int y, Type value) { ASSERT(miChannels==1, "Image::set() only for single channel images."); *(mData+miWidthStep*(y-miOffsetY) + x-miOffsetX) = value; };
+    void set(int x, int y, int channel, Type value) { *(mData+miWidthStep*(y-miOffsetY) + (x-miOffsetX)*miChannels + channel) = value; };
+    void add(int x, int y, Type value) { *(mData+miWidthStep*(y-miOffsetY) + x-miOffsetX) += value; };
+    void inc(int x, int y) { (*(mData+miWidthStep*(y-miOffsetY) + x-miOffsetX))++; };
     void setColourBGR(int x, int y, Colour c);
     Colour getColourBGR(int x, int y);
     void init(Type value);
     void init(Type value, Rectangle roi);
     void setZero();
     Image<Type>* clone();
+    // copy the pixels covered by both images to dst (single channel)
+    void copyTo(Image<Type>* dst);
     Image<Type>* resize(Rectangle roi, int dest_width, int dest_height);
     Image<Type>* flip();
 
     Image<unsigned char>* toGreyScale();
     bool toGreyScale(Image<unsigned char>* res);
+    bool toGreyScale(Image<unsigned char>* res, Rectangle roi);
 
     void multiply(Type f);
     void multiply(Type f, Image<Type>* result);
@@ -65,7 +86,20 @@ class Image
 
     void sobelX(Image<short>* result);
     void sobelY(Image<short>* result);
+    // only the pixels of roi (the image borders are never written)
+    void sobelX(Image<short>* result, Rectangle roi);
+    void sobelY(Image<short>* result, Rectangle roi);
+    // sobelX() and sobelY() in one pass (SIMD kernels for grey images)
+    void sobelXY(Image<short>* xresult, Image<short>* yresult);
+    void sobelXY(Image<short>* xresult, Image<short>* yresult, Rectangle roi);
     void average(Image<Type>* result);
+    // minimum (erode) or maximum (dilate) of the pixels of roi under a
+    // structuring element centred on each pixel of roi, written to result
+    // (not this image). Line k of the element.size() lines spans the
+    // columns -element[k] to element[k]. The pixels out of roi are
+    // ignored, as with the default border of cv::erode() and cv::dilate().
+    void erode(Image<Type>* result, Rectangle roi, const std::vector<int>& element) { morphology(result, roi, element, true); };
+    void dilate(Image<Type>* result, Rectangle roi, const std::vector<int>& element) { morphology(result, roi, element, false); };
     void binarise(float thresh);
     float entropy(Rectangle roi);
     float varianceFromCentre(Rectangle roi);
@@ -98,6 +132,8 @@ Image<Type>::Image(int width, int height, int channels)
   miWidthStep = width*channels;
   miHeight = height;
   miChannels = channels;
+  miOffsetX = 0;
+  miOffsetY = 0;
   mBB.initPosAndSize(0, 0, miWidth, miHeight);
 }
 
@@ -118,6 +154,8 @@ Image<Type>::Image(int width, int height, int channels, int widthstep, Type* dat
     mData = new Type[miHeight*miWidthStep];
     memcpy(mData, data, miHeight*miWidthStep*sizeof(Type));
   }
+  miOffsetX = 0;
+  miOffsetY = 0;
   mBB.initPosAndSize(0, 0, miWidth, miHeight);
 }
 
@@ -129,6 +167,15 @@ Image<Type>::~Image()
 }
 
 
+template<typename Type>
+void Image<Type>::setOffset(int x, int y)
+{
+  miOffsetX = x;
+  miOffsetY = y;
+  mBB.initPosAndSize(x, y, miWidth, miHeight);
+}
+
+
 template<typename Type>
 void Image<Type>::init(Type value)
 {
@@ -146,7 +193,7 @@ void Image<Type>::init(Type value, Rectangle roi)
 
   roi.intersection(mBB);
 
-  Type* ptr = mData + miWidthStep*roi.miFirstLine + roi.miFirstColumn;
+  Type* ptr = data(roi.miFirstColumn, roi.miFirstLine);
   int linestep = miWidthStep-roi.miWidth;
 
   for(int i=0; i<roi.miHeight; i++)
@@ -167,7 +214,7 @@ void Image<Type>::setZero()
 template<typename Type>
 void Image<Type>::setColourBGR(int x, int y, Colour c)
 {
-  Type* data_ptr = mData+(y*miWidthStep*sizeof(Type))+x*sizeof(Type)*3;
+  Type* data_ptr = mData+((y-miOffsetY)*miWidthStep*sizeof(Type))+(x-miOffsetX)*sizeof(Type)*3;
   data_ptr[0] = c.b;
   data_ptr[1] = c.g;
   data_ptr[2] = c.r;
@@ -176,7 +223,7 @@ void Image<Type>::setColourBGR(int x, int y, Colour c)
 template<typename Type>
 Colour Image<Type>::getColourBGR(int x, int y)
 {
-  Type* data_ptr = mData+(y*miWidthStep*sizeof(Type))+x*sizeof(Type)*3;
+  Type* data_ptr = mData+((y-miOffsetY)*miWidthStep*sizeof(Type))+(x-miOffsetX)*sizeof(Type)*3;
   return Colour(data_ptr[2], data_ptr[1], data_ptr[0]);;
 }
 
@@ -184,7 +231,21 @@ Colour Image<Type>::getColourBGR(int x, int y)
 template<class Type>
 Image<Type>* Image<Type>::clone()
 {
-  return new Image<Type>(miWidth, miHeight, miChannels, miWidthStep, mData, false);
+  Image<Type>* res = new Image<Type>(miWidth, miHeight, miChannels, miWidthStep, mData, false);
+  res->setOffset(miOffsetX, miOffsetY);
+  return res;
+}
+
+
+template<class Type>
+void Image<Type>::copyTo(Image<Type>* dst)
+{
+  ASSERT(miChannels==1, "Image::copyTo() requires a single-channel image.");
+
+  Rectangle roi = mBB;
+  roi.intersection(dst->mBB);
+  for(int i=roi.miFirstLine; i<=roi.lastLine(); i++)
+    memcpy(dst->data(roi.miFirstColumn, i), data(roi.miFirstColumn, i), roi.miWidth*sizeof(Type));
 }
 
 
@@ -193,6 +254,12 @@ inline bool Image<unsigned char>::toGreyScale(Image<unsigned char>* res)
 {
   if (miChannels==3)  // colour image (assuming BGR)
   {
+    if (simdLevel()!=SIMD_NONE)
+    {
+      for(int i=0; i<miHeight; i++)
+        greyScaleRowSIMD(mData + i*miWidthStep, res->mData + i*res->miWidthStep, miWidth);
+      return true;
+    }
     unsigned char* ptr = mData;
     unsigned char* resptr = res->mData;
     int r, g, b;
@@ -222,6 +289,44 @@ inline bool Image<unsigned char>::toGreyScale(Image<unsigned char>* res)
 }
 
 
+// only the pixels of roi
+template<>
+inline bool Image<unsigned char>::toGreyScale(Image<unsigned char>* res, Rectangle roi)
+{
+  roi.intersection(mBB);
+  if (miChannels==3)  // colour image (assuming BGR)
+  {
+    if (simdLevel()!=SIMD_NONE)
+    {
+      for(int i=roi.miFirstLine; i<=roi.lastLine(); i++)
+        greyScaleRowSIMD(mData + (i-miOffsetY)*miWidthStep + (roi.miFirstColumn-miOffsetX)*3, res->data(roi.miFirstColumn, i), roi.miWidth);
+      return true;
+    }
+    int r, g, b;
+    for(int i=roi.miFirstLine; i<=roi.lastLine(); i++)
+    {
+      unsigned char* ptr = mData + (i-miOffsetY)*miWidthStep + (roi.miFirstColumn-miOffsetX)*3;
+      unsigned char* resptr = res->data(roi.miFirstColumn, i);
+      for(int j=0; j<roi.miWidth; j++)
+      {
+	b = *ptr++;
+	g = *ptr++;
+	r = *ptr++;
+        *resptr++ = 0.299*r+0.587*g+0.114*b;
+      }
+    }
+    return true;
+  }
+  else if (miChannels==1)
+  {
+    for(int i=roi.miFirstLine; i<=roi.lastLine(); i++)
+      memcpy(res->data(roi.miFirstColumn, i), data(roi.miFirstColumn, i), roi.miWidth);
+    return true;
+  }
+  return false;
+}
+
+
 template<>
 inline Image<unsigned char>* Image<unsigned char>::toGreyScale()
 {
@@ -259,7 +364,7 @@ void Image<Type>::add(Type a, Rectangle roi)
 
   roi.intersection(mBB);
 
-  Type* ptr = mData + miWidthStep*roi.miFirstLine + roi.miFirstColumn;
+  Type* ptr = data(roi.miFirstColumn, roi.miFirstLine);
   int linestep = miWidthStep-roi.miWidth;
 
   for(int i=0; i<roi.miHeight; i++)
@@ -363,6 +468,73 @@ void Image<Type>::sobelY(Image<short>* result)
 }
 
 
+template<class Type>
+void Image<Type>::sobelX(Image<short>* result, Rectangle roi)
+{
+  Rectangle inner(mBB.miFirstColumn+1, mBB.miFirstLine+1, mBB.lastColumn()-1, mBB.lastLine()-1);
+  roi.intersection(inner);
+  for(int i=roi.miFirstLine; i<=roi.lastLine(); i++)
+  {
+    Type* in = data(roi.miFirstColumn, i);
+    short* out = result->data(roi.miFirstColumn, i);
+    for(int j=0; j<roi.miWidth; j++)
+    {
+      *out++ = (short)(in[1-miWidthStep] + 2*in[1] + in[1+miWidthStep] - in[-1-miWidthStep] - 2*in[-1] - in[-1+miWidthStep]);
+      in++;
+    }
+  }
+}
+
+
+template<class Type>
+void Image<Type>::sobelY(Image<short>* result, Rectangle roi)
+{
+  Rectangle inner(mBB.miFirstColumn+1, mBB.miFirstLine+1, mBB.lastColumn()-1, mBB.lastLine()-1);
+  roi.intersection(inner);
+  for(int i=roi.miFirstLine; i<=roi.lastLine(); i++)
+  {
+    Type* in = data(roi.miFirstColumn, i);
+    short* out = result->data(roi.miFirstColumn, i);
+    for(int j=0; j<roi.miWidth; j++)
+    {
+      *out++ = (short)(in[miWidthStep-1] + 2*in[miWidthStep] + in[miWidthStep+1] - in[-miWidthStep-1] - 2*in[-miWidthStep] - in[-miWidthStep+1]);
+      in++;
+    }
+  }
+}
+
+
+template<class Type>
+void Image<Type>::sobelXY(Image<short>* xresult, Image<short>* yresult)
+{
+  sobelXY(xresult, yresult, mBB);
+}
+
+
+template<class Type>
+void Image<Type>::sobelXY(Image<short>* xresult, Image<short>* yresult, Rectangle roi)
+{
+  sobelX(xresult, roi);
+  sobelY(yresult, roi);
+}
+
+
+template<>
+inline void Image<unsigned char>::sobelXY(Image<short>* xresult, Image<short>* yresult, Rectangle roi)
+{
+  if (simdLevel()==SIMD_NONE)
+  {
+    sobelX(xresult, roi);
+    sobelY(yresult, roi);
+    return;
+  }
+  Rectangle inner(mBB.miFirstColumn+1, mBB.miFirstLine+1, mBB.lastColumn()-1, mBB.lastLine()-1);
+  roi.intersection(inner);
+  for(int i=roi.miFirstLine; i<=roi.lastLine(); i++)
+    sobelRowSIMD(data(roi.miFirstColumn, i), miWidthStep, xresult->data(roi.miFirstColumn, i), yresult->data(roi.miFirstColumn, i), roi.miWidth);
+}
+
+
 template<class Type>
 void Image<Type>::average(Image<Type>* result)
 {
@@ -408,6 +580,48 @@ void Image<Type>::average(Image<Type>* result)
   }
 }
 
+template<class Type>
+void Image<Type>::morphology(Image<Type>* result, Rectangle roi, const std::vector<int>& element, bool minimum)
+{
+  ASSERT(miChannels==1, "Image::morphology() requires a single-channel image.");
+
+  roi.intersection(mBB);
+
+  int fl, fc, ll, lc;
+  fl = roi.miFirstLine;
+  fc = roi.miFirstColumn;
+  ll = roi.lastLine();
+  lc = roi.lastColumn();
+  int lines = element.size();
+  int ry = lines/2;
+
+  for(int i=fl; i<=ll; i++)
+  {
+    Type* out = result->data(fc, i);
+    // centre line first, it initialises the line of result
+    for(int n=0; n<lines; n++)
+    {
+      int k = (n+ry)%lines;
+      int y = i+k-ry;
+      if (y<fl || y>ll)
+        continue;
+      int e = element[k];
+      for(int j=fc; j<=lc; j++)
+      {
+        Type* in = data(j-e<fc ? fc : j-e, y);
+        Type* last = data(j+e>lc ? lc : j+e, y);
+        Type val = *in;
+        while (++in<=last)
+          if (minimum ? *in<val : *in>val)
+            val = *in;
+        if (n==0 || (minimum ? val<out[j-fc] : val>out[j-fc]))
+          out[j-fc] = val;
+      }
+    }
+  }
+}
+
+
 template<class Type>
 Type Image<Type>::maxLoc(Rectangle roi, int& maxx, int& maxy)
 {
@@ -415,7 +629,7 @@ Type Image<Type>::maxLoc(Rectangle roi, int& maxx, int& maxy)
 
   roi.intersection(mBB);
 
-  Type* ptr = mData + miWidthStep*roi.miFirstLine + roi.miFirstColumn;
+  Type* ptr = data(roi.miFirstColumn, roi.miFirstLine);
   int linestep = miWidthStep-roi.miWidth;
   Type maxval = *ptr;
   Type val;
@@ -450,7 +664,7 @@ void Image<Type>::centreOfMass(Rectangle roi, int& maxx, int& maxy)
 
   roi.intersection(mBB);
 
-  Type* ptr = mData + miWidthStep*roi.miFirstLine + roi.miFirstColumn;
+  Type* ptr = data(roi.miFirstColumn, roi.miFirstLine);
   int linestep = miWidthStep-roi.miWidth;
   Type maxval = *ptr;
   Type val;
@@ -522,7 +736,7 @@ float Image<Type>::entropy(Rectangle roi)
 
   roi.intersection(mBB);
 
-  Type* ptr = mData + miWidthStep*roi.miFirstLine + roi.miFirstColumn;
+  Type* ptr = data(roi.miFirstColumn, roi.miFirstLine);
   int linestep = miWidthStep-roi.miWidth;
   Type val;
   int fl, fc, ll, lc;
@@ -554,7 +768,7 @@ Type Image<Type>::sum(Rectangle roi)
 
   roi.intersection(mBB);
 
-  Type* ptr = mData + miWidthStep*roi.miFirstLine + roi.miFirstColumn;
+  Type* ptr = data(roi.miFirstColumn, roi.miFirstLine);
   int linestep = miWidthStep-roi.miWidth;
   Type val;
   int fl, fc, ll, lc;
@@ -584,7 +798,7 @@ float Image<Type>::varianceFromCentre(Rectangle roi)
 
   roi.intersection(mBB);
 
-  Type* ptr = mData + miWidthStep*roi.miFirstLine + roi.miFirstColumn;
+  Type* ptr = data(roi.miFirstColumn, roi.miFirstLine);
   int linestep = miWidthStep-roi.miWidth;
   Type val;
   int fl, fc, ll, lc;
@@ -720,7 +934,7 @@ float Image<Type>::uniformity(Rectangle roi)
     return 1.0;
 
   float res=0;
-  Type* ptr = mData + miWidthStep*roi.miFirstLine + roi.miFirstColumn;
+  Type* ptr = data(roi.miFirstColumn, roi.miFirstLine);
   //int xstep = miWidthStep - miWidth*miChannels;
   Type prevval = *ptr;;
   int linestep = miWidthStep-roi.miWidth;
@@ -752,7 +966,7 @@ int Image<Type>::sumGreaterThanThreshold(Rectangle roi, float thresh)
 
   roi.intersection(mBB);
 
-  Type* ptr = mData + miWidthStep*roi.miFirstLine + roi.miFirstColumn;
+  Type* ptr = data(roi.miFirstColumn, roi.miFirstLine);
   int linestep = miWidthStep-roi.miWidth;
   Type val;
   int fl, fc, ll, lc;
@@ -783,10 +997,11 @@ float Image<Type>::percentageChanged(Rectangle roi, int offx, int offy, Image<Ty
   roi.translate(offx, offy);
   roi.intersection(mBB);
   roi.translate(-offx, -offy);
+  roi.intersection(img->mBB);
 
   float res=0;
-  Type* ptr = mData + miWidthStep*(roi.miFirstLine+offy) + roi.miFirstColumn+offx;
-  Type* imgptr = img->mData + img->miWidthStep*roi.miFirstLine + roi.miFirstColumn;
+  Type* ptr = data(roi.miFirstColumn+offx, roi.miFirstLine+offy);
+  Type* imgptr = img->data(roi.miFirstColumn, roi.miFirstLine);
   int linestep = miWidthStep-roi.miWidth;
   int imglinestep = img->miWidthStep-roi.miWidth;
   float changes=0;
@@ -0,0 +1,347 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include "ImageSIMD.h"
+
+// the kernels are compiled for their instruction set only, whatever
+// the compiler options
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TL_SIMD_X86
+#include <immintrin.h>
+#define TL_TARGET_SSE2 __attribute__((target("sse2")))
+#define TL_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace TLImageProc
+{
+
+static std::atomic<int> simdLimit(SIMD_AVX2);
+
+static int detectSimdLevel()
+{
+#ifdef TL_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return SIMD_AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return SIMD_SSE2;
+#endif
+  return SIMD_NONE;
+}
+
+int simdLevel()
+{
+  static const int supported = detectSimdLevel();
+  int limit = simdLimit.load(std::memory_order_relaxed);
+  return limit < supported ? limit : supported;
+}
+
+void setSimdLevel(int level)
+{
+  simdLimit.store(level, std::memory_order_relaxed);
+}
+
+// scalar code of Image::toGreyScale()
+static inline unsigned char greyPixel(const unsigned char* bgr)
+{
+  int b = bgr[0];
+  int g = bgr[1];
+  int r = bgr[2];
+  return 0.299*r + 0.587*g + 0.114*b;
+}
+
+// scalar code of Image::sobelX() and Image::sobelY()
+static inline void sobelPixel(const unsigned char* in, int step, short* xgrad, short* ygrad)
+{
+  *xgrad = in[1-step] + 2*in[1] + in[1+step] - in[-1-step] - 2*in[-1] - in[-1+step];
+  *ygrad = in[step-1] + 2*in[step] + in[step+1] - in[-step-1] - 2*in[-step] - in[-step+1];
+}
+
+#ifdef TL_SIMD_X86
+
+/*
+ * Grey scale conversion.
+ * 1000 times the grey level, v = 299*r + 587*g + 114*b, is computed
+ * exactly with integers, and its truncated quotient by 1000 is the grey
+ * level computed in double, except when v is a multiple of 1000: the
+ * double computation may then round below the integer. Those pixels are
+ * computed again as in double. The quotient of v (< 2^18) is exact in
+ * float up to one, corrected with the remainder.
+ * Blocks of 3 registers of BGR pixels are split into B, G and R planes
+ * by 5 rounds of byte interleaving.
+ */
+
+TL_TARGET_SSE2
+static inline void deinterleaveBGR(__m128i* c)
+{
+  for(int round=0; round<5; round++)
+  {
+    __m128i t[6];
+    for(int k=0; k<3; k++)
+    {
+      t[2*k] = _mm_unpacklo_epi8(c[k], c[k+3]);
+      t[2*k+1] = _mm_unpackhi_epi8(c[k], c[k+3]);
+    }
+    for(int k=0; k<6; k++)
+      c[k] = t[k];
+  }
+}
+
+// grey levels of 2 pixels computed in double (int lanes 0 and 1)
+TL_TARGET_SSE2
+static inline __m128i greyDouble2(__m128i b, __m128i g, __m128i r)
+{
+  __m128d d = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(0.299), _mm_cvtepi32_pd(r)),
+                                    _mm_mul_pd(_mm_set1_pd(0.587), _mm_cvtepi32_pd(g))),
+                         _mm_mul_pd(_mm_set1_pd(0.114), _mm_cvtepi32_pd(b)));
+  return _mm_cvttpd_epi32(d);
+}
+
+// grey levels of 4 pixels (int lanes)
+TL_TARGET_SSE2
+static inline __m128i greySSE2(__m128i b, __m128i g, __m128i r)
+{
+  __m128i v = _mm_add_epi32(_mm_madd_epi16(_mm_or_si128(b, _mm_slli_epi32(g, 16)), _mm_set1_epi32((587<<16) | 114)),
+                            _mm_madd_epi16(r, _mm_set1_epi32(299)));
+  __m128 vf = _mm_cvtepi32_ps(v);
+  __m128i q = _mm_cvttps_epi32(_mm_mul_ps(vf, _mm_set1_ps(0.001f)));
+  __m128 rem = _mm_sub_ps(vf, _mm_mul_ps(_mm_cvtepi32_ps(q), _mm_set1_ps(1000.0f)));
+  __m128i multiple = _mm_castps_si128(_mm_or_ps(_mm_cmpeq_ps(rem, _mm_setzero_ps()),
+                                                _mm_cmpeq_ps(rem, _mm_set1_ps(1000.0f))));
+  if (_mm_movemask_epi8(multiple))
+  {
+    __m128i d = _mm_unpacklo_epi64(greyDouble2(b, g, r),
+                                   greyDouble2(_mm_srli_si128(b, 8), _mm_srli_si128(g, 8), _mm_srli_si128(r, 8)));
+    q = _mm_or_si128(_mm_and_si128(multiple, d), _mm_andnot_si128(multiple, q));
+  }
+  return q;
+}
+
+TL_TARGET_SSE2
+static void greyScaleRowSSE2(const unsigned char* bgr, unsigned char* grey, int n)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int x = 0;
+  for(; x+32<=n; x+=32)
+  {
+    __m128i c[6];
+    for(int k=0; k<6; k++)
+      c[k] = _mm_loadu_si128((const __m128i*)(bgr+3*x) + k);
+    deinterleaveBGR(c);
+
+    // c[h], c[2+h], c[4+h]: B, G, R of pixels 16*h to 16*h+15
+    for(int h=0; h<2; h++)
+    {
+      __m128i s[2];
+      for(int half=0; half<2; half++)
+      {
+        __m128i b = half ? _mm_unpackhi_epi8(c[h], zero) : _mm_unpacklo_epi8(c[h], zero);
+        __m128i g = half ? _mm_unpackhi_epi8(c[2+h], zero) : _mm_unpacklo_epi8(c[2+h], zero);
+        __m128i r = half ? _mm_unpackhi_epi8(c[4+h], zero) : _mm_unpacklo_epi8(c[4+h], zero);
+        __m128i q0 = greySSE2(_mm_unpacklo_epi16(b, zero), _mm_unpacklo_epi16(g, zero), _mm_unpacklo_epi16(r, zero));
+        __m128i q1 = greySSE2(_mm_unpackhi_epi16(b, zero), _mm_unpackhi_epi16(g, zero), _mm_unpackhi_epi16(r, zero));
+        s[half] = _mm_packs_epi32(q0, q1);
+      }
+      _mm_storeu_si128((__m128i*)(grey+x+16*h), _mm_packus_epi16(s[0], s[1]));
+    }
+  }
+  for(; x<n; x++)
+    grey[x] = greyPixel(bgr+3*x);
+}
+
+// AVX2 versions: the 128 bit lanes process 2 blocks as above
+
+TL_TARGET_AVX2
+static inline void deinterleaveBGR(__m256i* c)
+{
+  for(int round=0; round<5; round++)
+  {
+    __m256i t[6];
+    for(int k=0; k<3; k++)
+    {
+      t[2*k] = _mm256_unpacklo_epi8(c[k], c[k+3]);
+      t[2*k+1] = _mm256_unpackhi_epi8(c[k], c[k+3]);
+    }
+    for(int k=0; k<6; k++)
+      c[k] = t[k];
+  }
+}
+
+// grey levels of 4 pixels computed in double
+TL_TARGET_AVX2
+static inline __m128i greyDouble4(__m128i b, __m128i g, __m128i r)
+{
+  __m256d d = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(0.299), _mm256_cvtepi32_pd(r)),
+                                          _mm256_mul_pd(_mm256_set1_pd(0.587), _mm256_cvtepi32_pd(g))),
+                            _mm256_mul_pd(_mm256_set1_pd(0.114), _mm256_cvtepi32_pd(b)));
+  return _mm256_cvttpd_epi32(d);
+}
+
+TL_TARGET_AVX2
+static inline __m256i greyAVX2(__m256i b, __m256i g, __m256i r)
+{
+  __m256i v = _mm256_add_epi32(_mm256_madd_epi16(_mm256_or_si256(b, _mm256_slli_epi32(g, 16)), _mm256_set1_epi32((587<<16) | 114)),
+                               _mm256_madd_epi16(r, _mm256_set1_epi32(299)));
+  __m256 vf = _mm256_cvtepi32_ps(v);
+  __m256i q = _mm256_cvttps_epi32(_mm256_mul_ps(vf, _mm256_set1_ps(0.001f)));
+  __m256 rem = _mm256_sub_ps(vf, _mm256_mul_ps(_mm256_cvtepi32_ps(q), _mm256_set1_ps(1000.0f)));
+  __m256i multiple = _mm256_castps_si256(_mm256_or_ps(_mm256_cmp_ps(rem, _mm256_setzero_ps(), _CMP_EQ_OQ),
+                                                      _mm256_cmp_ps(rem, _mm256_set1_ps(1000.0f), _CMP_EQ_OQ)));
+  if (_mm256_movemask_epi8(multiple))
+  {
+    __m128i lo = greyDouble4(_mm256_castsi256_si128(b), _mm256_castsi256_si128(g), _mm256_castsi256_si128(r));
+    __m128i hi = greyDouble4(_mm256_extracti128_si256(b, 1), _mm256_extracti128_si256(g, 1), _mm256_extracti128_si256(r, 1));
+    __m256i d = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    q = _mm256_blendv_epi8(q, d, multiple);
+  }
+  return q;
+}
+
+TL_TARGET_AVX2
+static void greyScaleRowAVX2(const unsigned char* bgr, unsigned char* grey, int n)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  int x = 0;
+  for(; x+64<=n; x+=64)
+  {
+    // pixels x to x+31 in the low lanes, x+32 to x+63 in the high lanes
+    const __m128i* p = (const __m128i*)(bgr+3*x);
+    __m256i c[6];
+    for(int k=0; k<6; k++)
+      c[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(p+k)), _mm_loadu_si128(p+6+k), 1);
+    deinterleaveBGR(c);
+
+    __m256i o[2];
+    for(int h=0; h<2; h++)
+    {
+      __m256i s[2];
+      for(int half=0; half<2; half++)
+      {
+        __m256i b = half ? _mm256_unpackhi_epi8(c[h], zero) : _mm256_unpacklo_epi8(c[h], zero);
+        __m256i g = half ? _mm256_unpackhi_epi8(c[2+h], zero) : _mm256_unpacklo_epi8(c[2+h], zero);
+        __m256i r = half ? _mm256_unpackhi_epi8(c[4+h], zero) : _mm256_unpacklo_epi8(c[4+h], zero);
+        __m256i q0 = greyAVX2(_mm256_unpacklo_epi16(b, zero), _mm256_unpacklo_epi16(g, zero), _mm256_unpacklo_epi16(r, zero));
+        __m256i q1 = greyAVX2(_mm256_unpackhi_epi16(b, zero), _mm256_unpackhi_epi16(g, zero), _mm256_unpackhi_epi16(r, zero));
+        s[half] = _mm256_packs_epi32(q0, q1);
+      }
+      o[h] = _mm256_packus_epi16(s[0], s[1]);
+    }
+    _mm256_storeu_si256((__m256i*)(grey+x), _mm256_permute2x128_si256(o[0], o[1], 0x20));
+    _mm256_storeu_si256((__m256i*)(grey+x+32), _mm256_permute2x128_si256(o[0], o[1], 0x31));
+  }
+  greyScaleRowSSE2(bgr+3*x, grey+x, n-x);
+}
+
+/*
+ * Sobel filters, exact with 16 bit integers (|gradient| <= 1020).
+ */
+
+TL_TARGET_SSE2
+static void sobelRowSSE2(const unsigned char* grey, int step, short* xgrad, short* ygrad, int n)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int x = 0;
+  for(; x+16<=n; x+=16)
+  {
+    const unsigned char* in = grey + x;
+    __m128i p8[9];
+    for(int j=0; j<3; j++)
+      for(int i=0; i<3; i++)
+        p8[3*j+i] = _mm_loadu_si128((const __m128i*)(in + (j-1)*step + i-1));
+
+    for(int half=0; half<2; half++)
+    {
+      // p[3*j+i]: pixel at line j-1 and column i-1
+      __m128i p[9];
+      for(int k=0; k<9; k++)
+        p[k] = half ? _mm_unpackhi_epi8(p8[k], zero) : _mm_unpacklo_epi8(p8[k], zero);
+      __m128i dx = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(p[2], _mm_add_epi16(p[5], p[5])), p[8]),
+                                 _mm_add_epi16(_mm_add_epi16(p[0], _mm_add_epi16(p[3], p[3])), p[6]));
+      __m128i dy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(p[6], _mm_add_epi16(p[7], p[7])), p[8]),
+                                 _mm_add_epi16(_mm_add_epi16(p[0], _mm_add_epi16(p[1], p[1])), p[2]));
+      _mm_storeu_si128((__m128i*)(xgrad+x+8*half), dx);
+      _mm_storeu_si128((__m128i*)(ygrad+x+8*half), dy);
+    }
+  }
+  for(; x<n; x++)
+    sobelPixel(grey+x, step, xgrad+x, ygrad+x);
+}
+
+TL_TARGET_AVX2
+static void sobelRowAVX2(const unsigned char* grey, int step, short* xgrad, short* ygrad, int n)
+{
+  int x = 0;
+  for(; x+16<=n; x+=16)
+  {
+    const unsigned char* in = grey + x;
+    __m256i p[9];
+    for(int j=0; j<3; j++)
+      for(int i=0; i<3; i++)
+        p[3*j+i] = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(in + (j-1)*step + i-1)));
+    __m256i dx = _mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(p[2], _mm256_add_epi16(p[5], p[5])), p[8]),
+                                  _mm256_add_epi16(_mm256_add_epi16(p[0], _mm256_add_epi16(p[3], p[3])), p[6]));
+    __m256i dy = _mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(p[6], _mm256_add_epi16(p[7], p[7])), p[8]),
+                                  _mm256_add_epi16(_mm256_add_epi16(p[0], _mm256_add_epi16(p[1], p[1])), p[2]));
+    _mm256_storeu_si256((__m256i*)(xgrad+x), dx);
+    _mm256_storeu_si256((__m256i*)(ygrad+x), dy);
+  }
+  for(; x<n; x++)
+    sobelPixel(grey+x, step, xgrad+x, ygrad+x);
+}
+
+#endif
+
+void greyScaleRowSIMD(const unsigned char* bgr, unsigned char* grey, int n)
+{
+#ifdef TL_SIMD_X86
+  int level = simdLevel();
+  if (level>=SIMD_AVX2)
+  {
+    greyScaleRowAVX2(bgr, grey, n);
+    return;
+  }
+  if (level>=SIMD_SSE2)
+  {
+    greyScaleRowSSE2(bgr, grey, n);
+    return;
+  }
+#endif
+  for(int x=0; x<n; x++)
+    grey[x] = greyPixel(bgr+3*x);
+}
+
+void sobelRowSIMD(const unsigned char* grey, int step, short* xgrad, short* ygrad, int n)
+{
+#ifdef TL_SIMD_X86
+  int level = simdLevel();
+  if (level>=SIMD_AVX2)
+  {
+    sobelRowAVX2(grey, step, xgrad, ygrad, n);
+    return;
+  }
+  if (level>=SIMD_SSE2)
+  {
+    sobelRowSSE2(grey, step, xgrad, ygrad, n);
+    return;
+  }
+#endif
+  for(int x=0; x<n; x++)
+    sobelPixel(grey+x, step, xgrad+x, ygrad+x);
+}
+
+}
@@ -0,0 +1,62 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TL_IMAGESIMD_H
+#define TL_IMAGESIMD_H
+
+/*
+ * SIMD kernels of Image (grey scale conversion and Sobel filters).
+ * The instruction set is selected at run time among the ones the
+ * processor supports. The kernels give exactly the results of the
+ * scalar code of Image, which stays the reference.
+ */
+
+namespace TLImageProc
+{
+
+// instruction sets
+enum { SIMD_NONE, SIMD_SSE2, SIMD_AVX2 };
+
+/*
+ * Instruction set used by the kernels: the best one the processor
+ * supports, at most the one given to setSimdLevel().
+ * Image uses its scalar code with SIMD_NONE.
+ */
+int simdLevel();
+
+/*
+ * Restrict the instruction set of the kernels, for all the threads
+ * (SIMD_AVX2 by default, SIMD_NONE for the scalar code).
+ */
+void setSimdLevel(int level);
+
+/*
+ * Grey levels of n BGR pixels, as Image::toGreyScale().
+ */
+void greyScaleRowSIMD(const unsigned char* bgr, unsigned char* grey, int n);
+
+/*
+ * Sobel X and Y filters of n pixels of a grey image line, as
+ * Image::sobelX() and Image::sobelY() in one pass. The lines above and
+ * below are at -step and +step, and the pixels before and after the n
+ * pixels are read.
+ */
+void sobelRowSIMD(const unsigned char* grey, int step, short* xgrad, short* ygrad, int n);
+
+}
+
+#endif
@@ -0,0 +1,346 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#ifndef D_API_WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "LUTCache.h"
+
+using namespace TLImageProc;
+
+// LUT types
+enum { HIST_LUT, DIST_LUT, GRAD_LUT };
+
+typedef struct lut_entry_t
+{
+  int type;
+  int bins[3];
+  float thresholds[2];
+  int variant; // compact or full LUT
+  void* lut;
+  void (*destroy)(void*);
+  int refCount;
+  bool computing; // the first user is computing the LUT
+  std::string file; // LUT file, empty without disk cache
+  void* mapped; // mapped LUT file, NULL if computed
+  size_t mapped_size;
+} lut_entry_t;
+
+// LUT file header, the table follows at LUT_FILE_OFFSET
+#define LUT_FILE_MAGIC "PTLUT001"
+#define LUT_FILE_OFFSET 4096
+
+typedef struct lut_file_header_t
+{
+  char magic[8];
+  int type;
+  int bins[3];
+  float thresholds[2];
+  int element_size;
+  unsigned int elements;
+} lut_file_header_t;
+
+// registry state
+static std::mutex cacheMutex;
+static std::condition_variable cacheComputed;
+static std::list<lut_entry_t*> cacheEntries;
+static std::string diskCacheDirectory;
+
+static void fillHeader(const lut_entry_t* e, int element_size, unsigned int elements, lut_file_header_t* header)
+{
+  memset(header, 0, sizeof(lut_file_header_t));
+  memcpy(header->magic, LUT_FILE_MAGIC, 8);
+  header->type = e->type;
+  for(int i=0; i<3; i++)
+    header->bins[i] = e->bins[i];
+  header->thresholds[0] = e->thresholds[0];
+  header->thresholds[1] = e->thresholds[1];
+  header->element_size = element_size;
+  header->elements = elements;
+}
+
+// map the table of the LUT file of e (read-only), NULL if there is no
+// valid file
+static const void* loadLUTFile(lut_entry_t* e, int element_size, unsigned int elements)
+{
+#ifndef D_API_WIN32
+  if (e->file.empty())
+    return NULL;
+  int fd = open(e->file.c_str(), O_RDONLY);
+  if (fd<0)
+    return NULL;
+  size_t size = LUT_FILE_OFFSET + (size_t)element_size*elements;
+  struct stat st;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &st)==0 && (size_t)st.st_size==size)
+    data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data==MAP_FAILED)
+    return NULL;
+
+  // the thresholds are compared exactly, as in the registry
+  lut_file_header_t header;
+  fillHeader(e, element_size, elements, &header);
+  if (memcmp(data, &header, sizeof(lut_file_header_t))!=0)
+  {
+    std::cout << "LUTCache: ignoring invalid LUT file " << e->file << std::endl;
+    munmap(data, size);
+    return NULL;
+  }
+  e->mapped = data;
+  e->mapped_size = size;
+  return (const char*)data + LUT_FILE_OFFSET;
+#else
+  return NULL;
+#endif
+}
+
+// write the LUT file of e, through a temporary file so that other
+// processes never map an incomplete file
+static void saveLUTFile(const lut_entry_t* e, const void* table, int element_size, unsigned int elements)
+{
+#ifndef D_API_WIN32
+  if (e->file.empty())
+    return;
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)getpid());
+  std::string tmp = e->file + suffix;
+
+  char header[LUT_FILE_OFFSET];
+  memset(header, 0, LUT_FILE_OFFSET);
+  fillHeader(e, element_size, elements, (lut_file_header_t*)header);
+
+  FILE* f = fopen(tmp.c_str(), "wb");
+  bool ok = f!=NULL;
+  ok = ok && fwrite(header, 1, LUT_FILE_OFFSET, f)==LUT_FILE_OFFSET;
+  ok = ok && fwrite(table, element_size, elements, f)==elements;
+  if (f && fclose(f)!=0)
+    ok = false;
+  if (ok)
+    ok = rename(tmp.c_str(), e->file.c_str())==0;
+  if (!ok)
+  {
+    std::cout << "LUTCache: could not write LUT file " << e->file << std::endl;
+    remove(tmp.c_str());
+  }
+#endif
+}
+
+static void unmapLUTFile(lut_entry_t* e)
+{
+#ifndef D_API_WIN32
+  if (e->mapped)
+    munmap(e->mapped, e->mapped_size);
+#endif
+}
+
+static std::string lutFileName(const std::string& directory, int type, int b0, int b1, int b2, float t0, float t1)
+{
+  // the thresholds are written with all their bits
+  const char* names[3] = { "hist", "dist", "grad" };
+  unsigned int u0, u1;
+  memcpy(&u0, &t0, sizeof(float));
+  memcpy(&u1, &t1, sizeof(float));
+  char name[128];
+  snprintf(name, sizeof(name), "/%s_%d_%d_%d_%08x_%08x.lut", names[type], b0, b1, b2, u0, u1);
+  return directory + name;
+}
+
+template <class T> static void destroyLUT(void* lut)
+{
+  delete (T*) lut;
+}
+
+// the compact LUTs are not saved, their computation is short
+static BGR2HSVhistLUT* createHistLUT(lut_entry_t* e)
+{
+  unsigned int n = 256*256*256;
+  const void* table = loadLUTFile(e, sizeof(unsigned short int), n);
+  if (table)
+    return new BGR2HSVhistLUT(e->bins[0], e->bins[1], e->bins[2], (const unsigned short int*) table);
+  BGR2HSVhistLUT* lut = new BGR2HSVhistLUT(e->bins[0], e->bins[1], e->bins[2], e->thresholds[0], e->thresholds[1], e->variant!=0);
+  if (!e->variant)
+    saveLUTFile(e, lut->bgr_to_hsv_bin, sizeof(unsigned short int), n);
+  return lut;
+}
+
+static BGR2HSVdistLUT* createDistLUT(lut_entry_t* e)
+{
+  unsigned int n = 256*256*256;
+  const void* table = loadLUTFile(e, sizeof(unsigned short int), n);
+  if (table)
+    return new BGR2HSVdistLUT(e->bins[0], e->bins[1], e->bins[2], (const unsigned short int*) table);
+  BGR2HSVdistLUT* lut = new BGR2HSVdistLUT(e->bins[0], e->bins[1], e->bins[2], e->thresholds[0], e->thresholds[1], e->variant!=0);
+  if (!e->variant)
+    saveLUTFile(e, lut->bgr_to_dist, sizeof(unsigned short int), n);
+  return lut;
+}
+
+static GradDispLUT* createGradLUT(lut_entry_t* e)
+{
+  unsigned int n = (2050<<12)+2050;
+  const void* table = loadLUTFile(e, sizeof(unsigned int), n);
+  if (table)
+    return new GradDispLUT(e->bins[0], e->bins[1], (const unsigned int*) table);
+  GradDispLUT* lut = new GradDispLUT(e->bins[0], e->bins[1], e->thresholds[0], e->variant!=0);
+  if (!e->variant)
+    saveLUTFile(e, lut->grad_to_disp, sizeof(unsigned int), n);
+  return lut;
+}
+
+// find or create the LUT, computing it out of the lock so that
+// LUTs with other parameters can be acquired meanwhile
+template <class T> static T* acquireLUT(int type, int b0, int b1, int b2, float t0, float t1, int variant, T* (*create)(lut_entry_t*))
+{
+  lut_entry_t* entry = NULL;
+  {
+    std::unique_lock<std::mutex> lock(cacheMutex);
+    for(std::list<lut_entry_t*>::iterator it=cacheEntries.begin(); it!=cacheEntries.end(); it++)
+    {
+      lut_entry_t* e = *it;
+      if (e->type==type && e->bins[0]==b0 && e->bins[1]==b1 && e->bins[2]==b2 && e->thresholds[0]==t0 && e->thresholds[1]==t1 && e->variant==variant)
+      {
+        entry = e;
+        break;
+      }
+    }
+
+    if (entry)
+    {
+      // already computed, or being computed by another thread
+      entry->refCount++;
+      while (entry->computing)
+        cacheComputed.wait(lock);
+      return (T*) entry->lut;
+    }
+
+    entry = new lut_entry_t;
+    entry->type = type;
+    entry->bins[0] = b0;
+    entry->bins[1] = b1;
+    entry->bins[2] = b2;
+    entry->thresholds[0] = t0;
+    entry->thresholds[1] = t1;
+    entry->variant = variant;
+    entry->lut = NULL;
+    entry->destroy = destroyLUT<T>;
+    entry->refCount = 1;
+    entry->computing = true;
+    if (!variant && !diskCacheDirectory.empty())
+      entry->file = lutFileName(diskCacheDirectory, type, b0, b1, b2, t0, t1);
+    entry->mapped = NULL;
+    entry->mapped_size = 0;
+    cacheEntries.push_back(entry);
+  }
+
+  T* lut = create(entry);
+
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    entry->lut = lut;
+    entry->computing = false;
+  }
+  cacheComputed.notify_all();
+  return lut;
+}
+
+static void releaseLUT(void* lut)
+{
+  if (lut==NULL)
+    return;
+
+  lut_entry_t* entry = NULL;
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for(std::list<lut_entry_t*>::iterator it=cacheEntries.begin(); it!=cacheEntries.end(); it++)
+    {
+      if ((*it)->lut==lut)
+      {
+        if (--(*it)->refCount==0)
+        {
+          entry = *it;
+          cacheEntries.erase(it);
+        }
+        break;
+      }
+    }
+  }
+  if (entry)
+  {
+    entry->destroy(entry->lut);
+    unmapLUTFile(entry);
+    delete entry;
+  }
+}
+
+//---------------------------------------------------------
+
+BGR2HSVhistLUT* LUTCache::acquireHistLUT(int h_bins, int s_bins, int v_bins, float s_threshold, float v_threshold, bool compact)
+{
+  return acquireLUT<BGR2HSVhistLUT>(HIST_LUT, h_bins, s_bins, v_bins, s_threshold, v_threshold, compact, createHistLUT);
+}
+
+BGR2HSVdistLUT* LUTCache::acquireDistLUT(int h_bins, int s_bins, int v_bins, float s_threshold, float v_threshold, bool compact)
+{
+  return acquireLUT<BGR2HSVdistLUT>(DIST_LUT, h_bins, s_bins, v_bins, s_threshold, v_threshold, compact, createDistLUT);
+}
+
+GradDispLUT* LUTCache::acquireGradLUT(int o_bins, int m_bins, float m_threshold, bool compact)
+{
+  return acquireLUT<GradDispLUT>(GRAD_LUT, o_bins, m_bins, 0, m_threshold, 0, compact, createGradLUT);
+}
+
+void LUTCache::release(BGR2HSVhistLUT* lut)
+{
+  releaseLUT(lut);
+}
+
+void LUTCache::release(BGR2HSVdistLUT* lut)
+{
+  releaseLUT(lut);
+}
+
+void LUTCache::release(GradDispLUT* lut)
+{
+  releaseLUT(lut);
+}
+
+void LUTCache::setDiskCache(const std::string& directory)
+{
+#ifdef D_API_WIN32
+  if (!directory.empty())
+    std::cout << "LUTCache::setDiskCache() error: no disk cache on Windows" << std::endl;
+#else
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  diskCacheDirectory = directory;
+#endif
+}
+
+int LUTCache::size()
+{
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  return (int) cacheEntries.size();
+}
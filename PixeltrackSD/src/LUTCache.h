@@ -0,0 +1,82 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TL_LUTCACHE_H
+#define TL_LUTCACHE_H
+
+#include <string>
+#include "BGR2HSVhistLUT.h"
+#include "BGR2HSVdistLUT.h"
+#include "GradDispLUT.h"
+
+/*
+ * Process-wide registry of the colour and gradient LUTs.
+ * The LUTs only depend on their parameters and take 32 MB or more each,
+ * so all the trackers using the same parameters share one copy.
+ * A LUT is computed by its first user and deleted when its last user
+ * releases it. The shared LUTs are read-only.
+ * With a disk cache directory, the full LUTs are saved there when
+ * computed, and mapped from their file instead of computed by the
+ * following processes.
+ * All the functions are thread-safe.
+ */
+class LUTCache
+{
+  public:
+    /*
+     * Get a BGR to HSV histogram bin LUT (see BGR2HSVhistLUT).
+     * @param compact  if true, get the compact version of the LUT.
+     * @return  shared LUT, to be given back with release().
+     */
+    static TLImageProc::BGR2HSVhistLUT* acquireHistLUT(int h_bins, int s_bins, int v_bins, float s_threshold=0.1, float v_threshold=0.2, bool compact=false);
+
+    /*
+     * Get a BGR to HSV bin LUT of the pixel model (see BGR2HSVdistLUT).
+     * @param compact  if true, get the compact version of the LUT.
+     * @return  shared LUT, to be given back with release().
+     */
+    static BGR2HSVdistLUT* acquireDistLUT(int h_bins, int s_bins, int v_bins, float s_threshold=0.1, float v_threshold=0.2, bool compact=false);
+
+    /*
+     * Get a gradient bin LUT (see GradDispLUT).
+     * @param compact  if true, get the compact version of the LUT.
+     * @return  shared LUT, to be given back with release().
+     */
+    static GradDispLUT* acquireGradLUT(int o_bins, int m_bins, float m_threshold=50, bool compact=false);
+
+    /*
+     * Give back a LUT, it is deleted when it has no user left.
+     * NULL is ignored.
+     */
+    static void release(TLImageProc::BGR2HSVhistLUT* lut);
+    static void release(BGR2HSVdistLUT* lut);
+    static void release(GradDispLUT* lut);
+
+    /*
+     * Set the directory of the LUT files, created by the caller.
+     * An empty name disables the disk cache (default). Only the LUTs
+     * acquired afterwards are concerned. Not available on Windows.
+     */
+    static void setDiskCache(const std::string& directory);
+
+    /*
+     * Number of LUTs in memory.
+     */
+    static int size();
+};
+
+#endif
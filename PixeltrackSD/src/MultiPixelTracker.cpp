@@ -0,0 +1,250 @@
+
+#include "MultiPixelTracker.h"
+
+#include "Output.h"
+#include "HSVPixelGradientModel.h"
+#include "ThreadPool.h"
+
+//---------------------------------------------------------
+
+MultiPixelTracker::MultiPixelTracker( float _detector_update_factor, float _segmentation_update_factor, float _search_size, int _nthreads)
+{
+	detector_update_factor = _detector_update_factor;
+	segmentation_update_factor = _segmentation_update_factor;
+	search_size = _search_size;
+	colour_binning = PixelTracker::FULL_LUT;
+	gradient_binning = PixelTracker::FULL_LUT;
+	windowed_maps = false;
+	roi_preprocessing = true;
+	scale_count = 1;
+	scale_step = 0.05;
+	scale_update = 0.5;
+
+	pool = new TLUtil::ThreadPool(_nthreads);
+
+	// created with the first image
+	binning_model = NULL;
+	grey_img = NULL;
+	xgrad_img = NULL;
+	ygrad_img = NULL;
+	bin_img = NULL;
+
+	next_id = 0;
+	width = 0;
+	height = 0;
+	current_frame = 0;
+	firstImage = true;
+}
+
+//---------------------------------------------------------
+
+MultiPixelTracker::~MultiPixelTracker()
+{
+	for(unsigned int t = 0; t < targets.size(); t++)
+		delete targets[t].tracker;
+	delete pool;
+	delete binning_model;
+	delete grey_img;
+	delete xgrad_img;
+	delete ygrad_img;
+	delete bin_img;
+}
+
+//---------------------------------------------------------
+
+void MultiPixelTracker::setColourBinning(int mode)
+{
+	if( ! firstImage )
+	{
+		std::cout << "MultiPixelTracker::setColourBinning() error: must be called before the first image." << std::endl;
+		return;
+	}
+	colour_binning = mode;
+}
+
+//---------------------------------------------------------
+
+void MultiPixelTracker::setGradientBinning(int mode)
+{
+	if( ! firstImage )
+	{
+		std::cout << "MultiPixelTracker::setGradientBinning() error: must be called before the first image." << std::endl;
+		return;
+	}
+	gradient_binning = mode;
+}
+
+//---------------------------------------------------------
+
+void MultiPixelTracker::setWindowedMaps(bool windowed)
+{
+	if( ! firstImage )
+	{
+		std::cout << "MultiPixelTracker::setWindowedMaps() error: must be called before the first image." << std::endl;
+		return;
+	}
+	windowed_maps = windowed;
+}
+
+//---------------------------------------------------------
+
+int MultiPixelTracker::addTarget( int bbox_x, int bbox_y, int bbox_width, int bbox_height)
+{
+	target_t target;
+	target.id = next_id++;
+	target.tracker = new PixelTracker(bbox_x, bbox_y, bbox_width, bbox_height, detector_update_factor, segmentation_update_factor, search_size);
+	target.tracker->setColourBinning(colour_binning);
+	target.tracker->setGradientBinning(gradient_binning);
+	target.tracker->setWindowedMaps(windowed_maps);
+	target.tracker->setScaleSearch(scale_count, scale_step, scale_update);
+	target.tracker->shared_images = true;
+	target.started = false;
+	targets.push_back(target);
+	return target.id;
+}
+
+//---------------------------------------------------------
+
+void MultiPixelTracker::removeTarget(int id)
+{
+	for(unsigned int t = 0; t < targets.size(); t++)
+	{
+		if( targets[t].id == id )
+		{
+			delete targets[t].tracker;
+			targets.erase(targets.begin()+t);
+			return;
+		}
+	}
+	std::cout << "MultiPixelTracker::removeTarget() error: unknown target " << id << "." << std::endl;
+}
+
+//---------------------------------------------------------
+
+TLImageProc::Rectangle *MultiPixelTracker::getCurBb(int id)
+{
+	for(unsigned int t = 0; t < targets.size(); t++)
+		if( targets[t].id == id )
+			return targets[t].tracker->getCurBb();
+	return NULL;
+}
+
+//---------------------------------------------------------
+
+void MultiPixelTracker::preprocess(TLImageProc::Image<unsigned char> *image, TLImageProc::Rectangle roi)
+{
+	PixelTracker::computeGradients(image, roi, grey_img, xgrad_img, ygrad_img);
+	binning_model->computeBins(image, xgrad_img, ygrad_img, roi, bin_img);
+}
+
+//---------------------------------------------------------
+
+bool MultiPixelTracker::searchWindowsBox(TLImageProc::Rectangle& box)
+{
+	bool found = false;
+	for(unsigned int t = 0; t < targets.size(); t++)
+	{
+		if( targets[t].tracker->firstImage || targets[t].started )
+			continue;
+		if( found )
+			box.outerBoundingBox(*targets[t].tracker->search_window);
+		else
+			box = *targets[t].tracker->search_window;
+		found = true;
+	}
+	return found;
+}
+
+//---------------------------------------------------------
+
+void MultiPixelTracker::process(TLImageProc::Image<unsigned char> *image, int frameId, int time1, int time2)
+{
+	if( firstImage )
+	{
+		width = image->width();
+		height = image->height();
+		grey_img = new Image<unsigned char>(width, height, 1);
+		xgrad_img = new Image<short>(width, height, 1);
+		ygrad_img = new Image<short>(width, height, 1);
+		bin_img = new Image<unsigned short>(width, height, 1);
+		// the image borders have no gradient
+		xgrad_img->setZero();
+		ygrad_img->setZero();
+		binning_model = PixelTracker::createModel(colour_binning, gradient_binning);
+		firstImage = false;
+	}
+	else
+		current_frame++;
+
+	if( image->width() != width || image->height() != height )
+	{
+		std::cout << "MultiPixelTracker::process() error: all the images must have the same size." << std::endl;
+		return;
+	}
+
+	// the new targets are initialised on the whole image
+	bool new_targets = false;
+	for(unsigned int t = 0; t < targets.size(); t++)
+	{
+		PixelTracker *tracker = targets[t].tracker;
+		targets[t].started = false;
+		if( tracker->firstImage )
+		{
+			tracker->grey_img = grey_img;
+			tracker->xgrad_img = xgrad_img;
+			tracker->ygrad_img = ygrad_img;
+			tracker->bin_img = bin_img;
+			new_targets = true;
+		}
+	}
+
+	Rectangle full(width, height);
+	Rectangle roi = full;
+	bool preprocessed = true;
+	if( roi_preprocessing && ! new_targets )
+		preprocessed = searchWindowsBox(roi);
+	if( preprocessed )
+		preprocess(image, roi);
+
+	// vote and segment (or initialise) in parallel
+	pool->run(targets.size(), [&](int t) {
+		PixelTracker *tracker = targets[t].tracker;
+		if( tracker->firstImage )
+		{
+			tracker->processFirstImage(image, frameId, time1, time2);
+			tracker->firstImage = false;
+			targets[t].started = true;
+		}
+		else
+		{
+			tracker->current_frame++;
+			tracker->locate(image);
+		}
+	});
+
+	// the search windows have moved: complete the preprocessing
+	Rectangle new_roi;
+	if( searchWindowsBox(new_roi) )
+	{
+		new_roi.intersection(full);
+		Rectangle covered = new_roi;
+		covered.intersection(roi);
+		if( ! preprocessed || covered.area() != new_roi.area() )
+			preprocess(image, new_roi);
+	}
+
+	// update the models in parallel
+	pool->run(targets.size(), [&](int t) {
+		if( ! targets[t].started )
+			targets[t].tracker->updateModels(image);
+	});
+
+	// send tracking results to the outputs
+	int iter = (frameId != -1) ? frameId : current_frame;
+	for(unsigned int o = 0; o < outputs.size(); o++)
+	{
+		for(unsigned int t = 0; t < targets.size(); t++)
+			outputs[o]->sendBB(targets[t].tracker->getCurBb(), targets[t].id, 0, 1.0);
+		outputs[o]->commit( iter, time1, time2);
+	}
+}
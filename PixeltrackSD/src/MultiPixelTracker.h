@@ -0,0 +1,144 @@
+
+#ifndef MULTIPIXELTRACKER_H
+#define MULTIPIXELTRACKER_H
+
+#include <vector>
+
+#include "PixelTracker.h"
+
+namespace TLUtil
+{
+	class ThreadPool;
+}
+
+/*
+ * Tracker of several objects in the same video.
+ * The grey, gradient and model bin images are computed once per image
+ * for all the targets, only in their search windows by default. The
+ * targets are then tracked in parallel threads. Each target gives the
+ * same results as a PixelTracker alone.
+ */
+class DLL_EXPORT MultiPixelTracker
+{
+	public:
+		/*
+		 * Constructor.
+		 * @param _detector_update_factor, _segmentation_update_factor, _search_size  see PixelTracker
+		 * @param _nthreads  number of tracking threads, number of cores if <= 0
+		 */
+		MultiPixelTracker( float _detector_update_factor, float _segmentation_update_factor, float _search_size, int _nthreads = 0);
+
+		/*
+		 * Destructor.
+		 */
+		~MultiPixelTracker();
+
+		/*
+		 * Select the binning implementations of all the targets, before
+		 * the first image (see PixelTracker).
+		 */
+		void setColourBinning(int mode);
+		void setGradientBinning(int mode);
+
+		/*
+		 * Keep the maps of each target in buffers sized to its search
+		 * window, before the first image (see PixelTracker). The grey,
+		 * gradient and bin images stay shared.
+		 */
+		void setWindowedMaps(bool windowed);
+
+		/*
+		 * Compute the grey, gradient and bin images only in the search
+		 * windows of the targets (default), or in the whole images.
+		 */
+		void setRoiPreprocessing(bool roi)  { roi_preprocessing = roi; }
+
+		/*
+		 * Adapt the size of the bounding boxes of the targets added
+		 * afterwards (see PixelTracker::setScaleSearch()).
+		 */
+		void setScaleSearch(int nscales, float step = 0.05, float update = 0.5)  { scale_count = nscales; scale_step = step; scale_update = update; }
+
+		/*
+		 * Send the bounding boxes of all the targets of each image to out,
+		 * with their identifiers (see PixelTracker::addOutput()).
+		 */
+		void addOutput(TLInOut::Output* out)  { outputs.push_back(out); }
+
+		/*
+		 * Add an object to track from the next image.
+		 * @return  target identifier.
+		 */
+		int addTarget( int bbox_x, int bbox_y, int bbox_width, int bbox_height);
+
+		/*
+		 * Stop tracking an object.
+		 * @param id  target identifier.
+		 */
+		void removeTarget(int id);
+
+		int getNbTargets(void)  { return targets.size(); }
+		int getTargetId(int index)  { return targets[index].id; }
+
+		/*
+		 * Get last processing result of a target.
+		 * @return  bounding box around tracked object, NULL if unknown target.
+		 */
+		TLImageProc::Rectangle *getCurBb(int id);
+
+		/*
+		 * Track the objects in image.
+		 * @param  see PixelTracker::process(...) function.
+		 */
+		void process(TLImageProc::Image<unsigned char> *image, int frameId = -1, int time1 = 0, int time2 = 0);
+
+	protected:
+		typedef struct target_t
+		{
+			int id;
+			PixelTracker *tracker;
+			bool started; // first image processed in the current image
+		} target_t;
+
+		/*
+		 * Compute the grey, gradient and bin images in roi.
+		 */
+		void preprocess(TLImageProc::Image<unsigned char> *image, TLImageProc::Rectangle roi);
+
+		/*
+		 * Smallest rectangle containing the search windows of the targets
+		 * being tracked (not initialised in the current image).
+		 * @return  false if there is no such target.
+		 */
+		bool searchWindowsBox(TLImageProc::Rectangle& box);
+
+		float detector_update_factor;
+		float segmentation_update_factor;
+		float search_size;
+		int colour_binning;
+		int gradient_binning;
+		bool windowed_maps;
+		bool roi_preprocessing;
+		int scale_count;
+		float scale_step;
+		float scale_update;
+
+		bool firstImage; // first image flag
+		int current_frame; // images counter
+		int width; // images width
+		int height; // images height
+
+		std::vector<target_t> targets;
+		int next_id;
+		TLUtil::ThreadPool *pool;
+		std::vector<TLInOut::Output*> outputs;
+
+		// bins of the models of the targets (all the same)
+		HSVPixelGradientModel *binning_model;
+		Image<unsigned char> *grey_img;
+		Image<short> *xgrad_img;
+		Image<short> *ygrad_img;
+		Image<unsigned short> *bin_img;
+};
+
+#endif // MULTIPIXELTRACKER_H
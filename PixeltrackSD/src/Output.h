@@ -40,6 +40,9 @@ typedef struct faceinfo_
   float confidence;		// confidence value [0, 1.0]
 } faceinfo_t;
 
+// stdio buffer of the file outputs (written when full and when closed)
+const int OUTPUT_FILE_BUFFER_SIZE = 1<<16;
+
 enum OutputType { OutputFile=1 };
 int string2Output(char* str, int& result, int& nb_outputs);
 
@@ -55,10 +58,23 @@ class Output
     virtual int sendBB(TLImageProc::Rectangle* bb, int identifier, float pan, float confidence)=0;
     virtual int sendBB(int tl_x, int tl_y, int tr_x, int tr_y, int bl_x, int bl_y, int br_x, int br_y, int identifier, float pan, float confidence) { return 0; }
     virtual int commit(int iter, unsigned long long timestamp, long long vce_timestamp)=0;
+    // write the buffered results, if any
+    virtual void flush() {}
     void setCoordinateScale(float ws, float hs) { mfWidthScale=ws; mfHeightScale=hs; };
 };
 
 
+/*
+ * Output discarding the results.
+ */
+class OutputNull : public Output
+{
+  public:
+    int sendBB(TLImageProc::Rectangle* bb, int identifier, float pan, float confidence) { return 0; }
+    int commit(int iter, unsigned long long timestamp, long long vce_timestamp) { return 0; }
+};
+
+
 
 }
 
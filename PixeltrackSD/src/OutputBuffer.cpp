@@ -0,0 +1,79 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include "OutputBuffer.h"
+#include "util.h"
+
+namespace TLInOut
+{
+
+OutputBuffer::OutputBuffer(int capacity) : m_Results(capacity > 0 ? capacity : 1)
+{
+  m_iFirst = 0;
+  m_iCount = 0;
+  m_iPending = 0;
+}
+
+
+int OutputBuffer::sendBB(TLImageProc::Rectangle* bb, int identifier, float pan, float confidence)
+{
+  return sendBB(bb->miFirstColumn, bb->miFirstLine, bb->lastColumn(), bb->miFirstLine, bb->miFirstColumn, bb->lastLine(), bb->lastColumn(), bb->lastLine(), identifier, pan, confidence);
+}
+
+int OutputBuffer::sendBB(int tl_x, int tl_y, int tr_x, int tr_y, int bl_x, int bl_y, int br_x, int br_y, int identifier, float pan, float confidence)
+{
+  if (identifier<0)
+    return 0;
+
+  // the oldest result is replaced when the ring is full
+  int capacity = m_Results.size();
+  if (m_iCount+m_iPending==capacity)
+  {
+    if (m_iCount==0)
+      return -1;
+    m_iFirst = (m_iFirst+1) % capacity;
+    m_iCount--;
+  }
+
+  result_t& res = m_Results[(m_iFirst+m_iCount+m_iPending) % capacity];
+  res.id = identifier;
+  res.bb = TLImageProc::Rectangle(int(round(tl_x*mfWidthScale)), int(round(tl_y*mfHeightScale)), int(round(br_x*mfWidthScale)), int(round(br_y*mfHeightScale)));
+  res.pan = pan;
+  res.confidence = confidence;
+
+  m_iPending++;
+  return 0;
+}
+
+
+int OutputBuffer::commit(int iter, unsigned long long timestamp, long long vce_timestamp)
+{
+  int capacity = m_Results.size();
+  for(int i=0; i<m_iPending; i++)
+  {
+    result_t& res = m_Results[(m_iFirst+m_iCount+i) % capacity];
+    res.iter = iter;
+    res.timestamp = timestamp;
+  }
+  m_iCount += m_iPending;
+  m_iPending = 0;
+  return 0;
+}
+
+
+}
@@ -0,0 +1,70 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TL_OUTPUTBUFFER_H
+#define TL_OUTPUTBUFFER_H
+
+#include <vector>
+
+#include "Rectangle.h"
+#include "Output.h"
+
+
+namespace TLInOut
+{
+
+  typedef struct result_
+  {
+    int iter;                       // frame number
+    unsigned long long timestamp;   // frame time
+    int id;                         // object ID
+    TLImageProc::Rectangle bb;      // bounding box
+    float pan;
+    float confidence;
+  } result_t;
+
+  /*
+   * Output keeping the last results in memory, for a program embedding
+   * the tracker. The results are stored in a ring of capacity entries
+   * (one per object and frame) allocated once: the oldest ones are
+   * replaced when it is full. Not synchronised: read the results
+   * between the calls to the tracker.
+   */
+  class OutputBuffer : public Output
+  {
+    public:
+      OutputBuffer(int capacity);
+
+      int sendBB(TLImageProc::Rectangle* bb, int identifier, float pan, float confidence);
+      int sendBB(int tl_x, int tl_y, int tr_x, int tr_y, int bl_x, int bl_y, int br_x, int br_y, int identifier, float pan, float confidence);
+      int commit(int iter, unsigned long long timestamp, long long vce_timestamp);
+
+      // number of committed results
+      int size() const  { return m_iCount; }
+      // committed result, from 0 (oldest) to size()-1 (newest)
+      const result_t& get(int index) const  { return m_Results[(m_iFirst+index) % m_Results.size()]; }
+      void clear()  { m_iFirst = 0; m_iCount = 0; m_iPending = 0; }
+
+    private:
+      std::vector<result_t> m_Results;
+      int m_iFirst;
+      int m_iCount;
+      int m_iPending;  // results sent after the committed ones
+  };
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <math.h>
+#include "Rectangle.h"
+#include "OutputCSVFile.h"
+#include "util.h"
+
+namespace TLInOut
+{
+
+OutputCSVFile::OutputCSVFile(const char* filename)
+{
+  m_cFileName = new char[(int)strlen(filename)+1];
+  strcpy(m_cFileName, filename);
+
+  m_File = fopen(m_cFileName, "w");
+  if (m_File==NULL)
+  {
+    printf("Error: log file %s cannot be opened.\n", m_cFileName);
+    exit(-1);
+  }
+  setvbuf(m_File, NULL, _IOFBF, OUTPUT_FILE_BUFFER_SIZE);
+  fprintf(m_File, "frame,timestamp,id,x,y,width,height,confidence\n");
+
+  m_iCurrentNbPersons = 0;
+}
+
+
+int OutputCSVFile::sendBB(TLImageProc::Rectangle* bb, int identifier, float pan, float confidence)
+{
+  return sendBB(bb->miFirstColumn, bb->miFirstLine, bb->lastColumn(), bb->miFirstLine, bb->miFirstColumn, bb->lastLine(), bb->lastColumn(), bb->lastLine(), identifier, pan, confidence);
+}
+
+int OutputCSVFile::sendBB(int tl_x, int tl_y, int tr_x, int tr_y, int bl_x, int bl_y, int br_x, int br_y, int identifier, float pan, float confidence)
+{
+  if (identifier<0 || m_iCurrentNbPersons>=200)
+    return 0;
+
+  faceinfo_t& face = faceinfo[m_iCurrentNbPersons];
+  face.id = identifier;
+  face.tl_x = round(tl_x*mfWidthScale);
+  face.tl_y = round(tl_y*mfHeightScale);
+  face.tr_x = round(tr_x*mfWidthScale);
+  face.tr_y = round(tr_y*mfHeightScale);
+  face.bl_x = round(bl_x*mfWidthScale);
+  face.bl_y = round(bl_y*mfHeightScale);
+  face.br_x = round(br_x*mfWidthScale);
+  face.br_y = round(br_y*mfHeightScale);
+  face.pan = pan;
+  face.confidence = confidence;
+
+  m_iCurrentNbPersons++;
+  return 0;
+}
+
+
+int OutputCSVFile::commit(int iter, unsigned long long timestamp, long long vce_timestamp)
+{
+  setlocale(LC_NUMERIC, "C");
+
+  for(int i=0; i<m_iCurrentNbPersons; i++)
+    fprintf(m_File, "%d,%llu,%d,%d,%d,%d,%d,%g\n", iter, timestamp, faceinfo[i].id, faceinfo[i].tl_x, faceinfo[i].tl_y, faceinfo[i].br_x-faceinfo[i].tl_x, faceinfo[i].br_y-faceinfo[i].tl_y, faceinfo[i].confidence);
+
+  m_iCurrentNbPersons=0;
+  return 0;
+}
+
+void OutputCSVFile::flush()
+{
+  fflush(m_File);
+}
+
+OutputCSVFile::~OutputCSVFile()
+{
+  fclose(m_File);
+  delete [] m_cFileName;
+}
+
+
+}
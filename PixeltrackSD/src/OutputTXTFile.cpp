@@ -37,6 +37,7 @@ OutputTXTFile::OutputTXTFile(const char* filename, int skip_frames/*=0*/) //, in
     printf("Error: log file %s cannot be opened.\n", m_cFileName);
     exit(-1);
   }
+  setvbuf(m_File, NULL, _IOFBF, OUTPUT_FILE_BUFFER_SIZE);
   fprintf(m_File, "# frame number_objects obj1_id obj1_topleft_x obj1_topleft_y obj1_width obj1_height obj2_id ... \n");
 
   m_iLastNbPersons = 0;
@@ -93,8 +94,6 @@ int OutputTXTFile::commit(int iter, unsigned long long timestamp, long long vce_
     fprintf(m_File, "%d ", faceinfo[i].id);
 
     fprintf(m_File, "%d %d %d %d ", faceinfo[i].tl_x, faceinfo[i].tl_y, faceinfo[i].br_x-faceinfo[i].tl_x, faceinfo[i].br_y-faceinfo[i].tl_y);
-
-    fflush(m_File);
   }
   fprintf(m_File, "\n");
 
@@ -104,6 +103,11 @@ int OutputTXTFile::commit(int iter, unsigned long long timestamp, long long vce_
   return 0;
 }
 
+void OutputTXTFile::flush()
+{
+  fflush(m_File);
+}
+
 OutputTXTFile::~OutputTXTFile()
 {
   fclose(m_File);
@@ -42,6 +42,7 @@ namespace TLInOut
       int sendBB(TLImageProc::Rectangle* bb, int identifier, float pan, float confidence);
       int sendBB(int tl_x, int tl_y, int tr_x, int tr_y, int bl_x, int bl_y, int br_x, int br_y, int identifier, float pan, float confidence);
       int commit(int iter, unsigned long long timestamp, long long vce_timestamp);
+      void flush();
  
   };
 }
@@ -37,6 +37,7 @@ OutputXMLFile::OutputXMLFile(const char* filename, int skip_frames/*=0*/) //, in
     printf("Error: log file %s cannot be opened.\n", m_cFileName);
     exit(-1);
   }
+  setvbuf(m_File, NULL, _IOFBF, OUTPUT_FILE_BUFFER_SIZE);
   fprintf(m_File, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
   fprintf(m_File, "<!DOCTYPE analysisresult SYSTEM \"analysisresult_v0_1.dtd\">\n");
   fprintf(m_File, "<analysisresult>\n");
@@ -104,8 +105,6 @@ int OutputXMLFile::commit(int iter, unsigned long long timestamp, long long vce_
     //fprintf(m_File, "<smoothness>0</smoothness>\n");
     fprintf(m_File, "</value>\n");
     fprintf(m_File, "</event>\n\n\n");
-
-    fflush(m_File);
   }
 
 
@@ -115,6 +114,11 @@ int OutputXMLFile::commit(int iter, unsigned long long timestamp, long long vce_
   return 0;
 }
 
+void OutputXMLFile::flush()
+{
+  fflush(m_File);
+}
+
 OutputXMLFile::~OutputXMLFile()
 {
   fprintf(m_File, "\n\n\n\n</analysisresult>\n");
@@ -0,0 +1,66 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TL_PARALLEL_H
+#define TL_PARALLEL_H
+
+#include <thread>
+#include <vector>
+
+namespace TLUtil
+{
+
+/*
+ * Number of threads the hardware runs concurrently (at least 1).
+ */
+inline int hardwareThreads()
+{
+  int n = std::thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+/*
+ * Split [begin,end[ into contiguous ranges and call f(first, last)
+ * on each range, in parallel threads. The calling thread processes
+ * the last range. Returns when all the ranges are processed.
+ * @param nthreads  number of threads, hardwareThreads() if <= 0.
+ */
+template <class F> void parallelFor(int begin, int end, F f, int nthreads=0)
+{
+  if (nthreads <= 0)
+    nthreads = hardwareThreads();
+  if (nthreads > end-begin)
+    nthreads = end-begin;
+  if (nthreads <= 1)
+  {
+    if (end > begin)
+      f(begin, end);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  int n = end-begin;
+  for(int t=0; t<nthreads-1; t++)
+    threads.push_back(std::thread(f, begin + n*t/nthreads, begin + n*(t+1)/nthreads));
+  f(begin + n*(nthreads-1)/nthreads, end);
+  for(unsigned int t=0; t<threads.size(); t++)
+    threads[t].join();
+}
+
+}
+
+#endif
@@ -33,7 +33,11 @@ PixelClassColourModel::PixelClassColourModel(BGR2HSVhistLUT** lut, int h_bins, i
     mUpdateHist[i] = new Histogram(h_bins, s_bins, v_bins, _niScales, imgw, imgh);
   }
   mLUT = lut;
+  miLineWidth = imgw;
+  mLineBins.resize(_niScales*imgw);
   mfMeanFGVoteErr = -1;
+  miGridStep = 1;
+  miEvalScales = _niScales;
 }
 
 PixelClassColourModel::~PixelClassColourModel()
@@ -45,6 +49,19 @@ PixelClassColourModel::~PixelClassColourModel()
   }
 }
 
+// the LUT mode is chosen once per line and scale, not for each pixel
+void PixelClassColourModel::lineBins(const unsigned char* bgr, int n, int step, int nscales)
+{
+  for(int s=0; s<nscales; s++)
+    mLUT[s]->hsv_bins(bgr, n, step, &mLineBins[s*miLineWidth]);
+}
+
+void PixelClassColourModel::setEvaluationQuality(int step, int nscales)
+{
+  miGridStep = max(1, step);
+  miEvalScales = max(1, min(nscales, mHist[0]->niScales));
+}
+
 void PixelClassColourModel::setVoteErrParameters(float mean_pos, float var_pos, float mean_neg, float var_neg)
 {
   mfMeanFGVoteErr = mean_pos;
@@ -116,23 +133,23 @@ void PixelClassColourModel::update(Image8U* img, Rectangle* outer_bb, Image<floa
 
   float sigmax = outer_bb->miWidth/8;;
   float sigmay = outer_bb->miHeight/8;;
-  float dx, dy;
   int rw2=outer_bb->miWidth/2, rh2=outer_bb->miHeight/2;
-  Rectangle imgbb(0,0,bp_img->width()-1,bp_img->height()-1);
+  // weights of the unclipped box, from its first pixel
+  int kw = outer_bb->miWidth;
+  const float* kernel = mUpdateKernel.weights(kw, outer_bb->miHeight, rw2, rh2, sigmax, sigmay, 0.7);
+  Rectangle imgbb(0,0,img->width()-1,img->height()-1);
   outer_bb->intersection(imgbb);
   int si, sj, si0, sj0;;
   int ll = outer_bb->lastLine(), lc = outer_bb->lastColumn();
-  double spatial_prior;
+  float* bpptr;
   si0=0;
   for(si=outer_bb->miFirstLine; si<=ll; si++)
   {
-    dy = si0-rh2;
+    bpptr = bp_img->data(outer_bb->miFirstColumn, si);
     sj0=0;
     for(sj=outer_bb->miFirstColumn; sj<=lc; sj++)
     {
-      dx = sj0-rw2;
-      spatial_prior = 0.7*exp(-0.5*(dx*dx/sigmax/sigmax+dy*dy/sigmay/sigmay)); 
-      bp_img->add(sj, si, spatial_prior);
+      *bpptr++ += kernel[si0*kw + sj0];
       sj0++;
     }
     si0++;
@@ -151,6 +168,49 @@ void PixelClassColourModel::update(Image8U* img, Rectangle* outer_bb, Image<floa
 }
 
 
+// Per bin tables of evaluateColour() and evaluateColourWithPrior(),
+// computed for each image from the current histograms. The factors are
+// the ones the pixel formulas give, with the same rounding.
+void PixelClassColourModel::computePosteriors()
+{
+  int nscales = mHist[0]->niScales;
+  mScaleStart.resize(nscales+1);
+  mScaleStart[0] = 0;
+  for(int s=0; s<nscales; s++)
+    mScaleStart[s+1] = mScaleStart[s] + mHist[0]->hsv_count[s].size();
+  mBins.resize(mScaleStart[nscales]);
+  mColourRatio.resize(mScaleStart[nscales]);
+
+  float trans_fg_to_fg = 0.4; // transition probability from FG to FG
+  float trans_bg_to_bg = 0.6; // transition probability from BG to BG
+  for(int s=0; s<nscales; s++)
+  {
+    const float* fg = &mHist[0]->hsv_count[s][0];
+    const float* bg = &mHist[1]->hsv_count[s][0];
+    for(int i=0, k=mScaleStart[s]; k<mScaleStart[s+1]; i++, k++)
+    {
+      colour_bin_t& c = mBins[k];
+      c.fg = fg[i];
+      c.bg = bg[i];
+
+      // with a prior of 0 or 1, the prior terms of evaluateColourWithPrior()
+      // are exactly fg*trans_fg_to_fg and bg*trans_bg_to_bg
+      float ttmp = c.fg*trans_fg_to_fg;
+      float ttmp_neg = c.bg*trans_bg_to_bg;
+      if (ttmp+ttmp_neg>0)
+	c.fg_posterior = ttmp / (ttmp + ttmp_neg);
+      else
+	c.fg_posterior = 0.0;
+
+      float colour_prob = c.fg*FG_PRIOR_PROBABILITY + c.bg*(1.0-FG_PRIOR_PROBABILITY);
+      if (colour_prob>0)
+	mColourRatio[k] = c.fg*FG_PRIOR_PROBABILITY/colour_prob;
+      else
+	mColourRatio[k] = 0.0;
+    }
+  }
+}
+
 void PixelClassColourModel::evaluateColour(Image8U* img, Rectangle* roi, bool use_spatial_prior, Image<float>* result)
 {
   int lastline, lastcol;
@@ -162,7 +222,6 @@ void PixelClassColourModel::evaluateColour(Image8U* img, Rectangle* roi, bool us
   roi->intersection(imgBB); 
   lastline = roi->lastLine();
   lastcol = roi->lastColumn();
-  unsigned char r, g, b;
   float xtrans, ytrans;
   int si, sj;
   int xgrid_step = 1; //max(1,roi->miWidth/30);
@@ -171,12 +230,10 @@ void PixelClassColourModel::evaluateColour(Image8U* img, Rectangle* roi, bool us
   int rws = result->widthStep();
   int roinx = roi->miWidth/xgrid_step;
   int roiny = roi->miHeight/ygrid_step;
-  int pixelstep = (xgrid_step-1)*3;
   int rpixelstep = (xgrid_step);
-  int xstep = ws-xgrid_step*roinx*3 + (ygrid_step-1)*ws;
   int rxstep = rws-xgrid_step*roinx + (ygrid_step-1)*rws;
   unsigned char* iptr = (unsigned char*)img->data()+roi->miFirstLine*ws + roi->miFirstColumn*3;
-  float* resptr = result->data()+roi->miFirstLine*rws + roi->miFirstColumn;
+  float* resptr = result->data(roi->miFirstColumn, roi->miFirstLine);
   float colour_prob;
   float spatial_prior;
   float dx, dy;
@@ -184,44 +241,49 @@ void PixelClassColourModel::evaluateColour(Image8U* img, Rectangle* roi, bool us
   float sigmax = roi->miWidth/4;;
   float sigmay = roi->miHeight/4;;
   float tmpres;
+  int nscales = mHist[0]->niScales;
+
+  computePosteriors();
+  const colour_bin_t* bins = mBins.data();
+  const double* ratio = mColourRatio.data();
+  const int* start = mScaleStart.data();
+  // bins of the current line, pixel_bins[s*w+sj] at scale s
+  const unsigned short* pixel_bins = mLineBins.data();
+  int w = miLineWidth;
 
   for(si=0; si<roiny; si++)
   {
     dy = si-rh2;
+    lineBins(iptr, roinx, xgrid_step, nscales);
     for(sj=0; sj<roinx; sj++)
     {
+
+      tmpres=1.0;
       if (use_spatial_prior)
       {
 	dx = sj-rw2;
 	spatial_prior = exp(-0.5*(dx*dx/sigmax/sigmax+dy*dy/sigmay/sigmay)); ///(2*M_PI*sigmax*sigmay);
+	for(int s=0; s<nscales; s++)
+	{
+	  const colour_bin_t& c = bins[start[s] + pixel_bins[s*w+sj]];
+	  colour_prob = spatial_prior*c.fg*FG_PRIOR_PROBABILITY + (1.0-spatial_prior)*c.bg*(1.0-FG_PRIOR_PROBABILITY);
+	  if (colour_prob>0)
+	    tmpres *= spatial_prior*c.fg*FG_PRIOR_PROBABILITY/colour_prob;
+	  else
+	    tmpres = 0.0;
+	}
       }
-
-      b = *iptr++; 
-      g = *iptr++;
-      r = *iptr++;
-
-      tmpres=1.0;
-      for(int s=0; s<mHist[0]->niScales; s++)
-      {
-      index = mLUT[s]->hsv_bin(r,g,b);
-      if (use_spatial_prior)
-	colour_prob = spatial_prior*mHist[0]->hsv_count[s][index]*FG_PRIOR_PROBABILITY + (1.0-spatial_prior)*mHist[1]->hsv_count[s][index]*(1.0-FG_PRIOR_PROBABILITY);
-      else
-	colour_prob = mHist[0]->hsv_count[s][index]*FG_PRIOR_PROBABILITY + mHist[1]->hsv_count[s][index]*(1.0-FG_PRIOR_PROBABILITY);
-      if (colour_prob>0)
-	if (use_spatial_prior)
-	  tmpres *= spatial_prior*mHist[0]->hsv_count[s][index]*FG_PRIOR_PROBABILITY/colour_prob;
-	else
-	  tmpres *= mHist[0]->hsv_count[s][index]*FG_PRIOR_PROBABILITY/colour_prob;
       else
-	tmpres = 0.0;
+      {
+	// the ratio is 0 for the empty bins
+	for(int s=0; s<nscales; s++)
+	  tmpres *= ratio[start[s] + pixel_bins[s*w+sj]];
       }
       *resptr = tmpres;
 
-      iptr+=pixelstep;
       resptr+=rpixelstep;
     }
-    iptr+=xstep;
+    iptr+=ygrid_step*ws;
     resptr+=rxstep;
   }
   
@@ -238,21 +300,19 @@ void PixelClassColourModel::evaluateColourWithPrior(Image8U* img, Rectangle* roi
   roi->intersection(imgBB); 
   lastline = roi->lastLine();
   lastcol = roi->lastColumn();
-  unsigned char r, g, b;
   float xtrans, ytrans;
   int si, sj;
-  int xgrid_step = 1; //max(1,roi->miWidth/30);
-  int ygrid_step = 1; //max(1,roi->miHeight/30);
+  int xgrid_step = miGridStep;
+  int ygrid_step = miGridStep;
   int ws = img->widthStep();
   int rws = result->widthStep();
   int roinx = roi->miWidth/xgrid_step;
   int roiny = roi->miHeight/ygrid_step;
-  int pixelstep = (xgrid_step-1)*3;
   int rpixelstep = (xgrid_step);
-  int xstep = ws-xgrid_step*roinx*3 + (ygrid_step-1)*ws;
   int rxstep = rws-xgrid_step*roinx + (ygrid_step-1)*rws;
   unsigned char* iptr = (unsigned char*)img->data()+roi->miFirstLine*ws + roi->miFirstColumn*3;
-  float* resptr = result->data()+roi->miFirstLine*rws + roi->miFirstColumn;
+  float* resptr = result->data(roi->miFirstColumn, roi->miFirstLine);
+  float* priorptr;
   float colour_prob;
   float spatial_prior;
   float dx, dy;
@@ -262,68 +322,82 @@ void PixelClassColourModel::evaluateColourWithPrior(Image8U* img, Rectangle* roi
   int i, j;
   float prior_val;
   float tmpres;
+  float trans;
+  float trans_fg_to_fg, trans_fg_to_bg, trans_bg_to_fg, trans_bg_to_bg;
+  trans_fg_to_fg = 0.4; // transition probability from FG to FG
+  trans_fg_to_bg = 0.6; // transition probability from FG to BG
+  trans_bg_to_fg = 0.4; // transition probability from BG to FG
+  trans_bg_to_bg = 0.6; // transition probability from BG to BG
+  float ttmp, ttmp_neg;
+  int nscales = miEvalScales;
+
+  computePosteriors();
+  const colour_bin_t* bins = mBins.data();
+  const int* start = mScaleStart.data();
+  // bins of the current line, pixel_bins[s*w+sj] at scale s
+  const unsigned short* pixel_bins = mLineBins.data();
+  int w = miLineWidth;
 
   for(si=0; si<roiny; si++)
   {
-    i = si+roi->miFirstLine;
-    dy = si-rh2;
+    i = si*ygrid_step+roi->miFirstLine;
+    dy = si*ygrid_step-rh2;
+    priorptr = prior->data(roi->miFirstColumn, i);
+    lineBins(iptr, roinx, xgrid_step, nscales);
     for(sj=0; sj<roinx; sj++)
     {
-      j = sj+roi->miFirstColumn;
+      prior_val = *priorptr;
+      priorptr+=rpixelstep;
+
+      tmpres=1.0;
       if (use_spatial_prior)
       {
-	dx = sj-rw2;
+	dx = sj*xgrid_step-rw2;
 	spatial_prior = exp(-0.5*(dx*dx/sigmax/sigmax+dy*dy/sigmay/sigmay)); ///(2*M_PI*sigmax*sigmay);
+	if (prior_val>0.5)
+	  trans=0.6;   // transition probability from FG to BG
+	else 
+	  trans=0.4;   // transition probability from BG to FG
+	for(int s=0; s<nscales; s++)
+	{
+	  const colour_bin_t& c = bins[start[s] + pixel_bins[s*w+sj]];
+	  colour_prob = spatial_prior*c.fg*prior_val*trans + (1.0-spatial_prior)*c.bg*(1.0-prior_val)*(1.0-trans);
+	  if (colour_prob>0)
+	    tmpres *= spatial_prior*c.fg*prior_val*trans/colour_prob;
+	  else
+	    tmpres = 0.0;
+	}
       }
-
-      b = *iptr++; 
-      g = *iptr++;
-      r = *iptr++;
-
-      float trans;
-      float trans_fg_to_fg, trans_fg_to_bg, trans_bg_to_fg, trans_bg_to_bg;
-      prior_val = prior->get(j,i);  // TODO use pointer to traverse prior
-      trans_fg_to_fg = 0.4; // transition probability from FG to FG
-      trans_fg_to_bg = 0.6; // transition probability from FG to BG
-      trans_bg_to_fg = 0.4; // transition probability from BG to FG
-      trans_bg_to_bg = 0.6; // transition probability from BG to BG
-      if (prior_val>0.5)
-	trans=0.6;   // transition probability from FG to BG
-      else 
-	trans=0.4;   // transition probability from BG to FG
-
-      float ttmp, ttmp_neg;
-      tmpres=1.0;
-      for(int s=0; s<mHist[0]->niScales; s++)
+      else if (prior_val==0 || prior_val==1)
       {
-      index = mLUT[s]->hsv_bin(r,g,b);
-      if (use_spatial_prior)
-      {
-	colour_prob = spatial_prior*mHist[0]->hsv_count[s][index]*prior_val*trans + (1.0-spatial_prior)*mHist[1]->hsv_count[s][index]*(1.0-prior_val)*(1.0-trans);
-	if (colour_prob>0)
-	  tmpres *= spatial_prior*mHist[0]->hsv_count[s][index]*prior_val*trans/colour_prob;
-	else
-	  tmpres = 0.0;
+	// posterior of the bin (0 for the empty bins)
+	for(int s=0; s<nscales; s++)
+	  tmpres *= bins[start[s] + pixel_bins[s*w+sj]].fg_posterior;
       }
       else
       {
-	ttmp = ((mHist[0]->hsv_count[s][index]*prior_val*trans_fg_to_fg) + mHist[0]->hsv_count[s][index]*(1.0-prior_val)*trans_bg_to_fg);
-	ttmp_neg = ((mHist[1]->hsv_count[s][index]*prior_val*trans_fg_to_bg) + mHist[1]->hsv_count[s][index]*(1.0-prior_val)*trans_bg_to_bg);
-	if (ttmp+ttmp_neg>0)
+	for(int s=0; s<nscales; s++)
 	{
-	  tmpres *= ttmp / (ttmp + ttmp_neg);
+	  const colour_bin_t& c = bins[start[s] + pixel_bins[s*w+sj]];
+	  ttmp = ((c.fg*prior_val*trans_fg_to_fg) + c.fg*(1.0-prior_val)*trans_bg_to_fg);
+	  ttmp_neg = ((c.bg*prior_val*trans_fg_to_bg) + c.bg*(1.0-prior_val)*trans_bg_to_bg);
+	  if (ttmp+ttmp_neg>0)
+	    tmpres *= ttmp / (ttmp + ttmp_neg);
+	  else
+	    tmpres = 0.0;
 	}
-
-	else
-	  tmpres = 0.0;
       }
+      if (xgrid_step==1)
+	*resptr = tmpres;
+      else
+      {
+	j = sj*xgrid_step+roi->miFirstColumn;
+	result->init(tmpres, roi->gridCell(j, i, xgrid_step));
       }
-      *resptr = tmpres;
 
-      iptr+=pixelstep;
       resptr+=rpixelstep;
     }
-    iptr+=xstep;
+    iptr+=ygrid_step*ws;
     resptr+=rxstep;
   }
   
@@ -341,7 +415,6 @@ void PixelClassColourModel::evaluate(Image8U* img, Rectangle* roi, Image<float>*
   roi->intersection(imgBB); 
   lastline = roi->lastLine();
   lastcol = roi->lastColumn();
-  unsigned char r, g, b;
   float xtrans, ytrans;
   int si, sj;
   int xgrid_step = 1; //max(1,roi->miWidth/30);
@@ -350,18 +423,17 @@ void PixelClassColourModel::evaluate(Image8U* img, Rectangle* roi, Image<float>*
   int rws = result->widthStep();
   int roinx = roi->miWidth/xgrid_step;
   int roiny = roi->miHeight/ygrid_step;
-  int pixelstep = (xgrid_step-1)*3;
   int rpixelstep = (xgrid_step);
-  int xstep = ws-xgrid_step*roinx*3 + (ygrid_step-1)*ws;
   int rxstep = rws-xgrid_step*roinx + (ygrid_step-1)*rws;
   unsigned char* iptr = (unsigned char*)img->data()+roi->miFirstLine*ws + roi->miFirstColumn*3;
-  float* resptr = result->data()+roi->miFirstLine*rws + roi->miFirstColumn;
+  float* resptr = result->data(roi->miFirstColumn, roi->miFirstLine);
   float colour_prob;
   float err_max = 30;
   float p_err_fg, p_err_bg = 1.0/err_max;;
   int i, j;
   float tmpexp;
   float den;
+  unsigned short* pixel_bins = mLineBins.data(); // bins of the current line
 #ifdef SPATIAL_PRIOR
   float spatial_prior;
   float dx, dy;
@@ -376,6 +448,7 @@ void PixelClassColourModel::evaluate(Image8U* img, Rectangle* roi, Image<float>*
     dy = si-rh2;
 #endif
     i = roi->miFirstLine+si*ygrid_step;
+    mLUT[1]->hsv_bins(iptr, roinx, xgrid_step, pixel_bins);
     for(sj=0; sj<roinx; sj++)
     {
 #ifdef SPATIAL_PRIOR
@@ -384,13 +457,10 @@ void PixelClassColourModel::evaluate(Image8U* img, Rectangle* roi, Image<float>*
 #endif
 
       j = roi->miFirstColumn+sj*xgrid_step;
-      b = *iptr++; 
-      g = *iptr++;
-      r = *iptr++;
       tmpexp = (bp_img->get(j,i)-mfMeanFGVoteErr);
       p_err_fg = 1.0/(sqrtf(2.0*M_PI*mfVarFGVoteErr))*exp(-0.5*(tmpexp*tmpexp)/mfVarFGVoteErr);
 
-      index = mLUT[1]->hsv_bin(r,g,b);
+      index = pixel_bins[sj];
 
 #ifdef SPATIAL_PRIOR
       den = spatial_prior*mHist[0]->hsv_count[1][index]*p_err_fg*0.5 + (1.0-spatial_prior)*mHist[1]->hsv_count[1][index]*p_err_bg*0.5;
@@ -406,10 +476,9 @@ void PixelClassColourModel::evaluate(Image8U* img, Rectangle* roi, Image<float>*
       else
 	*resptr = 0;
 
-      iptr+=pixelstep;
       resptr+=rpixelstep;
     }
-    iptr+=xstep;
+    iptr+=ygrid_step*ws;
     resptr+=rxstep;
   }
   
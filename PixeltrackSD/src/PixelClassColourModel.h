@@ -18,7 +18,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef PIXELCLASSCOLOURMODEL_H
 #define PIXELCLASSCOLOURMODEL_H
 
+#include <vector>
 #include "Histogram.h"
+#include "GaussianKernel.h"
 #include "Image.h"
 #include "BGR2HSVhistLUT.h"
 
@@ -40,6 +42,28 @@ class PixelClassColourModel
     float mfVarFGVoteErr;
     float mfMeanBGVoteErr;
     float mfVarBGVoteErr;
+    GaussianKernel mUpdateKernel; // spatial prior of update()
+
+    // per bin values of the current histograms, for each scale the bins
+    // mScaleStart[s] to mScaleStart[s+1]-1 (see computePosteriors())
+    typedef struct colour_bin_t
+    {
+      float fg;           // foreground histogram
+      float bg;           // background histogram
+      float fg_posterior; // evaluateColourWithPrior() factor for a prior of 0 or 1
+    } colour_bin_t;
+    std::vector<colour_bin_t> mBins;
+    std::vector<double> mColourRatio; // evaluateColour() factor
+    std::vector<int> mScaleStart;
+    int miGridStep;   // sampling step of evaluateColourWithPrior()
+    int miEvalScales; // scales of evaluateColourWithPrior()
+    std::vector<unsigned short> mLineBins; // bins of a line of the evaluation, by scale
+    int miLineWidth; // image width, scale stride of mLineBins
+
+    void computePosteriors();
+    // bins of n pixels of a BGR line, step pixels apart, at the nscales
+    // first scales (in mLineBins)
+    void lineBins(const unsigned char* bgr, int n, int step, int nscales);
 
   public:
     PixelClassColourModel(BGR2HSVhistLUT** lut, int h_bins, int s_bins, int v_bins, int _niScales, int imgw, int imgh);
@@ -50,6 +74,11 @@ class PixelClassColourModel
     void update(Image8U* img, Rectangle* outer_bb, Image<float>* segmentation, Image<float>* bp_img, float update_factor);
     void evaluateColour(Image8U* img, Rectangle* roi, bool use_spatial_prior, Image<float>* result); 
     void evaluateColourWithPrior(Image8U* img, Rectangle* roi, bool use_spatial_prior, Image<float>* prior, Image<float>* result);
+    // trade accuracy for speed in evaluateColourWithPrior(): the pixels of
+    // roi are sampled every step pixels in both directions (the result is
+    // set for the step x step block of each sample), with the histograms
+    // of the nscales first scales (all by default)
+    void setEvaluationQuality(int step, int nscales);
     void evaluate(Image8U* img, Rectangle* roi, Image<float>* bp_img, Image<float>* result); 
 };
 
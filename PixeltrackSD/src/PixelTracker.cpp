@@ -1,9 +1,13 @@
 
 #include "PixelTracker.h"
 
+#include <algorithm>
+
 #include "BGR2HSVhistLUT.h"
-#include "OutputXMLFile.h"
-#include "OutputTXTFile.h"
+#include "LUTCache.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+#include "Output.h"
 #include "HSVPixelGradientModel.h"
 #include "PixelClassColourModel.h"
 
@@ -16,9 +20,37 @@ PixelTracker::PixelTracker( int _bbox_x, int _bbox_y, int _bbox_width, int _bbox
 	segmentation_update_factor = _segmentation_update_factor;
 	search_size = _search_size;
 
-	xmlout = new OutputXMLFile("output.xml");
-	txtout = new OutputTXTFile("output.txt");
-	model = new HSVPixelGradientModel(16, 16, 8, 1, 60); // best
+	// created with the first image
+	model = NULL;
+	pccm = NULL;
+	lut = NULL;
+	shared_images = false;
+	grey_img = NULL;
+	xgrad_img = NULL;
+	ygrad_img = NULL;
+	bin_img = NULL;
+	segmentation = NULL;
+	seg_prior = NULL;
+	seg_tmp = NULL;
+	voting_map = NULL;
+	voting_map_normalised = NULL;
+	bp_img = NULL;
+	bp_img_normalised = NULL;
+	window_tmp = NULL;
+	windowed_maps = false;
+	vote_pool = NULL;
+	scale_count = 1;
+	scale_step = 0.05;
+	scale_update = 0.5;
+	bb_scale = 1;
+	base_width = 0;
+	base_height = 0;
+	time_budget = 0;
+	quality_level = 0;
+	next_quality_level = 0;
+	fast_images = 0;
+	for(int s = 0; s < STAGE_COUNT; s++)
+		stage_time[s] = 0;
 
 	cur_bb = new Rectangle();
 	search_window = new Rectangle();
@@ -29,6 +61,8 @@ PixelTracker::PixelTracker( int _bbox_x, int _bbox_y, int _bbox_width, int _bbox
 	prev_shift_y = 0;
 
 	lut_nscales = 2;
+	colour_binning = FULL_LUT;
+	gradient_binning = FULL_LUT;
 
 	width = 0;
 	height = 0;
@@ -43,24 +77,33 @@ PixelTracker::~PixelTracker()
 {
 	delete seg_prior;
 	delete segmentation;
+	delete seg_tmp;
 	delete voting_map;
 	delete voting_map_normalised;
 	delete model;
 
-	delete grey_img;
-	delete xgrad_img;
-	delete ygrad_img;
+	if( ! shared_images )
+	{
+		delete grey_img;
+		delete xgrad_img;
+		delete ygrad_img;
+		delete bin_img;
+	}
 	delete bp_img;
 	delete bp_img_normalised;
+	delete window_tmp;
+	for(unsigned int k = 0; k < scale_maps.size(); k++)
+		delete scale_maps[k];
+	delete vote_pool;
 
 	delete pccm;
 
-	for(int s = 0; s < lut_nscales; s++)
-		delete lut[s];
-	delete [] lut;
-
-	delete xmlout;
-	delete txtout;
+	if( lut )
+	{
+		for(int s = 0; s < lut_nscales; s++)
+			LUTCache::release(lut[s]);
+		delete [] lut;
+	}
 
 	delete cur_bb;
 	delete search_window;
@@ -71,32 +114,357 @@ PixelTracker::~PixelTracker()
 
 //---------------------------------------------------------
 
+void PixelTracker::setColourBinning(int mode)
+{
+	if( ! firstImage )
+	{
+		std::cout << "PixelTracker::setColourBinning() error: must be called before the first image." << std::endl;
+		return;
+	}
+	colour_binning = mode;
+}
+
+//---------------------------------------------------------
+
+void PixelTracker::setGradientBinning(int mode)
+{
+	if( ! firstImage )
+	{
+		std::cout << "PixelTracker::setGradientBinning() error: must be called before the first image." << std::endl;
+		return;
+	}
+	gradient_binning = mode;
+}
+
+//---------------------------------------------------------
+
+void PixelTracker::setWindowedMaps(bool windowed)
+{
+	if( ! firstImage )
+	{
+		std::cout << "PixelTracker::setWindowedMaps() error: must be called before the first image." << std::endl;
+		return;
+	}
+	windowed_maps = windowed;
+}
+
+//---------------------------------------------------------
+
+void PixelTracker::setVotingThreads(int nthreads)
+{
+	// the threads are kept from one image to the next
+	delete vote_pool;
+	vote_pool = NULL;
+	if( nthreads != 1 )
+		vote_pool = new TLUtil::ThreadPool(nthreads);
+}
+
+//---------------------------------------------------------
+
+void PixelTracker::setScaleSearch(int nscales, float step, float update)
+{
+	if( ! firstImage )
+	{
+		std::cout << "PixelTracker::setScaleSearch() error: must be called before the first image." << std::endl;
+		return;
+	}
+	if( nscales != 1 && nscales != 3 && nscales != 5 )
+	{
+		std::cout << "PixelTracker::setScaleSearch() error: 1, 3 or 5 scales required." << std::endl;
+		return;
+	}
+	scale_count = nscales;
+	scale_step = step;
+	scale_update = update;
+}
+
+//---------------------------------------------------------
+
+void PixelTracker::setTimeBudget(float budget_ms)
+{
+	time_budget = max(0.0f, budget_ms);
+	if( time_budget == 0 )
+		next_quality_level = 0;
+}
+
+//---------------------------------------------------------
+
+// quality levels of setTimeBudget(), from the full quality: sampling step
+// and votes per pixel of the voting and backprojection, sampling step and
+// scales of the colour segmentation
+static const struct
+{
+	int vote_step;
+	int max_votes;
+	int colour_step;
+	int colour_scales;
+} quality_levels[PixelTracker::QUALITY_LEVELS] =
+{
+	{ 1, MAXVOTES,   1, 2 },
+	{ 1, MAXVOTES/2, 1, 2 },
+	{ 2, MAXVOTES/2, 2, 2 },
+	{ 2, MAXVOTES/2, 2, 1 },
+	{ 3, MAXVOTES/2, 2, 1 }
+};
+
+void PixelTracker::applyQuality(int level)
+{
+	quality_level = level;
+	model->setVoteQuality(quality_levels[level].vote_step, quality_levels[level].max_votes);
+	pccm->setEvaluationQuality(quality_levels[level].colour_step, quality_levels[level].colour_scales);
+}
+
+//---------------------------------------------------------
+
+void PixelTracker::adaptQuality()
+{
+	float total = 0;
+	for(int s = 0; s < STAGE_COUNT; s++)
+		total += stage_time[s];
+
+	// lowered at once when over the budget (by two levels well over it),
+	// raised after 10 images in a row under 60% of it
+	if( total > time_budget )
+	{
+		next_quality_level = min(QUALITY_LEVELS-1, quality_level + (total > 1.5*time_budget ? 2 : 1));
+		fast_images = 0;
+	}
+	else if( total < 0.6*time_budget && quality_level > 0 )
+	{
+		fast_images++;
+		if( fast_images >= 10 )
+		{
+			next_quality_level = quality_level - 1;
+			fast_images = 0;
+		}
+	}
+	else
+		fast_images = 0;
+}
+
+//---------------------------------------------------------
+
+HSVPixelGradientModel* PixelTracker::createModel(int colour_binning, int gradient_binning)
+{
+	return new HSVPixelGradientModel(16, 16, 8, 1, 60, colour_binning==COMPACT_LUT, gradient_binning==COMPACT_LUT); // best
+}
+
+//---------------------------------------------------------
+
+// lines of cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(2*w+1, 2*h+1))
+// as their half widths, see Image::erode()
+static void ellipseElement(int w, int h, std::vector<int>& element)
+{
+	double inv_r2 = h ? 1.0/((double)h*h) : 0;
+	element.resize(2*h+1);
+	for(int i = 0; i <= 2*h; i++)
+	{
+		int dy = i - h;
+		int dx = cvRound(w*std::sqrt((h*h - dy*dy)*inv_r2));
+		element[i] = min(dx, w);
+	}
+}
+
+//---------------------------------------------------------
+
+void PixelTracker::computeGradients(TLImageProc::Image<unsigned char> *image, TLImageProc::Rectangle roi, Image<unsigned char> *grey, Image<short> *xgrad, Image<short> *ygrad)
+{
+	// the gradients use the neighbouring pixels
+	Rectangle grey_roi(roi.miFirstColumn-1, roi.miFirstLine-1, roi.lastColumn()+1, roi.lastLine()+1);
+	image->toGreyScale(grey, grey_roi);
+	grey->sobelXY(xgrad, ygrad, roi);
+}
+
+//---------------------------------------------------------
+
+template<class T> void PixelTracker::placeWindow(Image<T> *&img, TLImageProc::Rectangle area)
+{
+	Rectangle imageBB(width, height);
+	area.intersection(imageBB);
+	int w = max(1, area.miWidth);
+	int h = max(1, area.miHeight);
+	if( img == NULL || img->width() < w || img->height() < h )
+	{
+		if( img )
+		{
+			w = max(w, img->width());
+			h = max(h, img->height());
+		}
+		delete img;
+		img = new Image<T>(w, h, 1);
+	}
+	int x = max(0, min(area.miFirstColumn, width - img->width()));
+	int y = max(0, min(area.miFirstLine, height - img->height()));
+	img->setOffset(x, y);
+	img->setZero();
+}
+
+//---------------------------------------------------------
+
+void PixelTracker::moveWindow(Image<float> *&img, TLImageProc::Rectangle area)
+{
+	Rectangle imageBB(width, height);
+	area.intersection(imageBB);
+	Rectangle covered = area;
+	Rectangle img_area = img->area();
+	covered.intersection(img_area);
+	if( covered.area() == area.area() )
+		return;
+
+	placeWindow(window_tmp, area);
+	img->copyTo(window_tmp);
+	std::swap(img, window_tmp);
+}
+
+//---------------------------------------------------------
+
+void PixelTracker::windowGradients(TLImageProc::Image<unsigned char> *image, TLImageProc::Rectangle roi)
+{
+	Rectangle grey_area(roi.miFirstColumn-1, roi.miFirstLine-1, roi.lastColumn()+1, roi.lastLine()+1);
+	placeWindow(grey_img, grey_area);
+	placeWindow(xgrad_img, roi);
+	placeWindow(ygrad_img, roi);
+	computeGradients(image, roi, grey_img, xgrad_img, ygrad_img);
+}
+
+//---------------------------------------------------------
+
+void PixelTracker::computeBinImage(TLImageProc::Image<unsigned char> *image, TLImageProc::Rectangle roi)
+{
+	if( shared_images || scale_count == 1 )
+		return;
+
+	if( windowed_maps )
+		placeWindow(bin_img, roi);
+	else if( bin_img == NULL )
+		bin_img = new Image<unsigned short>(width, height, 1);
+	model->computeBins(image, xgrad_img, ygrad_img, roi, bin_img);
+	model->setBinImage(bin_img);
+}
+
+//---------------------------------------------------------
+
+// votes around the maximum of map in roi, within the displacement
+// quantisation (a single pixel depends too much on the rounding of the
+// scaled displacements)
+static float peakStrength(Image<float> *map, Rectangle roi)
+{
+	Rectangle area = map->area();
+	roi.intersection(area);
+	int x = roi.miFirstColumn;
+	int y = roi.miFirstLine;
+	map->maxLoc(roi, x, y);
+	Rectangle peak(x - CLUSTER_SIZE, y - CLUSTER_SIZE, x + CLUSTER_SIZE, y + CLUSTER_SIZE);
+	peak.intersection(roi);
+	return map->sum(peak);
+}
+
+//---------------------------------------------------------
+
+float PixelTracker::voteScales(TLImageProc::Image<unsigned char> *image)
+{
+	int middle = scale_count/2;
+	for(int k = 0; k < scale_count; k++)
+	{
+		if( k == middle )
+			continue;
+		Rectangle area = model->voteArea(image, *search_window, scale_factors[k]);
+		if( windowed_maps )
+		{
+			area.outerBoundingBox(*search_window);
+			placeWindow(scale_maps[k], area);
+		}
+		else
+			scale_maps[k]->init(0, scale_dirty[k]);
+		scale_dirty[k] = area;
+	}
+
+	// voting_map is the map of the current scale
+	auto voteScale = [&](int k){
+		if( k == middle )
+			model->vote(image, xgrad_img, ygrad_img, *search_window, voting_map);
+		else
+			model->vote(image, xgrad_img, ygrad_img, *search_window, scale_maps[k], scale_factors[k], 0);
+	};
+	if( vote_pool )
+		vote_pool->run(scale_count, voteScale);
+	else
+		for(int k = 0; k < scale_count; k++)
+			voteScale(k);
+
+	int best = middle;
+	float best_peak = peakStrength(voting_map, *search_window);
+	for(int k = 0; k < scale_count; k++)
+	{
+		if( k == middle )
+			continue;
+		float peak = peakStrength(scale_maps[k], *search_window);
+		if( peak > best_peak )
+		{
+			best_peak = peak;
+			best = k;
+		}
+	}
+	if( best != middle )
+	{
+		std::swap(voting_map, scale_maps[best]);
+		std::swap(voting_dirty, scale_dirty[best]);
+	}
+	return scale_factors[best];
+}
+
+//---------------------------------------------------------
+
+Image<float>* PixelTracker::scaleMap(Image<float> *map, Image<float> *&scaled, float factor)
+{
+	if( scaled == NULL || scaled->width() != map->width() || scaled->height() != map->height() )
+	{
+		delete scaled;
+		scaled = new Image<float>(map->width(), map->height(), 1);
+	}
+	scaled->setOffset(map->offsetX(), map->offsetY());
+	map->multiply(factor, scaled);
+	return scaled;
+}
+
+//---------------------------------------------------------
+
 void PixelTracker::processFirstImage(TLImageProc::Image<unsigned char> *cur_image, int frameId, int time1, int time2)
 {
 	width = cur_image->width();
 	height = cur_image->height();
 
-	grey_img = new Image<unsigned char>(width, height, 1);
-
-	xgrad_img = new Image<short>(width, height, 1);
-	ygrad_img = new Image<short>(width, height, 1);
-	xgrad_img->setZero();
-	ygrad_img->setZero();
-	cur_image->toGreyScale(grey_img);
-	grey_img->sobelX(xgrad_img);
-	grey_img->sobelY(ygrad_img);
-
-	segmentation = new Image<float>(width, height, 1);
-	segmentation->setZero();
-	voting_map = new Image<float>(width, height, 1);
-	voting_map_normalised = new Image<float>(width, height, 1);
-	voting_map->setZero();
-	bp_img = new Image<float>(width, height, 1);
-	bp_img_normalised = new Image<float>(width, height, 1);
-	bp_img->setZero();
-
 	*outer_bb = *initial_rect;
 	outer_bb->enlarge(1.5);
+
+	if( windowed_maps )
+	{
+		// the other maps, and the grey and gradient images, are placed
+		// when their windows are known
+		placeWindow(segmentation, *outer_bb);
+	}
+	else
+	{
+		if( ! shared_images )
+		{
+			grey_img = new Image<unsigned char>(width, height, 1);
+
+			xgrad_img = new Image<short>(width, height, 1);
+			ygrad_img = new Image<short>(width, height, 1);
+			xgrad_img->setZero();
+			ygrad_img->setZero();
+			cur_image->toGreyScale(grey_img);
+			grey_img->sobelXY(xgrad_img, ygrad_img);
+		}
+
+		segmentation = new Image<float>(width, height, 1);
+		segmentation->setZero();
+		voting_map = new Image<float>(width, height, 1);
+		voting_map->setZero();
+		bp_img = new Image<float>(width, height, 1);
+		bp_img->setZero();
+	}
+
 	*cur_bb = *initial_rect;
 	*search_window = *cur_bb;
 	search_window->enlarge(search_size);
@@ -104,10 +472,11 @@ void PixelTracker::processFirstImage(TLImageProc::Image<unsigned char> *cur_imag
 	maxy = cur_bb->centerY();
 
 	// learn pixel colour model (FG / BG)
+	// the LUTs are shared with the other trackers
 	int nbins=12;
 	lut = new BGR2HSVhistLUT*[lut_nscales];
 	for( int s = 0; s < lut_nscales; s++)
-		lut[s] = new BGR2HSVhistLUT(nbins*(s+1), nbins*(s+1), nbins*(s+1));
+		lut[s] = LUTCache::acquireHistLUT(nbins*(s+1), nbins*(s+1), nbins*(s+1), 0.1, 0.2, colour_binning==COMPACT_LUT);
 
 	// create colour segmentation model
 	pccm = new PixelClassColourModel(lut, nbins, nbins, nbins, lut_nscales, width, height);
@@ -153,30 +522,57 @@ void PixelTracker::processFirstImage(TLImageProc::Image<unsigned char> *cur_imag
 	*search_window = *cur_bb;
 	search_window->enlarge(search_size);
 
-	erosion_type = cv::MORPH_ELLIPSE;
 	erosion_w = int(float(cur_bb->miWidth)/100+.5);
 	erosion_h = int(float(cur_bb->miHeight)/100+.5);
+	ellipseElement(erosion_w, erosion_h, erosion_element);
+
+	if( windowed_maps )
+	{
+		if( ! shared_images )
+			windowGradients(cur_image, *search_window);
+		Rectangle bp_area = *search_window;
+		bp_area.outerBoundingBox(*cur_bb);
+		placeWindow(bp_img, bp_area);
+		placeWindow(voting_map, *search_window);
+	}
+
+	if( scale_count > 1 )
+	{
+		base_width = cur_bb->miWidth;
+		base_height = cur_bb->miHeight;
+		scale_factors.resize(scale_count);
+		for(int k = 0; k < scale_count; k++)
+			scale_factors[k] = pow(1 + scale_step, k - scale_count/2);
+		scale_maps.assign(scale_count, NULL);
+		scale_dirty.assign(scale_count, Rectangle(width, height));
+		if( ! windowed_maps )
+		{
+			for(int k = 0; k < scale_count; k++)
+			{
+				if( k == scale_count/2 )
+					continue;
+				scale_maps[k] = new Image<float>(width, height, 1);
+				scale_maps[k]->setZero();
+			}
+		}
+	}
 
 	// learn pixel model
+	model = createModel(colour_binning, gradient_binning);
+	model->setBinImage(bin_img);
+	computeBinImage(cur_image, *search_window);
 	model->learn(cur_image, xgrad_img, ygrad_img, *search_window, segmentation);
 	model->backproject(cur_image, xgrad_img, ygrad_img, *search_window, bp_img, maxx, maxy);
 	// do a first update to re-inforce pixels with "correct" backprojection
 	pccm->update(cur_image, cur_bb, segmentation, bp_img, 0.1);
 	model->update(cur_image, xgrad_img, ygrad_img, *search_window, bp_img, 0.2); 
 
+	voting_dirty.initPosAndSize(0, 0, width, height);
+	bp_dirty = voting_dirty;
+	seg_dirty = voting_dirty;
+
 	// output first tracking result to XML file
-	xmlout->sendBB(cur_bb, 0, 0, 1.0);
-	txtout->sendBB(cur_bb, 0, 0, 1.0);
-	if( frameId != -1 )
-	{
-		xmlout->commit( frameId, time1, time2);
-		txtout->commit( frameId, time1, time2);
-	}
-	else
-	{
-		xmlout->commit( current_frame, time1, time2);
-		txtout->commit( current_frame, time1, time2);
-	}
+	outputResult( frameId, time1, time2);
 }
 
 //---------------------------------------------------------
@@ -191,37 +587,113 @@ void PixelTracker::process( TLImageProc::Image<unsigned char> *cur_image, int fr
 	}
 
 	current_frame++;
+	if( next_quality_level != quality_level )
+		applyQuality(next_quality_level);
+
+	// the pixels out of the search windows are not used
+	TLUtil::Timer timer;
+	timer.reset();
+	Rectangle roi = *search_window;
+	if( windowed_maps )
+		windowGradients(cur_image, roi);
+	else
+		computeGradients(cur_image, roi, grey_img, xgrad_img, ygrad_img);
+	computeBinImage(cur_image, roi);
+	stage_time[STAGE_PREPROCESS] = timer.stop()/1000.0;
+
+	timer.reset();
+	locate( cur_image);
+	stage_time[STAGE_LOCATE] = timer.stop()/1000.0;
+
+	timer.reset();
+	Rectangle covered = *search_window;
+	covered.intersection(roi);
+	if( covered.area() != search_window->area() )
+	{
+		if( windowed_maps )
+			windowGradients(cur_image, *search_window);
+		else
+			computeGradients(cur_image, *search_window, grey_img, xgrad_img, ygrad_img);
+		computeBinImage(cur_image, *search_window);
+	}
+	updateModels( cur_image);
+	stage_time[STAGE_UPDATE] = timer.stop()/1000.0;
+
+	if( time_budget > 0 )
+		adaptQuality();
+	outputResult( frameId, time1, time2);
+}
 
-	voting_map->setZero();
-	bp_img->setZero();
-	segmentation->setZero();
+//---------------------------------------------------------
 
-	cur_image->toGreyScale(grey_img);
-	grey_img->sobelX(xgrad_img);
-	grey_img->sobelY(ygrad_img);
+void PixelTracker::locate( TLImageProc::Image<unsigned char> *cur_image)
+{
+	if( windowed_maps )
+	{
+		// place the maps on the pixels used in this image
+		Rectangle voting_area = model->voteArea(cur_image, *search_window);
+		voting_area.outerBoundingBox(*search_window);
+		placeWindow(voting_map, voting_area);
+		Rectangle seg_area(search_window->miFirstColumn-erosion_w, search_window->miFirstLine-erosion_h, search_window->lastColumn()+erosion_w, search_window->lastLine()+erosion_h);
+		Rectangle shifted_bb = *cur_bb;
+		shifted_bb.translate(prev_shift_x, prev_shift_y);
+		seg_area.outerBoundingBox(*cur_bb);
+		seg_area.outerBoundingBox(shifted_bb);
+		moveWindow(seg_prior, seg_area);
+		placeWindow(segmentation, seg_area);
+		placeWindow(bp_img, *search_window);
+	}
+	else
+	{
+		voting_map->init(0, voting_dirty);
+		bp_img->init(0, bp_dirty);
+		segmentation->init(0, seg_dirty);
+	}
 
 	// ***** do the Hough voting **********
-	model->vote(cur_image, xgrad_img, ygrad_img, *search_window, voting_map);
+	voting_dirty = model->voteArea(cur_image, *search_window);
+	float scale = 1;
+	if( scale_count > 1 )
+		scale = voteScales(cur_image);
+	else if( ! vote_pool )
+		model->vote(cur_image, xgrad_img, ygrad_img, *search_window, voting_map);
+	else
+		model->voteParallel(cur_image, xgrad_img, ygrad_img, *search_window, voting_map, vote_pool);
 	voting_map->maxLoc(*search_window, maxx, maxy);
 
 	// segmentation
 	pccm->evaluateColourWithPrior(cur_image, search_window, false, seg_prior, segmentation);
 	cur_seg_change = segmentation->percentageChanged(*cur_bb, prev_shift_x, prev_shift_y, seg_prior);
-	// set segmentation prior for next iteration
-	delete seg_prior;
-	seg_prior = segmentation->clone();
 
 	uncertainty = max(0.2f, min(0.8f, cur_seg_change));
 	//MESSAGE(0, "uncertainty: " << uncertainty);
 
-	// opening
-	cv::Mat element = cv::getStructuringElement( erosion_type, cv::Size( 2*erosion_w + 1, 2*erosion_h+1 ), cv::Point( erosion_w, erosion_h ) );
-	cv::Mat mseg(segmentation->height(), segmentation->width(), CV_32F, segmentation->data(), segmentation->width()*sizeof(float));
-	cv::erode( mseg, mseg, element );
-	cv::dilate( mseg, mseg, element );
+	// opening, the segmentation is zero out of the search window
+	// (clipped to the image by evaluateColourWithPrior)
+	Rectangle opening_area = *search_window;
+	opening_area.initPosAndSize(opening_area.miFirstColumn-erosion_w, opening_area.miFirstLine-erosion_h, opening_area.miWidth+2*erosion_w, opening_area.miHeight+2*erosion_h);
+	Rectangle imageBB(width, height);
+	opening_area.intersection(imageBB);
+
+	// the opening is written to the prior, no longer used, and both are
+	// swapped: the prior of the next image is this segmentation before
+	// the opening, and no map is allocated or copied
+	if( windowed_maps )
+		seg_prior->setZero();
+	else
+		seg_prior->init(0, seg_dirty);
+	seg_dirty = opening_area;
+	if( ! seg_dirty.empty() )
+	{
+		placeWindow(seg_tmp, seg_dirty);
+		segmentation->erode(seg_tmp, seg_dirty, erosion_element);
+		seg_tmp->dilate(seg_prior, seg_dirty, erosion_element);
+	}
+	std::swap(segmentation, seg_prior);
 
 	// backprojection
 	model->backproject(cur_image, xgrad_img, ygrad_img, *search_window, bp_img, maxx, maxy);
+	bp_dirty = *search_window;
 
 	segmentation->centreOfMass(*search_window, cm_maxx, cm_maxy);
 	*prev_bb = *cur_bb;
@@ -229,24 +701,46 @@ void PixelTracker::process( TLImageProc::Image<unsigned char> *cur_image, int fr
 	prev_shift_x = cur_bb->centerX() - prev_bb->centerX();
 	prev_shift_y = cur_bb->centerY() - prev_bb->centerY();
 
+	if( scale != 1 )
+	{
+		// follow the scale of the strongest peak smoothly
+		bb_scale = max(0.25f, min(4.0f, bb_scale*(1 + scale_update*(scale - 1))));
+		int cx = cur_bb->centerX();
+		int cy = cur_bb->centerY();
+		cur_bb->initPosAndSize(0, 0, max(1, int(base_width*bb_scale + .5)), max(1, int(base_height*bb_scale + .5)));
+		cur_bb->setCenter(cx, cy);
+	}
+
 	*search_window = *cur_bb;
 	search_window->enlarge(search_size);
+}
 
-	pccm->update(cur_image, search_window, segmentation, bp_img, detector_update_factor);
-	model->update(cur_image, xgrad_img, ygrad_img, *search_window, segmentation, segmentation_update_factor); 
+//---------------------------------------------------------
 
-	// output tracking result to XML/TXT file
-	xmlout->sendBB(cur_bb, 0, 0, 1.0);
-	txtout->sendBB(cur_bb, 0, 0, 1.0);
-	if( frameId != -1 )
+void PixelTracker::updateModels( TLImageProc::Image<unsigned char> *cur_image)
+{
+	// adds a spatial prior to bp_img in the search window
+	if( windowed_maps )
 	{
-		xmlout->commit( frameId, time1, time2);
-		txtout->commit( frameId, time1, time2);
+		Rectangle bp_area = bp_dirty;
+		bp_area.outerBoundingBox(*search_window);
+		moveWindow(bp_img, bp_area);
 	}
-	else
+	pccm->update(cur_image, search_window, segmentation, bp_img, detector_update_factor);
+	bp_dirty.outerBoundingBox(*search_window);
+	model->update(cur_image, xgrad_img, ygrad_img, *search_window, segmentation, segmentation_update_factor); 
+}
+
+//---------------------------------------------------------
+
+void PixelTracker::outputResult(int frameId, int time1, int time2)
+{
+	// send tracking result to the outputs
+	int iter = (frameId != -1) ? frameId : current_frame;
+	for(unsigned int o = 0; o < outputs.size(); o++)
 	{
-		xmlout->commit( current_frame, time1, time2);
-		txtout->commit( current_frame, time1, time2);
+		outputs[o]->sendBB(cur_bb, 0, 0, 1.0);
+		outputs[o]->commit( iter, time1, time2);
 	}
 }
 
@@ -8,14 +8,19 @@
 	#define DLL_EXPORT
 #endif
 
+#include <vector>
 #include <opencv2/opencv.hpp>
 
 #include "Image.h"
 
 namespace TLInOut
 {
-	class OutputXMLFile;
-	class OutputTXTFile;
+	class Output;
+}
+
+namespace TLUtil
+{
+	class ThreadPool;
 }
 
 namespace TLImageProc
@@ -36,6 +41,15 @@ using namespace TLInOut;
 class DLL_EXPORT PixelTracker
 {
 	public:
+		// colour and gradient binning implementations, see setColourBinning()
+		enum { FULL_LUT, COMPACT_LUT };
+
+		// steps of an image timed by the tracker, see getStageTime()
+		enum { STAGE_PREPROCESS, STAGE_LOCATE, STAGE_UPDATE, STAGE_COUNT };
+
+		// number of quality levels of the adaptive mode, see setTimeBudget()
+		static const int QUALITY_LEVELS = 5;
+
 		/*
 		 * Constructor.
 		 * @param _bbox_x  bounding box initial x position 
@@ -53,6 +67,86 @@ class DLL_EXPORT PixelTracker
 		 */
 		~PixelTracker();
 
+		/*
+		 * Select the colour binning implementation, before the first image.
+		 * FULL_LUT (default) reads the bins from 16M entries LUTs (32 MB each),
+		 * COMPACT_LUT computes them from small tables that stay in cache.
+		 * Both give the same bins.
+		 * @param mode  FULL_LUT or COMPACT_LUT.
+		 */
+		void setColourBinning(int mode);
+
+		/*
+		 * Select the gradient binning implementation, before the first image.
+		 * FULL_LUT (default) reads the bins from a 8M entries LUT (33 MB),
+		 * COMPACT_LUT computes them from a 8 KB table. Both give the same bins.
+		 * @param mode  FULL_LUT or COMPACT_LUT.
+		 */
+		void setGradientBinning(int mode);
+
+		/*
+		 * Keep the segmentation, voting and backprojection maps, and the
+		 * grey and gradient images, in buffers sized to the search window
+		 * instead of the whole image, before the first image. The memory
+		 * of a tracker then depends on the object size instead of the
+		 * image size, the results are the same.
+		 * The maps given by the getters below are then windows of the
+		 * image (see Image::offsetX()).
+		 * @param windowed  true for window buffers, false for whole image
+		 * buffers (default).
+		 */
+		void setWindowedMaps(bool windowed);
+
+		/*
+		 * Share the Hough voting of each image between threads, with the
+		 * same results (see HSVPixelGradientModel::voteParallel()).
+		 * Worth it for large objects, when the tracker has the cores
+		 * for itself (not in a MultiPixelTracker).
+		 * @param nthreads  number of threads, 1 for serial voting (default),
+		 * number of cores if <= 0.
+		 */
+		void setVotingThreads(int nthreads);
+
+		/*
+		 * Adapt the size of the bounding box to the object, before the
+		 * first image. The Hough voting is done at nscales scales of the
+		 * model displacements, step apart around the current scale, in
+		 * separate maps (in parallel with setVotingThreads()). The box and
+		 * the search window follow the scale of the strongest peak, by
+		 * update times the change at each image, between 1/4 and 4 times
+		 * their initial size. The colour and gradient bins are computed
+		 * once for all the scales.
+		 * @param nscales  number of scales: 1 for a fixed size (default),
+		 * 3 or 5,
+		 * @param step  relative scale step,
+		 * @param update  update factor of the box size.
+		 */
+		void setScaleSearch(int nscales, float step = 0.05, float update = 0.5);
+
+		/*
+		 * Send the bounding box of each image to out (identifier 0), in
+		 * addition to the previous outputs. The results are not written
+		 * anywhere by default.
+		 * @param out  output, kept by the caller until the tracker is deleted
+		 * (see OutputXMLFile, OutputTXTFile, OutputCSVFile, OutputBuffer).
+		 */
+		void addOutput(TLInOut::Output* out)  { outputs.push_back(out); }
+
+		/*
+		 * Keep the processing time of each image under a budget by
+		 * lowering the quality of the tracking when needed, rather than
+		 * dropping images. From level 0 (full quality) to
+		 * QUALITY_LEVELS-1, the Hough voting, the backprojection and the
+		 * colour segmentation use fewer votes per pixel, then sample the
+		 * search window every 2 or 3 pixels, then use one colour scale.
+		 * The steps of each image are timed: the quality is lowered when
+		 * an image exceeds the budget, and raised when several images in
+		 * a row stay well under it.
+		 * @param budget_ms  time budget per image in milliseconds, 0 for
+		 * the full quality (default).
+		 */
+		void setTimeBudget(float budget_ms);
+
 		/*
 		 * Track object in image.
 		 * @param img  image to process.
@@ -63,7 +157,7 @@ class DLL_EXPORT PixelTracker
 		 * Track object in image.
 		 * @param image  image to process,
 		 * @param frameId  frame id if given by caller,
-		 * @param time1  frame time, if given by caller (used in output.xml file),
+		 * @param time1  frame time, if given by caller (timestamp of the outputs),
 		 * @param time2  frame time, if given by caller.
 		 */
 		void process(TLImageProc::Image<unsigned char> *image, int frameId = -1, int time1 = 0, int time2 = 0);
@@ -83,21 +177,29 @@ class DLL_EXPORT PixelTracker
 		int getCmMaxx(void)  { return cm_maxx; }
 		int getCmMaxy(void)  { return cm_maxy; }
 
-		Image<float>* getBpImgNormalised(void)
-		{
-			bp_img->multiply(1, bp_img_normalised);
-			return bp_img_normalised;
-		}
-
-		Image<float>* getVotingMapNormalised(void)
-		{
-			voting_map->multiply(0.01, voting_map_normalised);
-			return voting_map_normalised;
-		}
+		Image<float>* getBpImgNormalised(void)  { return scaleMap(bp_img, bp_img_normalised, 1); }
+		Image<float>* getVotingMapNormalised(void)  { return scaleMap(voting_map, voting_map_normalised, 0.01); }
 
 		Image<float>* getSegmentation(void)  { return segmentation; }
 
+		/*
+		 * Quality level used for the last image, 0 (full quality) to
+		 * QUALITY_LEVELS-1, see setTimeBudget().
+		 */
+		int getQualityLevel(void)  { return quality_level; }
+
+		/*
+		 * Time of a step of the last image in milliseconds.
+		 * @param stage  STAGE_PREPROCESS (grey, gradient and bin images),
+		 * STAGE_LOCATE (voting, segmentation and backprojection) or
+		 * STAGE_UPDATE (models update, and gradients of the new search
+		 * window).
+		 */
+		float getStageTime(int stage)  { return stage_time[stage]; }
+
 	protected:
+		friend class MultiPixelTracker;
+
 		/*
 		 * First image processing.
 		 * Do some initializations.
@@ -105,6 +207,69 @@ class DLL_EXPORT PixelTracker
 		 */
 		void processFirstImage(TLImageProc::Image<unsigned char> *cur_image, int frameId, int time1, int time2);
 
+		/*
+		 * Tracking steps of the following images: vote, segment and move
+		 * the bounding box and the search window (locate), then update the
+		 * models in the new search window (updateModels).
+		 * The grey and gradient images must be computed before each step.
+		 */
+		void locate(TLImageProc::Image<unsigned char> *cur_image);
+		void updateModels(TLImageProc::Image<unsigned char> *cur_image);
+		void outputResult(int frameId, int time1, int time2);
+
+		/*
+		 * Adaptive mode: set the quality of the models for the next image,
+		 * and choose the next one from the time of the last image.
+		 */
+		void applyQuality(int level);
+		void adaptQuality();
+
+		/*
+		 * Compute the grey and gradient images in roi (and the grey
+		 * image around it).
+		 */
+		static void computeGradients(TLImageProc::Image<unsigned char> *image, TLImageProc::Rectangle roi, Image<unsigned char> *grey, Image<short> *xgrad, Image<short> *ygrad);
+
+		/*
+		 * Windowed maps: move img so that it covers area (clipped to the
+		 * image) and set it to zero (placeWindow), or keep its pixels
+		 * covered by both positions (moveWindow). img is reallocated if it
+		 * is too small. The window stays in the image, so that the part of
+		 * a rectangle in the window is its part in the image when the
+		 * window covers it.
+		 */
+		template<class T> void placeWindow(Image<T> *&img, TLImageProc::Rectangle area);
+		void moveWindow(Image<float> *&img, TLImageProc::Rectangle area);
+
+		/*
+		 * Windowed maps: place the grey and gradient images on roi and
+		 * compute them.
+		 */
+		void windowGradients(TLImageProc::Image<unsigned char> *image, TLImageProc::Rectangle roi);
+
+		/*
+		 * Scale search: compute the model bins of roi in the bin image of
+		 * the tracker (unless shared_images).
+		 */
+		void computeBinImage(TLImageProc::Image<unsigned char> *image, TLImageProc::Rectangle roi);
+
+		/*
+		 * Scale search: vote at each scale, the map with the strongest
+		 * peak becomes voting_map.
+		 * @return  scale of this map.
+		 */
+		float voteScales(TLImageProc::Image<unsigned char> *image);
+
+		/*
+		 * map multiplied by factor, in scaled (allocated if needed).
+		 */
+		static Image<float>* scaleMap(Image<float> *map, Image<float> *&scaled, float factor);
+
+		/*
+		 * Pixel model, created with the first image.
+		 */
+		static HSVPixelGradientModel* createModel(int colour_binning, int gradient_binning);
+
 		/*
 		 * Class members.
 		 */
@@ -115,8 +280,7 @@ class DLL_EXPORT PixelTracker
 
 		bool firstImage; // first image flag
 
-		OutputXMLFile *xmlout;
-		OutputTXTFile *txtout;
+		std::vector<TLInOut::Output*> outputs;
 
 		TLImageProc::Rectangle *initial_rect; // initial search box
 
@@ -125,6 +289,8 @@ class DLL_EXPORT PixelTracker
 		int height; // images height
   
 		int lut_nscales;
+		int colour_binning;
+		int gradient_binning;
 		HSVPixelGradientModel* model;
 		TLImageProc::Rectangle *cur_bb, *search_window;
 		TLImageProc::Rectangle *outer_bb;
@@ -135,20 +301,52 @@ class DLL_EXPORT PixelTracker
 		int prev_shift_x, prev_shift_y;
 		TLImageProc::Rectangle *prev_bb;
 
+		// grey, gradient and model bin images, computed by a
+		// MultiPixelTracker if shared_images (not owned then), the bin
+		// image is only used by the scale search otherwise
+		bool shared_images;
 		Image<unsigned char> *grey_img;
 		Image<short> *xgrad_img;
 		Image<short> *ygrad_img;
+		Image<unsigned short> *bin_img;
+		// segmentation and its prior are swapped after each image, see locate()
 		Image<float> *segmentation;
 		Image<float> *seg_prior;
+		Image<float> *seg_tmp; // erosion buffer
 		Image<float> *voting_map;
 		Image<float> *voting_map_normalised;
 		Image<float> *bp_img;
 		Image<float> *bp_img_normalised;
+		// parts of voting_map, bp_img and segmentation (and seg_prior) written
+		// with the previous image, the rest of these images is zero
+		TLImageProc::Rectangle voting_dirty, bp_dirty, seg_dirty;
+		// the maps are windows placed in each image, see setWindowedMaps()
+		bool windowed_maps;
+		Image<float> *window_tmp; // moveWindow() buffer
+		TLUtil::ThreadPool *vote_pool; // see setVotingThreads(), NULL if serial
+		// see setScaleSearch()
+		int scale_count;
+		float scale_step;
+		float scale_update;
+		float bb_scale; // size of cur_bb relative to the one after the first image
+		int base_width, base_height;
+		std::vector<float> scale_factors; // scales relative to the current one
+		// voting maps of the other scales than the current one (the middle
+		// one is NULL), and their parts written with the previous image
+		std::vector<Image<float>*> scale_maps;
+		std::vector<TLImageProc::Rectangle> scale_dirty;
+		// see setTimeBudget()
+		float time_budget;
+		int quality_level; // of the last image
+		int next_quality_level;
+		int fast_images; // consecutive images well under the budget
+		float stage_time[STAGE_COUNT];
 		BGR2HSVhistLUT **lut;
 		PixelClassColourModel *pccm;
-		int erosion_type;
 		int erosion_w;
 		int erosion_h;
+		// half widths of the lines of the elliptic structuring element
+		std::vector<int> erosion_element;
 };
 
 #endif // PIXELTRACKER_H
@@ -206,6 +206,17 @@ namespace TLImageProc {
     (*this)=B;
   }
 
+  Rectangle Rectangle::gridCell(int column, int line, int step)
+  {
+    int last_col = column+step-1;
+    int last_li = line+step-1;
+    if (last_col+step > lastColumn())
+      last_col = lastColumn();
+    if (last_li+step > lastLine())
+      last_li = lastLine();
+    return Rectangle(column, line, last_col, last_li);
+  }
+
   void Rectangle::scale(float scalefactor)
   {
     miFirstColumn = int(miFirstColumn*scalefactor+.5);
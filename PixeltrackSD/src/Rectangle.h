@@ -69,6 +69,10 @@ namespace TLImageProc {
       float agarwal_measure(Rectangle& ground_truth);
       float pascal_measure(Rectangle& ground_truth);
       void outerBoundingBox(Rectangle & BBox2);
+      // cell of (column, line) in a grid of step x step cells covering
+      // the rectangle from its first pixel, the last cells extended to
+      // its last column and line
+      Rectangle gridCell(int column, int line, int step);
 
       void scale(float scalefactor);
       void scale(float width_scale, float height_scale);
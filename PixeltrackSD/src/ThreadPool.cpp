@@ -0,0 +1,106 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Parallel.h"
+#include "ThreadPool.h"
+
+namespace TLUtil
+{
+
+ThreadPool::ThreadPool(int nthreads)
+{
+  if (nthreads <= 0)
+    nthreads = hardwareThreads();
+  task_call = NULL;
+  current_task = NULL;
+  task_count = 0;
+  next_task = 0;
+  busy_workers = 0;
+  generation = 0;
+  stopping = false;
+  for(int t=0; t<nthreads-1; t++)
+    workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  started.notify_all();
+  for(unsigned int t=0; t<workers.size(); t++)
+    workers[t].join();
+}
+
+void ThreadPool::dispatch(int n, void (*call)(const void*, int), const void* task)
+{
+  if (workers.empty() || n <= 1)
+  {
+    for(int i=0; i<n; i++)
+      call(task, i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    task_call = call;
+    current_task = task;
+    task_count = n;
+    next_task = 0;
+    busy_workers = workers.size();
+    generation++;
+  }
+  started.notify_all();
+  runTasks();
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (busy_workers > 0)
+    finished.wait(lock);
+  current_task = NULL;
+}
+
+// take the tasks one by one until there is none left
+void ThreadPool::runTasks()
+{
+  for(int i=next_task++; i<task_count; i=next_task++)
+    task_call(current_task, i);
+}
+
+void ThreadPool::workerLoop()
+{
+  unsigned long done_generation = 0;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (!stopping && generation == done_generation)
+        started.wait(lock);
+      if (stopping)
+        return;
+      done_generation = generation;
+    }
+
+    runTasks();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--busy_workers == 0)
+      finished.notify_one();
+  }
+}
+
+}
@@ -0,0 +1,79 @@
+/*
+Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TL_THREADPOOL_H
+#define TL_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace TLUtil
+{
+
+/*
+ * Fixed set of worker threads running the tasks of run().
+ * The threads wait for work between two calls, so that small tasks
+ * (e.g. one tracked object in one frame) do not pay a thread creation.
+ * run() must not be called by several threads at a time.
+ */
+class ThreadPool
+{
+  public:
+    /*
+     * @param nthreads  number of threads including the caller of run(),
+     *                  hardwareThreads() if <= 0.
+     */
+    ThreadPool(int nthreads=0);
+    ~ThreadPool();
+
+    /*
+     * Call task(0) to task(n-1), in parallel threads. The calling thread
+     * also runs tasks. Returns when all the tasks are done. The task is
+     * called through a pointer, without copy or allocation.
+     */
+    template <class F> void run(int n, const F& task)  { dispatch(n, &callTask<F>, &task); }
+
+    /*
+     * Number of threads including the caller of run().
+     */
+    int size() { return workers.size()+1; }
+
+  private:
+    template <class F> static void callTask(const void* task, int i)  { (*static_cast<const F*>(task))(i); }
+    void dispatch(int n, void (*call)(const void*, int), const void* task);
+    void workerLoop();
+    void runTasks();
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+    void (*task_call)(const void*, int);
+    const void* current_task;
+    int task_count;
+    std::atomic<int> next_task;
+    int busy_workers;
+    unsigned long generation;
+    bool stopping;
+};
+
+}
+
+#endif
@@ -16,7 +16,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "Timer.h"
-#include <sys/time.h>
+#include <chrono>
 #include <stdlib.h>
 
 namespace TLUtil {
@@ -73,19 +73,11 @@ long long Timer::computeDelta(long long current_time_, long long previous_time_)
 	return delta;
 }
 
-/// returns timestamp in microseconds
+/// returns timestamp in microseconds, of a monotonic clock (portable, and
+/// not changed with the system time during the measures)
 long long Timer::getRunTime()
 {
-   	timeval tv;
-	long long ts;
-	
-    	gettimeofday(&tv, NULL);
-	
-    	ts  = tv.tv_sec;
-    	ts *= 1000000;
-    	ts += tv.tv_usec;
-
-	return ts;
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 Timer::~Timer()
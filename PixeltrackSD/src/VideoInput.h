@@ -38,6 +38,7 @@ class VideoInput
     float getFPS() { return mfFPS; };
 
     virtual bool nextImageAvailable()=0;
+    // the image is owned by the VideoInput, and valid until the next call
     virtual Image<unsigned char>* nextImage()=0;
 
     virtual unsigned long long getCurrentTimestampMs()=0;
@@ -31,6 +31,7 @@ VideoInputFile::VideoInputFile(string filename, float fps/*=-1*/)
   msFilename = filename;
   mbFrameGrabbed = false;
   mbNextImageAvailable = false;
+  mCurrentImage = NULL;
   mCapture = new cv::VideoCapture();
   if (!mCapture->open(msFilename))
   {
@@ -60,6 +61,7 @@ VideoInputFile::VideoInputFile(string filename, float fps/*=-1*/)
 VideoInputFile::~VideoInputFile()
 {
   delete mCapture;
+  delete mCurrentImage;
 }
 
 
@@ -88,11 +90,17 @@ Image<unsigned char>* VideoInputFile::nextImage()
   if (!mCapture->retrieve(mFrame))
     return NULL;
   
-  Image<unsigned char>* newimage = new Image<unsigned char>(mFrame.cols, mFrame.rows, 3, mFrame.step, mFrame.data);
+  // the frames are usually decoded in the same buffer, the image on it is
+  // only created again when the buffer changes
+  if (!mCurrentImage || mCurrentImage->data()!=mFrame.data || mCurrentImage->width()!=mFrame.cols || mCurrentImage->height()!=mFrame.rows || mCurrentImage->widthStep()!=(int)mFrame.step)
+  {
+    delete mCurrentImage;
+    mCurrentImage = new Image<unsigned char>(mFrame.cols, mFrame.rows, 3, mFrame.step, mFrame.data);
+  }
 
   VideoInput::miFramesRead++;
   mbFrameGrabbed=false;
-  return newimage;
+  return mCurrentImage;
 }
 
 
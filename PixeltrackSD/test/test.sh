@@ -27,7 +27,29 @@ function doTest()
 	logs="${logs}${msg}\n"
 }
 
+# $1: test name
+# $2: unit test command, succeeding when the test passes
+function doUnitTest()
+{
+	echo "-------------------------------"
+	echo "Running unit test '$1' ..."
+
+	eval "$2"
+	if [ "$?" = "0" ]
+	then
+		result="passed"
+	else
+		result="FAILED"
+	fi
+
+	msg="* Unit test '$1' $result."
+	echo "$msg"
+	logs="${logs}${msg}\n"
+}
+
 # run tests
+doUnitTest "image_simd" "../build/test_image_simd"
+doUnitTest "allocations" "../build/test_allocations"
 doTest "video" "../build/pixeltrack -s -f 10 -t 100 -b 5,80,10,20 ./video.avi"
 doTest "cliff-dive1" "../build/pixeltrack -s -b 146,110,66,38 ./cliff-dive1.avi"
 doTest "diving" "../build/pixeltrack -s -b 179,65,14,52 diving.avi"
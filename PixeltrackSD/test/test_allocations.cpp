@@ -0,0 +1,154 @@
+/*
+   Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   */
+
+/*
+ * Heap allocations of the PixelTracker frame loop.
+ *
+ * Tracks an object moving on synthetic frames with the full maps (the
+ * windowed maps grow when the search area does), and counts the calls to
+ * the global operator new made by PixelTracker::process(). After the
+ * second frame, the maps and the model buffers are reused: no allocation
+ * is allowed, also with the voting shared between threads and with the
+ * scale search. Returns EXIT_FAILURE otherwise.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <iostream>
+#include <new>
+
+#include "../src/Image.h"
+#include "../src/Rectangle.h"
+#include "../src/PixelTracker.h"
+
+using namespace std;
+using namespace TLImageProc;
+
+
+// allocations counted by the operator new below
+bool counting = false;
+long allocations = 0;
+
+void* operator new(size_t size)
+{
+	if (counting)
+		allocations++;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
+
+
+const int width = 320;
+const int height = 240;
+const int frames = 60;
+
+
+// synthetic frame: textured object moving on a textured background
+void make_frame(int index, Image<unsigned char>* img)
+{
+	float cx = width*0.5 + width*0.25*sin(index*0.07);
+	float cy = height*0.5 + height*0.2*cos(index*0.05);
+	float rx = height*0.2*0.4;
+	float ry = height*0.2*0.6;
+	for (int y=0; y<height; y++)
+	{
+		for (int x=0; x<width; x++)
+		{
+			unsigned char* p = img->data() + y*img->widthStep() + x*3;
+			float dx = (x-cx)/rx;
+			float dy = (y-cy)/ry;
+			if (dx*dx+dy*dy < 1)
+			{
+				p[0] = (unsigned char)(30 + 20*((x/3)&1));
+				p[1] = (unsigned char)(50 + 60*(dy>0));
+				p[2] = (unsigned char)(200 + 40*sin(x*0.3+y*0.2));
+			}
+			else
+			{
+				int t = ((x/8 + y/8) & 1) ? 40 : 0;
+				p[0] = (unsigned char)(60 + t + 30*sin(x*0.11+y*0.03));
+				p[1] = (unsigned char)(120 + t/2 + 40*cos(y*0.09));
+				p[2] = (unsigned char)(70 + 20*sin((x+y)*0.05));
+			}
+		}
+	}
+}
+
+
+// nthreads: see PixelTracker::setVotingThreads()
+// nscales: see PixelTracker::setScaleSearch()
+bool test_frame_loop(int nthreads, int nscales)
+{
+	Image<unsigned char> img(width, height, 3);
+	int bw = int(height*0.2*0.8);
+	int bh = int(height*0.2*1.2);
+	PixelTracker tracker(int(width*0.5 - bw/2), int(height*0.7 - bh/2), bw, bh, 0.1, 0.1, 2);
+	tracker.setVotingThreads(nthreads);
+	tracker.setScaleSearch(nscales);
+
+	long total = 0;
+	for (int i=0; i<frames; i++)
+	{
+		make_frame(i, &img);
+		allocations = 0;
+		counting = i>=2;
+		tracker.process(&img, i);
+		counting = false;
+		if (allocations)
+			cerr << "test_allocations: " << allocations << " allocations in frame " << i << " with " << nthreads << " voting threads and " << nscales << " scales" << endl;
+		total += allocations;
+	}
+	return total==0;
+}
+
+
+int main(int argc, char** argv)
+{
+	bool ok = test_frame_loop(1, 1);
+	ok = test_frame_loop(4, 1) && ok;
+	ok = test_frame_loop(4, 3) && ok;
+
+	cout << "test_allocations " << (ok ? "passed" : "FAILED") << endl;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,219 @@
+/*
+   Copyright (C) 2013 Stefan Duffner, LIRIS, INSA de Lyon, France
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+   */
+
+/*
+ * Unit test of the SIMD kernels of Image.
+ *
+ * The grey scale conversion and the Sobel filters computed with each
+ * instruction set the processor supports must be bit-exact with the
+ * scalar code, on all the BGR colours and on random images of various
+ * sizes, line steps, offsets and regions of interest.
+ * Returns EXIT_FAILURE on the first difference.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+#include "../src/Image.h"
+#include "../src/ImageSIMD.h"
+#include "../src/Rectangle.h"
+
+using namespace std;
+using namespace TLImageProc;
+
+const char* level_names[3] = { "none", "SSE2", "AVX2" };
+
+// image sizes, with widths around the vector lengths
+const int sizes[][2] = { {1,1}, {3,3}, {7,5}, {15,4}, {16,3}, {17,9}, {31,8}, {32,6}, {33,17}, {63,5}, {64,7}, {65,11}, {97,41}, {130,3}, {640,480} };
+const int n_sizes = sizeof(sizes)/sizeof(sizes[0]);
+
+
+unsigned int random_state = 12345;
+
+int random_int(int n)
+{
+	random_state = random_state*1103515245 + 12345;
+	return (random_state >> 8) % n;
+}
+
+
+// image with random pixels, padded lines and a random offset
+template<class T> Image<T>* random_image(int w, int h, int channels, bool offset)
+{
+	int step = w*channels + random_int(9);
+	T* data = new T[step*h];
+	for (int i=0; i<step*h; i++)
+		data[i] = (T) random_int(256);
+	Image<T>* img = new Image<T>(w, h, channels, step, data, false);
+	delete [] data;
+	if (offset)
+		img->setOffset(random_int(50), random_int(50));
+	return img;
+}
+
+
+// random rectangle overlapping area, may exceed it
+Rectangle random_roi(Rectangle area)
+{
+	int x = area.miFirstColumn - 2 + random_int(area.miWidth+2);
+	int y = area.miFirstLine - 2 + random_int(area.miHeight+2);
+	return Rectangle(x, y, x + random_int(area.miWidth+3), y + random_int(area.miHeight+3));
+}
+
+
+// blank image of the same size and offset as img
+template<class T, class U> Image<T>* same_size(Image<U>* img)
+{
+	Image<T>* res = new Image<T>(img->width(), img->height(), 1);
+	res->setZero();
+	res->setOffset(img->offsetX(), img->offsetY());
+	return res;
+}
+
+
+template<class T> bool same_pixels(Image<T>* a, Image<T>* b)
+{
+	return memcmp(a->data(), b->data(), a->widthStep()*a->height()*sizeof(T))==0;
+}
+
+
+bool report(bool ok, const string& what, int level, int w, int h)
+{
+	if (!ok)
+		cerr << "test_image_simd: " << what << " differs with " << level_names[level] << " on a " << w << "x" << h << " image" << endl;
+	return ok;
+}
+
+
+// all the BGR colours
+bool test_all_colours(int level)
+{
+	Image<unsigned char> img(4096, 4096, 3);
+	unsigned char* p = img.data();
+	for (int c=0; c<256*256*256; c++)
+	{
+		*p++ = c & 0xff;
+		*p++ = (c >> 8) & 0xff;
+		*p++ = c >> 16;
+	}
+
+	Image<unsigned char> ref(4096, 4096, 1);
+	Image<unsigned char> res(4096, 4096, 1);
+	setSimdLevel(SIMD_NONE);
+	img.toGreyScale(&ref);
+	setSimdLevel(level);
+	img.toGreyScale(&res);
+	return report(same_pixels(&ref, &res), "toGreyScale() of all colours", level, 4096, 4096);
+}
+
+
+bool test_grey_scale(int level, int w, int h)
+{
+	bool ok = true;
+	for (int offset=0; offset<2; offset++)
+	{
+		Image<unsigned char>* img = random_image<unsigned char>(w, h, 3, offset!=0);
+		Image<unsigned char>* ref = same_size<unsigned char>(img);
+		Image<unsigned char>* res = same_size<unsigned char>(img);
+
+		if (!offset)
+		{
+			setSimdLevel(SIMD_NONE);
+			img->toGreyScale(ref);
+			setSimdLevel(level);
+			img->toGreyScale(res);
+			ok = ok && report(same_pixels(ref, res), "toGreyScale()", level, w, h);
+		}
+		for (int r=0; r<4; r++)
+		{
+			Rectangle roi = random_roi(img->area());
+			setSimdLevel(SIMD_NONE);
+			img->toGreyScale(ref, roi);
+			setSimdLevel(level);
+			img->toGreyScale(res, roi);
+			ok = ok && report(same_pixels(ref, res), "toGreyScale(roi)", level, w, h);
+		}
+		delete img;
+		delete ref;
+		delete res;
+	}
+	return ok;
+}
+
+
+bool test_sobel(int level, int w, int h)
+{
+	bool ok = true;
+	for (int offset=0; offset<2; offset++)
+	{
+		Image<unsigned char>* img = random_image<unsigned char>(w, h, 1, offset!=0);
+		Image<short>* xref = same_size<short>(img);
+		Image<short>* yref = same_size<short>(img);
+		Image<short>* xres = same_size<short>(img);
+		Image<short>* yres = same_size<short>(img);
+
+		if (!offset)
+		{
+			setSimdLevel(SIMD_NONE);
+			img->sobelX(xref);
+			img->sobelY(yref);
+			setSimdLevel(level);
+			img->sobelXY(xres, yres);
+			ok = ok && report(same_pixels(xref, xres) && same_pixels(yref, yres), "sobelXY()", level, w, h);
+		}
+		for (int r=0; r<4; r++)
+		{
+			Rectangle roi = random_roi(img->area());
+			setSimdLevel(SIMD_NONE);
+			img->sobelX(xref, roi);
+			img->sobelY(yref, roi);
+			setSimdLevel(level);
+			img->sobelXY(xres, yres, roi);
+			ok = ok && report(same_pixels(xref, xres) && same_pixels(yref, yres), "sobelXY(roi)", level, w, h);
+		}
+		delete img;
+		delete xref;
+		delete yref;
+		delete xres;
+		delete yres;
+	}
+	return ok;
+}
+
+
+int main(int argc, char** argv)
+{
+	setSimdLevel(SIMD_AVX2);
+	int supported = simdLevel();
+	cout << "SIMD instruction set: " << level_names[supported] << endl;
+
+	bool ok = true;
+	for (int level=SIMD_SSE2; level<=supported; level++)
+	{
+		ok = ok && test_all_colours(level);
+		for (int s=0; s<n_sizes; s++)
+		{
+			ok = ok && test_grey_scale(level, sizes[s][0], sizes[s][1]);
+			ok = ok && test_sobel(level, sizes[s][0], sizes[s][1]);
+		}
+	}
+	setSimdLevel(SIMD_AVX2);
+
+	cout << "test_image_simd " << (ok ? "passed" : "FAILED") << endl;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}